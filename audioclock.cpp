@@ -0,0 +1,126 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "audioclock.h"
+
+AudioClock::AudioClock()
+{
+    reset();
+}
+
+///
+/// \brief AudioClock::reset
+///
+void AudioClock::reset()
+{
+    sample_rate = 0;
+    total_frames = 0;
+    start_us = -1;
+    drift_us = 0;
+    settled = false;
+    window_start_us = 0;
+    window_min_us = 0;
+}
+
+///
+/// \brief AudioClock::addBuffer
+///
+/// \param arrivalUs
+/// \param frames
+/// \param sampleRate
+///
+void AudioClock::addBuffer(qint64 arrivalUs, qint64 frames, int sampleRate)
+{
+    if (frames <= 0 || sampleRate <= 0)
+    {
+        return;
+    }
+
+    if (sampleRate != sample_rate)
+    {
+        reset();
+        sample_rate = sampleRate;
+    }
+
+    total_frames += frames;
+
+    // when sample 0 was captured, if this buffer had arrived without delay
+    qint64 implied = arrivalUs - total_frames * 1000000 / sample_rate;
+
+    if (start_us < 0)
+    {
+        start_us = implied;
+        window_start_us = arrivalUs;
+        window_min_us = 0;
+
+        return;
+    }
+
+    if (!settled)
+    {
+        start_us = qMin(start_us, implied);
+
+        if (arrivalUs - window_start_us >= WindowUs)
+        {
+            settled = true;
+            window_start_us = arrivalUs;
+            window_min_us = implied - start_us;
+        }
+
+        return;
+    }
+
+    window_min_us = qMin(window_min_us, implied - start_us);
+
+    if (arrivalUs - window_start_us >= WindowUs)
+    {
+        drift_us = window_min_us;
+        window_start_us = arrivalUs;
+        window_min_us = implied - start_us;
+    }
+}
+
+///
+/// \brief AudioClock::rate
+/// \return
+///
+double AudioClock::rate() const
+{
+    if (sample_rate <= 0 || total_frames <= 0)
+    {
+        return 1.0;
+    }
+
+    double audioUs = double(total_frames) * 1000000.0 / sample_rate;
+
+    if (audioUs + drift_us <= 0)
+    {
+        return 1.0;
+    }
+
+    return audioUs / (audioUs + drift_us);
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef AUDIOCLOCK_H
+#define AUDIOCLOCK_H
+
+#include <QtGlobal>
+
+///
+/// \brief The AudioClock class
+///
+/// Places an audio stream on the SessionClock. Each buffer's arrival time
+/// minus the audio received so far implies when the first sample was
+/// captured; delivery jitter only ever makes that later, so the minimum
+/// over a window is kept. The first window gives the start time, later
+/// windows how far the device clock has drifted from the session clock.
+///
+class AudioClock
+{
+public:
+    AudioClock();
+
+    void reset();
+
+    // frames that had all arrived by arrivalUs (SessionClock)
+    void addBuffer(qint64 arrivalUs, qint64 frames, int sampleRate);
+
+    bool isValid() const { return start_us >= 0; }
+
+    // session time of the first sample
+    qint64 startUs() const { return start_us; }
+
+    // session time the sample count is behind by; positive when the device runs slow
+    qint64 driftUs() const { return drift_us; }
+
+    // device seconds per session second
+    double rate() const;
+
+    qint64 frames() const { return total_frames; }
+    int sampleRate() const { return sample_rate; }
+
+private:
+    static const qint64 WindowUs = 2000000;
+
+    int sample_rate;
+    qint64 total_frames;
+
+    qint64 start_us;
+    qint64 drift_us;
+    bool settled;
+
+    qint64 window_start_us;
+    qint64 window_min_us;
+};
+
+#endif // AUDIOCLOCK_H
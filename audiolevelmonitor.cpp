@@ -0,0 +1,137 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "audiolevelmonitor.h"
+
+AudioLevelMonitor::AudioLevelMonitor(QObject *parent) : QObject(parent),
+    channels(0),
+    clips(0)
+{
+}
+
+///
+/// \brief AudioLevelMonitor::processBuffer
+///
+/// Runs on the monitor thread
+///
+/// \param buffer
+///
+void AudioLevelMonitor::processBuffer(const QAudioBuffer &buffer)
+{
+    AudioLevels levels;
+
+    if (!meter.measure(buffer, levels))
+    {
+        return;
+    }
+
+    for (int i = 0; i < levels.channels; ++i)
+    {
+        storeMax(peaks[i], int(levels.peak[i] * Scale));
+        storeMax(rmss[i], int(levels.rms[i] * Scale));
+
+        if (levels.clips[i] > 0)
+        {
+            clips.fetchAndAddRelaxed(int(levels.clips[i]));
+        }
+    }
+
+    channels.storeRelease(levels.channels);
+}
+
+///
+/// \brief AudioLevelMonitor::channelCount
+/// \return
+///
+int AudioLevelMonitor::channelCount() const
+{
+    return channels.loadAcquire();
+}
+
+///
+/// \brief AudioLevelMonitor::takeLevels
+///
+/// Called from the GUI thread
+///
+/// \param channel
+/// \param peak
+/// \param rms
+///
+/// \return false if nothing was metered on the channel since the last call
+///
+bool AudioLevelMonitor::takeLevels(int channel, qreal &peak, qreal &rms)
+{
+    if (channel < 0 || channel >= channelCount())
+    {
+        return false;
+    }
+
+    int p = peaks[channel].fetchAndStoreOrdered(-1);
+    int r = rmss[channel].fetchAndStoreOrdered(-1);
+
+    if (p < 0)
+    {
+        return false;
+    }
+
+    peak = qreal(p) / Scale;
+    rms = qreal(qMax(r, 0)) / Scale;
+
+    return true;
+}
+
+///
+/// \brief AudioLevelMonitor::clipCount
+/// \return
+///
+quint64 AudioLevelMonitor::clipCount() const
+{
+    return quint64(quint32(clips.loadAcquire()));
+}
+
+///
+/// \brief AudioLevelMonitor::storeMax
+///
+/// Keeps the larger of the stored and the new value
+///
+/// \param value
+/// \param candidate
+///
+void AudioLevelMonitor::storeMax(QAtomicInt &value, int candidate)
+{
+    int current = value.loadAcquire();
+
+    while (candidate > current)
+    {
+        if (value.testAndSetOrdered(current, candidate))
+        {
+            return;
+        }
+
+        current = value.loadAcquire();
+    }
+}
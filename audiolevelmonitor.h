@@ -0,0 +1,73 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef AUDIOLEVELMONITOR_H
+#define AUDIOLEVELMONITOR_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAudioBuffer>
+
+#include "audiometer.h"
+
+///
+/// \brief The AudioLevelMonitor class
+///
+/// Meters probed audio on its own thread. Results are kept in atomics as
+/// the loudest value since the last read, so the GUI can poll them at
+/// display rate instead of repainting for every buffer.
+///
+class AudioLevelMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AudioLevelMonitor(QObject *parent = 0);
+
+    int channelCount() const;
+
+    // peak and rms since the previous call, 0..1; resets the channel
+    bool takeLevels(int channel, qreal &peak, qreal &rms);
+
+    quint64 clipCount() const;
+
+public slots:
+    void processBuffer(const QAudioBuffer &buffer);
+
+private:
+    static const int Scale = 1 << 16;
+
+    static void storeMax(QAtomicInt &value, int candidate);
+
+    AudioMeter meter;
+
+    QAtomicInt channels;
+    QAtomicInt peaks[AudioLevels::MaxChannels];
+    QAtomicInt rmss[AudioLevels::MaxChannels];
+    QAtomicInt clips;
+};
+
+#endif // AUDIOLEVELMONITOR_H
@@ -0,0 +1,366 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "audiometer.h"
+
+#include <QAudioBuffer>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIOMETER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    template <typename T, int Channels>
+    void scalarKernel(const void *data, int frames, int channels, AudioLevels &out)
+    {
+        measureLevels<T, Channels>(static_cast<const T *>(data), frames, channels, out);
+    }
+
+#ifdef AUDIOMETER_SSE2
+
+    ///
+    /// \brief mergeLanes
+    ///
+    /// Lane l of an interleaved register always holds channel l % Channels, so
+    /// the per lane results fold straight into channels. The scalar tail is
+    /// merged on top.
+    ///
+    template <int Channels, int Lanes>
+    void mergeLanes(const float *lanePeak, const float *laneSum, const quint32 *laneClips, int frames,
+                    const AudioLevels &tail, int tailFrames, AudioLevels &out)
+    {
+        out.channels = Channels;
+
+        for (int c = 0; c < Channels; ++c)
+        {
+            float peak = tailFrames > 0 ? tail.peak[c] : 0.0f;
+            float sum = tailFrames > 0 ? tail.rms[c] * tail.rms[c] * tailFrames : 0.0f;
+            quint32 clips = tailFrames > 0 ? tail.clips[c] : 0;
+
+            for (int l = c; l < Lanes; l += Channels)
+            {
+                peak = qMax(peak, lanePeak[l]);
+                sum += laneSum[l];
+                clips += laneClips[l];
+            }
+
+            out.peak[c] = qMin(peak, 1.0f);
+            out.rms[c] = frames > 0 ? qMin(std::sqrt(sum / frames), 1.0f) : 0.0f;
+            out.clips[c] = clips;
+        }
+    }
+
+    ///
+    /// \brief int16Kernel
+    ///
+    /// Eight samples per step: peak from lane min/max, sum of squares in float,
+    /// clips counted with compare masks. Channels must divide 8.
+    ///
+    template <int Channels>
+    void int16Kernel(const void *data, int frames, int, AudioLevels &out)
+    {
+        const qint16 *samples = static_cast<const qint16 *>(data);
+        const int vectors = frames * Channels / 8;
+
+        // same threshold as the scalar path: |x| / 32767 >= AudioClipLevel
+        const qint16 clipAt = qint16(std::ceil(AudioClipLevel * 32767.0f));
+        const __m128i clipHigh = _mm_set1_epi16(clipAt - 1);
+        const __m128i clipLow = _mm_set1_epi16(1 - clipAt);
+        const __m128 scale = _mm_set1_ps(1.0f / 32767.0f);
+
+        __m128i laneMax = _mm_set1_epi16(0);
+        __m128i laneMin = _mm_set1_epi16(0);
+        __m128i laneClips = _mm_setzero_si128();
+        __m128 sumLow = _mm_setzero_ps();
+        __m128 sumHigh = _mm_setzero_ps();
+
+        quint32 clipTotals[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        for (int v = 0; v < vectors; ++v)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + v * 8));
+
+            laneMax = _mm_max_epi16(laneMax, x);
+            laneMin = _mm_min_epi16(laneMin, x);
+
+            // compare masks are -1, so subtracting counts hits per lane
+            __m128i clipped = _mm_or_si128(_mm_cmpgt_epi16(x, clipHigh), _mm_cmplt_epi16(x, clipLow));
+            laneClips = _mm_sub_epi16(laneClips, clipped);
+
+            __m128 low = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), scale);
+            __m128 high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), scale);
+            sumLow = _mm_add_ps(sumLow, _mm_mul_ps(low, low));
+            sumHigh = _mm_add_ps(sumHigh, _mm_mul_ps(high, high));
+
+            // flush the 16 bit counters before they can wrap
+            if ((v & 0x3fff) == 0x3fff)
+            {
+                qint16 counts[8];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(counts), laneClips);
+                for (int l = 0; l < 8; ++l)
+                {
+                    clipTotals[l] += quint16(counts[l]);
+                }
+
+                laneClips = _mm_setzero_si128();
+            }
+        }
+
+        qint16 maxima[8], minima[8], counts[8];
+        float sums[8];
+        float peaks[8];
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(maxima), laneMax);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(minima), laneMin);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(counts), laneClips);
+        _mm_storeu_ps(sums, sumLow);
+        _mm_storeu_ps(sums + 4, sumHigh);
+
+        for (int l = 0; l < 8; ++l)
+        {
+            peaks[l] = qMax(float(maxima[l]), -float(minima[l])) / 32767.0f;
+            clipTotals[l] += quint16(counts[l]);
+        }
+
+        const int vectorFrames = vectors * 8 / Channels;
+
+        AudioLevels tail;
+        measureLevels<qint16, Channels>(samples + vectors * 8, frames - vectorFrames, Channels, tail);
+
+        mergeLanes<Channels, 8>(peaks, sums, clipTotals, frames, tail, frames - vectorFrames, out);
+    }
+
+    ///
+    /// \brief floatKernel
+    ///
+    /// Four samples per step. Channels must divide 4.
+    ///
+    template <int Channels>
+    void floatKernel(const void *data, int frames, int, AudioLevels &out)
+    {
+        const float *samples = static_cast<const float *>(data);
+        const int vectors = frames * Channels / 4;
+
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        const __m128 clipLevel = _mm_set1_ps(AudioClipLevel);
+
+        __m128 lanePeak = _mm_setzero_ps();
+        __m128 laneSum = _mm_setzero_ps();
+        __m128i laneClips = _mm_setzero_si128();
+
+        for (int v = 0; v < vectors; ++v)
+        {
+            __m128 x = _mm_loadu_ps(samples + v * 4);
+            __m128 magnitude = _mm_andnot_ps(signMask, x);
+
+            lanePeak = _mm_max_ps(lanePeak, magnitude);
+            laneSum = _mm_add_ps(laneSum, _mm_mul_ps(x, x));
+            laneClips = _mm_sub_epi32(laneClips, _mm_castps_si128(_mm_cmpge_ps(magnitude, clipLevel)));
+        }
+
+        float peaks[4], sums[4];
+        quint32 clips[4];
+
+        _mm_storeu_ps(peaks, lanePeak);
+        _mm_storeu_ps(sums, laneSum);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(clips), laneClips);
+
+        const int vectorFrames = vectors * 4 / Channels;
+
+        AudioLevels tail;
+        measureLevels<float, Channels>(samples + vectors * 4, frames - vectorFrames, Channels, tail);
+
+        mergeLanes<Channels, 4>(peaks, sums, clips, frames, tail, frames - vectorFrames, out);
+    }
+
+#endif // AUDIOMETER_SSE2
+
+    template <typename T>
+    AudioMeter::Kernel scalarFor(int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return &scalarKernel<T, 1>;
+        case 2:
+            return &scalarKernel<T, 2>;
+        case 4:
+            return &scalarKernel<T, 4>;
+        case 6:
+            return &scalarKernel<T, 6>;
+        case 8:
+            return &scalarKernel<T, 8>;
+        default:
+            return &scalarKernel<T, 0>;
+        }
+    }
+
+    AudioMeter::Kernel int16For(int channels)
+    {
+#ifdef AUDIOMETER_SSE2
+        switch (channels)
+        {
+        case 1:
+            return &int16Kernel<1>;
+        case 2:
+            return &int16Kernel<2>;
+        case 4:
+            return &int16Kernel<4>;
+        case 8:
+            return &int16Kernel<8>;
+        default:
+            break;
+        }
+#endif
+
+        return scalarFor<qint16>(channels);
+    }
+
+    AudioMeter::Kernel floatFor(int channels)
+    {
+#ifdef AUDIOMETER_SSE2
+        switch (channels)
+        {
+        case 1:
+            return &floatKernel<1>;
+        case 2:
+            return &floatKernel<2>;
+        case 4:
+            return &floatKernel<4>;
+        default:
+            break;
+        }
+#endif
+
+        return scalarFor<float>(channels);
+    }
+}
+
+///
+/// \brief AudioMeter::select
+///
+/// Resolves the kernel for a format
+///
+/// \param format
+///
+/// \return null if the format is not metered
+///
+AudioMeter::Kernel AudioMeter::select(const QAudioFormat &format)
+{
+    if (!format.isValid() || format.channelCount() <= 0)
+    {
+        return nullptr;
+    }
+
+    if (format.codec() != QLatin1String("audio/pcm"))
+    {
+        return nullptr;
+    }
+
+    // multi-byte samples are metered in native byte order only
+    if (format.sampleSize() > 8 && format.byteOrder() != QAudioFormat::Endian(QSysInfo::ByteOrder))
+    {
+        return nullptr;
+    }
+
+    const int channels = format.channelCount();
+
+    switch (format.sampleType())
+    {
+    case QAudioFormat::SignedInt:
+        switch (format.sampleSize())
+        {
+        case 8:
+            return scalarFor<qint8>(channels);
+        case 16:
+            return int16For(channels);
+        case 32:
+            return scalarFor<qint32>(channels);
+        default:
+            return nullptr;
+        }
+    case QAudioFormat::UnSignedInt:
+        switch (format.sampleSize())
+        {
+        case 8:
+            return scalarFor<quint8>(channels);
+        case 16:
+            return scalarFor<quint16>(channels);
+        case 32:
+            return scalarFor<quint32>(channels);
+        default:
+            return nullptr;
+        }
+    case QAudioFormat::Float:
+        return format.sampleSize() == 32 ? floatFor(channels) : nullptr;
+    default:
+        return nullptr;
+    }
+}
+
+///
+/// \brief AudioMeter::measure
+///
+/// \param data
+/// \param frames
+/// \param format
+/// \param out
+///
+/// \return false if the format is not metered
+///
+bool AudioMeter::measure(const void *data, int frames, const QAudioFormat &format, AudioLevels &out)
+{
+    if (format != kernel_format)
+    {
+        kernel_format = format;
+        kernel = select(format);
+    }
+
+    if (!kernel || frames < 0 || (!data && frames > 0))
+    {
+        return false;
+    }
+
+    kernel(data, frames, format.channelCount(), out);
+
+    return true;
+}
+
+///
+/// \brief AudioMeter::measure
+///
+/// \param buffer
+/// \param out
+///
+/// \return false if the buffer is not metered
+///
+bool AudioMeter::measure(const QAudioBuffer &buffer, AudioLevels &out)
+{
+    return measure(buffer.constData(), buffer.frameCount(), buffer.format(), out);
+}
@@ -0,0 +1,161 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef AUDIOMETER_H
+#define AUDIOMETER_H
+
+#include <QtGlobal>
+#include <QAudioFormat>
+
+#include <cmath>
+#include <limits>
+
+class QAudioBuffer;
+
+///
+/// \brief The AudioLevels struct
+///
+/// One buffer's worth of metering, normalized to full scale (0..1)
+///
+struct AudioLevels
+{
+    static const int MaxChannels = 32;
+
+    int channels = 0;
+
+    float peak[MaxChannels];
+    float rms[MaxChannels];
+    quint32 clips[MaxChannels];
+};
+
+///
+/// \brief The SampleTraits struct
+///
+/// Maps a raw sample type onto signed full scale: (x - offset) * scale
+///
+template <typename T>
+struct SampleTraits
+{
+    // unsigned formats are centred on half range
+    static float offset() { return std::numeric_limits<T>::is_signed ? 0.0f : float(std::numeric_limits<T>::max() / 2 + 1); }
+    static float scale() { return 1.0f / float(std::numeric_limits<T>::is_signed ? std::numeric_limits<T>::max() : std::numeric_limits<T>::max() / 2); }
+};
+
+template <>
+struct SampleTraits<float>
+{
+    static float offset() { return 0.0f; }
+    static float scale() { return 1.0f; }
+};
+
+// a sample this close to full scale counts as clipped
+static const float AudioClipLevel = 0.999f;
+
+///
+/// \brief measureLevels
+///
+/// Peak, RMS and clip count per channel in one pass. Channels is a compile
+/// time constant (0 = taken from the argument) so the inner loop has a
+/// fixed stride and no per-sample branches, and vectorizes as written.
+///
+/// \param data
+///
+/// Interleaved samples
+///
+/// \param frames
+/// \param channels
+///
+/// Only used when Channels == 0
+///
+/// \param out
+///
+template <typename T, int Channels>
+void measureLevels(const T *data, int frames, int channels, AudioLevels &out)
+{
+    const int stride = Channels > 0 ? Channels : qMin(channels, int(AudioLevels::MaxChannels));
+    const int step = Channels > 0 ? Channels : channels;
+    const float offset = SampleTraits<T>::offset();
+    const float scale = SampleTraits<T>::scale();
+
+    float peak[Channels > 0 ? Channels : AudioLevels::MaxChannels];
+    float sum[Channels > 0 ? Channels : AudioLevels::MaxChannels];
+    quint32 clips[Channels > 0 ? Channels : AudioLevels::MaxChannels];
+
+    for (int c = 0; c < stride; ++c)
+    {
+        peak[c] = 0.0f;
+        sum[c] = 0.0f;
+        clips[c] = 0;
+    }
+
+    for (int i = 0; i < frames; ++i, data += step)
+    {
+        for (int c = 0; c < stride; ++c)
+        {
+            float value = (float(data[c]) - offset) * scale;
+            float magnitude = std::fabs(value);
+
+            peak[c] = magnitude > peak[c] ? magnitude : peak[c];
+            sum[c] += value * value;
+            clips[c] += magnitude >= AudioClipLevel ? 1 : 0;
+        }
+    }
+
+    out.channels = stride;
+
+    for (int c = 0; c < stride; ++c)
+    {
+        out.peak[c] = qMin(peak[c], 1.0f);
+        out.rms[c] = frames > 0 ? qMin(std::sqrt(sum[c] / frames), 1.0f) : 0.0f;
+        out.clips[c] = clips[c];
+    }
+}
+
+///
+/// \brief The AudioMeter class
+///
+/// Picks the kernel for a buffer format once, and reuses it for every
+/// buffer until the format changes
+///
+class AudioMeter
+{
+public:
+    typedef void (*Kernel)(const void *data, int frames, int channels, AudioLevels &out);
+
+    AudioMeter() : kernel(nullptr) {}
+
+    bool measure(const QAudioBuffer &buffer, AudioLevels &out);
+    bool measure(const void *data, int frames, const QAudioFormat &format, AudioLevels &out);
+
+    static Kernel select(const QAudioFormat &format);
+
+private:
+    QAudioFormat kernel_format;
+    Kernel kernel;
+};
+
+#endif // AUDIOMETER_H
@@ -0,0 +1,216 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QAudioDeviceInfo>
+#include <QAudioInput>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+#include "audiopreroll.h"
+#include "sessionclock.h"
+
+///
+/// \brief AudioPreroll::AudioPreroll
+/// \param parent
+///
+AudioPreroll::AudioPreroll(QObject *parent) : QObject(parent)
+{
+
+}
+
+///
+/// \brief AudioPreroll::~AudioPreroll
+///
+AudioPreroll::~AudioPreroll()
+{
+    stop();
+}
+
+///
+/// \brief AudioPreroll::start
+///
+/// \param deviceName
+///
+/// As listed by QAudioRecorder::audioInputs(); unknown names use the default
+///
+/// \param sampleRate
+///
+/// 0 for the device's preferred rate
+///
+/// \param seconds
+///
+/// Audio kept while idle
+///
+/// \return
+///
+bool AudioPreroll::start(const QString &deviceName, int sampleRate, int seconds)
+{
+    stop();
+
+    QAudioDeviceInfo info = QAudioDeviceInfo::defaultInputDevice();
+
+    foreach (const QAudioDeviceInfo &candidate, QAudioDeviceInfo::availableDevices(QAudio::AudioInput))
+    {
+        if (candidate.deviceName() == deviceName)
+        {
+            info = candidate;
+            break;
+        }
+    }
+
+    audio_format = info.preferredFormat();
+    audio_format.setCodec(QLatin1String("audio/pcm"));
+    audio_format.setChannelCount(1);
+    audio_format.setSampleSize(16);
+    audio_format.setSampleType(QAudioFormat::SignedInt);
+    audio_format.setByteOrder(QAudioFormat::LittleEndian);
+
+    if (sampleRate > 0)
+    {
+        audio_format.setSampleRate(sampleRate);
+    }
+
+    if (!info.isFormatSupported(audio_format))
+    {
+        audio_format = info.nearestFormat(audio_format);
+    }
+
+    max_bytes = qint64(qMax(0, seconds)) * audio_format.bytesForDuration(1000000);
+
+    input = new QAudioInput(info, audio_format, this);
+    device = input->start();
+
+    if (!device)
+    {
+#ifdef QT_DEBUG
+        qDebug() << "AudioPreroll: could not open" << info.deviceName();
+#endif
+
+        stop();
+
+        return false;
+    }
+
+    connect(device, SIGNAL(readyRead()), this, SLOT(readAvailable()));
+
+#ifdef QT_DEBUG
+    qDebug() << "AudioPreroll: capturing" << info.deviceName() << audio_format.sampleRate() << "Hz";
+#endif
+
+    return true;
+}
+
+///
+/// \brief AudioPreroll::stop
+///
+void AudioPreroll::stop()
+{
+    if (input)
+    {
+        input->stop();
+        delete input;
+    }
+
+    input = nullptr;
+    device = nullptr;
+
+    buffered.clear();
+    buffered_bytes = 0;
+}
+
+///
+/// \brief AudioPreroll::setLive
+///
+/// Going idle starts a fresh pre-roll
+///
+/// \param value
+///
+void AudioPreroll::setLive(bool value)
+{
+    live = value;
+
+    if (!live)
+    {
+        buffered.clear();
+        buffered_bytes = 0;
+    }
+}
+
+///
+/// \brief AudioPreroll::takeBuffered
+///
+/// Hand over the pre-roll and go live, so nothing falls in between
+///
+/// \return
+///
+/// Blocks in capture order, each with its own arrival time, so the pre-roll
+/// is placed before the live audio rather than on top of it
+///
+QList<AudioBlock> AudioPreroll::takeBuffered()
+{
+    QList<AudioBlock> blocks;
+    blocks.swap(buffered);
+
+    buffered_bytes = 0;
+
+    live = true;
+
+    return blocks;
+}
+
+///
+/// \brief AudioPreroll::readAvailable
+///
+void AudioPreroll::readAvailable()
+{
+    AudioBlock block;
+    block.pcm = device->readAll();
+    block.arrival_us = SessionClock::elapsedMicroseconds();
+
+    if (block.pcm.isEmpty())
+    {
+        return;
+    }
+
+    if (live)
+    {
+        emit samples(block.pcm, block.arrival_us);
+
+        return;
+    }
+
+    buffered.append(block);
+    buffered_bytes += block.pcm.size();
+
+    while (buffered_bytes - buffered.first().pcm.size() >= max_bytes && buffered.count() > 1)
+    {
+        buffered_bytes -= buffered.first().pcm.size();
+        buffered.removeFirst();
+    }
+}
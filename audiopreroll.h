@@ -0,0 +1,98 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef AUDIOPREROLL_H
+#define AUDIOPREROLL_H
+
+#include <QObject>
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QList>
+
+class QAudioInput;
+class QIODevice;
+
+///
+/// \brief The AudioBlock struct
+///
+/// PCM as read, with the SessionClock time it had all arrived by
+///
+struct AudioBlock
+{
+    QByteArray pcm;
+    qint64 arrival_us = 0;
+};
+
+///
+/// \brief The AudioPreroll class
+///
+/// Continuous PCM capture for in-process recording. While idle it keeps
+/// only the last few seconds (the audio half of the pre-roll); once live it
+/// hands every block straight on through samples(). QAudioProbe only sees
+/// audio while QAudioRecorder is recording, hence a separate input.
+///
+class AudioPreroll : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AudioPreroll(QObject *parent = 0);
+    ~AudioPreroll();
+
+    bool start(const QString &deviceName, int sampleRate, int seconds);
+    void stop();
+
+    bool isLive() const { return live; }
+    void setLive(bool value);
+
+    QList<AudioBlock> takeBuffered();
+
+    const QAudioFormat& format() const { return audio_format; }
+
+    qint64 bytes() const { return buffered_bytes; }
+
+signals:
+    void samples(const QByteArray &pcm, qint64 arrivalUs);
+
+private slots:
+    void readAvailable();
+
+private:
+    QAudioInput *input = nullptr;
+    QIODevice *device = nullptr;
+
+    QAudioFormat audio_format;
+
+    // blocks as read; trimmed a whole block at a time
+    QList<AudioBlock> buffered;
+    qint64 buffered_bytes = 0;
+    qint64 max_bytes = 0;
+
+    bool live = false;
+};
+
+#endif // AUDIOPREROLL_H
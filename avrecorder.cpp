@@ -92,12 +92,18 @@
 #include <QDir>
 #include <QFileDialog>
 #include <QMediaRecorder>
+#include <QHideEvent>
 #include <QHostInfo>
+#include <QLabel>
 #include <QMessageBox>
 #include <QShortcut>
+#include <QShowEvent>
+#include <QGridLayout>
+#include <QtMath>
 #include <QStandardPaths>
 #include <QString>
 #include <QTimer>
+#include <QThread>
 
 #ifdef QT_DEBUG
 #include <QDebug>
@@ -105,14 +111,25 @@
 
 #include "avrecorder.h"
 #include "qaudiolevel.h"
+#include "previewwidget.h"
+#include "camerathread.h"
+#include "mediamuxer.h"
+#include "muxjobqueue.h"
+#include "audiopreroll.h"
+#include "audiolevelmonitor.h"
+#include "sessionclock.h"
+#include "recordingcatalog.h"
+#include "sessionlistdialog.h"
+#include "fileshipper.h"
+#include "storagemonitor.h"
 
 #include "ui_avrecorder.h"
 
-static qreal getPeakValue(const QAudioFormat &format);
-static QVector<qreal> getBufferLevels(const QAudioBuffer &buffer);
-
-template <class T>
-static QVector<qreal> getBufferLevels(const T *buffer, int frames, int channels);
+namespace
+{
+    // StorageMonitor volumes, in the order given to setPaths
+    enum { StagingVolume, OutputVolume, SecondaryVolume };
+}
 
 AvRecorder::AvRecorder(RecordSettingsData *recordSettings, QWidget *parent) :
     QMainWindow(parent),
@@ -138,6 +155,19 @@ AvRecorder::AvRecorder(RecordSettingsData *recordSettings, QWidget *parent) :
     connect(probe, SIGNAL(audioBufferProbed(QAudioBuffer)), this, SLOT(processBuffer(QAudioBuffer)));
     probe->setSource(audioRecorder);
 
+    // <!-- Setup Metering -->
+    // buffers are metered off the GUI thread; the meters only repaint at display rate
+    meterThread = new QThread(this);
+    levelMonitor = new AudioLevelMonitor;
+    levelMonitor->moveToThread(meterThread);
+    connect(probe, SIGNAL(audioBufferProbed(QAudioBuffer)), levelMonitor, SLOT(processBuffer(QAudioBuffer)));
+    meterThread->start();
+
+    meterTimer = new QTimer(this);
+    meterTimer->setInterval(1000 / qMax(1, meterFPS));
+    connect(meterTimer, SIGNAL(timeout()), this, SLOT(refreshLevels()));
+    meterTimer->start();
+
     connect(audioRecorder, SIGNAL(durationChanged(qint64)), this, SLOT(updateProgress(qint64)));
     connect(audioRecorder, SIGNAL(statusChanged(QMediaRecorder::Status)), this, SLOT(updateStatus(QMediaRecorder::Status)));
     connect(audioRecorder, SIGNAL(stateChanged(QMediaRecorder::State)), this, SLOT(onStateChanged(QMediaRecorder::State)));
@@ -151,12 +181,85 @@ AvRecorder::AvRecorder(RecordSettingsData *recordSettings, QWidget *parent) :
     connect(ui->lineEditTx, SIGNAL(textChanged(QString)), this, SLOT(changeTreatmentSlot(QString)));
     connect(ui->lineEditCond, SIGNAL(textChanged(QString)), this, SLOT(changeConditionSlot(QString)));
 
+    // <!-- Setup Preview -->
+    viewfinders.append(ui->viewfinder_0);
+
+    // GUI pulls the newest frame at the preview rate, independent of recording rate
+    previewTimer = new QTimer(this);
+    previewTimer->setInterval(1000 / qMax(1, previewFPS));
+    connect(previewTimer, SIGNAL(timeout()), this, SLOT(pullPreviews()));
+
+    // <!-- Setup Pipeline Statistics -->
+    latencyLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(latencyLabel);
+
+    muxLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(muxLabel);
+
+    statsTimer = new QTimer(this);
+    connect(statsTimer, SIGNAL(timeout()), this, SLOT(updateLatencyStatus()));
+    statsTimer->start(1000);
+
+    // <!-- Setup Pre-roll -->
+    if (prerollSeconds > 0 && inProcessMux && MediaMuxer::isAvailable())
+    {
+        // continuous capture; the last prerollSeconds lead into each recording
+        audioPreroll = new AudioPreroll(this);
+        connect(audioPreroll, SIGNAL(samples(QByteArray,qint64)), this, SLOT(forwardAudio(QByteArray,qint64)));
+
+        if (!audioPreroll->start(comboBoxAudioDevice, comboBoxAudioSampling.toInt(), prerollSeconds))
+        {
+            delete audioPreroll;
+            audioPreroll = nullptr;
+        }
+    }
+
     // <!-- Setup Conversion Process -->
-    combineStreamProcess = new QProcess(this);
-    connect(combineStreamProcess, SIGNAL(started()), this, SLOT(processStarted()));
-    connect(combineStreamProcess, SIGNAL(readyReadStandardOutput()), this,SLOT(readyReadStandardOutput()));
-    connect(combineStreamProcess, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)));
-    connect(combineStreamProcess, SIGNAL(finished(int)), this, SLOT(encodingFinished()));
+    // jobs run in the background; recording the next session never waits
+    muxQueue = new MuxJobQueue(this);
+    connect(muxQueue, SIGNAL(jobStarted(int,QString)), this, SLOT(muxJobStarted(int,QString)));
+    connect(muxQueue, SIGNAL(jobProgress(int,int)), this, SLOT(muxJobProgress(int,int)));
+    connect(muxQueue, SIGNAL(jobFinished(int,QString,bool)), this, SLOT(muxJobFinished(int,QString,bool)));
+
+    // <!-- Setup Catalog -->
+    catalog = new RecordingCatalog(this);
+    catalog->importDirectory(lineEditOutputDirectory, QStringList() << VIDEOEXT << MUXEXT);
+    connect(catalog, SIGNAL(changed()), this, SLOT(suggestSession()));
+
+    // <!-- Setup Delivery -->
+    // the output directory is often a network share: sessions only ever
+    // write to local disk, finished files are shipped in the background
+    outboxDirectory = tempWriteLocation + "/.sessionrecorder/outbox";
+
+    shipper = new FileShipper(this);
+    connect(shipper, SIGNAL(delivered(QString,qint64,QString)), this, SLOT(fileDelivered(QString,qint64,QString)));
+    connect(shipper, SIGNAL(deliveryFailed(QString,QString,int)), this, SLOT(fileDeliveryFailed(QString,QString,int)));
+
+    // <!-- Setup Storage Forecast -->
+    // free space is queried off the GUI thread; what is written is counted
+    if (!secondaryDirectory.isEmpty())
+    {
+        secondaryOutbox = secondaryDirectory + "/.sessionrecorder/outbox";
+    }
+
+    storageLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(storageLabel);
+
+    storageThread = new QThread(this);
+    storageMonitor = new StorageMonitor;
+    storageMonitor->moveToThread(storageThread);
+    connect(storageMonitor, SIGNAL(refreshed()), this, SLOT(updateStorageStatus()));
+    storageThread->start();
+
+    QMetaObject::invokeMethod(storageMonitor, "setPaths", Qt::QueuedConnection,
+                              Q_ARG(QStringList, QStringList() << tempWriteLocation
+                                                               << lineEditOutputDirectory
+                                                               << secondaryDirectory));
+
+    QShortcut *findShortcut = new QShortcut(QKeySequence::Find, this);
+    connect(findShortcut, SIGNAL(activated()), this, SLOT(showSessionList()));
+
+    suggestSession();
 }
 
 ///
@@ -253,6 +356,8 @@ void AvRecorder::setCameraStatus(bool value)
 void AvRecorder::changeIdSlot(QString value)
 {
     emit changeSessionConditionSignal(0, value);
+
+    suggestSession();
 }
 
 ///
@@ -271,6 +376,8 @@ void AvRecorder::changeSessionSlot(QString value)
 void AvRecorder::changeTreatmentSlot(QString value)
 {
     emit changeSessionConditionSignal(2, value);
+
+    suggestSession();
 }
 
 ///
@@ -289,6 +396,14 @@ AvRecorder::~AvRecorder()
 {
     delete audioRecorder;
     delete probe;
+
+    meterThread->quit();
+    meterThread->wait();
+    delete levelMonitor;
+
+    storageThread->quit();
+    storageThread->wait();
+    delete storageMonitor;
 }
 
 ///
@@ -302,9 +417,6 @@ void AvRecorder::updateProgress(qint64 duration)
         return;
     }
 
-    QFileInfo wavFile(tempWriteLocation+"/audio.wav");
-    QFileInfo ca1File(tempWriteLocation+"/" + VIDEOSTRING);
-
     qint64 duration_human = duration / 1000;
     QString duration_unit = "secs";
 
@@ -314,12 +426,28 @@ void AvRecorder::updateProgress(qint64 duration)
         duration_unit = "mins";
     }
 
-    ui->statusbar->showMessage(tr("Rec started %1 (%2 %3), audio %4 MB, camera 0: %5 MB")
+    QStringList cameraSizes;
+
+    qint64 totalBytes = audioBytes;
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        qint64 bytes = cameras.at(i)->bytesWritten();
+        totalBytes += bytes;
+
+        cameraSizes << tr("camera %1: %2 MB").arg(i).arg(bytes/1024/1024);
+    }
+
+    writeRate.addSample(totalBytes, duration);
+
+    ui->statusbar->showMessage(tr("Rec started %1 (%2 %3), audio %4 MB, %5")
                                .arg(rec_started.toString("hh:mm:ss"))
                                .arg(duration_human)
                                .arg(duration_unit)
-                               .arg(wavFile.size()/1024/1024)
-                               .arg(ca1File.size()/1024/1024));
+                               .arg(audioBytes/1024/1024)
+                               .arg(cameraSizes.join(", ")));
+
+    updateStorageStatus();
 }
 
 ///
@@ -331,10 +459,12 @@ void AvRecorder::updateStatus(QMediaRecorder::Status status)
 
     QString statusMessage;
 
+    int queuedJobs = 0;
+
     QString program = QString(lineEditFFmpegDirectory + "/ffmpeg");
 
-    QString audioSrc = QString(tempWriteLocation + "/audio.wav");
-    QString videoSrc = QString(tempWriteLocation + "/" + VIDEOSTRING);
+    QString audioSrc = QString(sessionWorkspace + "/audio.wav");
+    QString videoSrc = QString(sessionWorkspace + "/" + VIDEOSTRING);
 
 #ifdef QT_DEBUG
     qDebug() << "AvRecorder::updateStatus(QMediaRecorder::Status status)";
@@ -343,13 +473,6 @@ void AvRecorder::updateStatus(QMediaRecorder::Status status)
     qDebug() << program;
 #endif
 
-    QString id = ui->lineEditId->text();
-    QString sessNumber = QString::number(ui->lineEditSession->text().toInt());
-
-    QDir dirNew(QString("%1/%2/%3").arg(lineEditOutputDirectory)
-             .arg(id)
-             .arg(ui->lineEditTx->text()));
-
     switch (status) {
     case QMediaRecorder::RecordingStatus:
         statusMessage = tr("Starting to record...");
@@ -368,73 +491,79 @@ void AvRecorder::updateStatus(QMediaRecorder::Status status)
         qDebug() << "Video: " << videoSrc;
 #endif
 
-        QDir::setCurrent(tempWriteLocation);
-        combineStreamProcess->setWorkingDirectory(tempWriteLocation);
-
-        if (!dirNew.exists())
+        // one mux job per camera not already written in-process,
+        // all sharing the session's audio track; each is queued once its
+        // camera has released the temporary file
+        for (int i = 0; i < qMax(1, cameras.count()); ++i)
         {
-            dirNew.mkpath(".");
+            if (i < cameras.count() && cameras.at(i)->isMuxedInProcess())
+            {
+                continue;
+            }
+
+            PendingMuxJob pending;
+            pending.job.workspace = sessionWorkspace;
+            pending.job.program = program;
+            pending.job.output = stagedFilePath(i, VIDEOEXT);
+            pending.job.durationMs = rec_started.msecsTo(QDateTime::currentDateTime());
+            pending.videoFile = CameraThread::videoFileName(i);
+            pending.audio = audioClock;
+            pending.compress = ui->checkBoxCompression->isChecked();
+
+            QString path = i < cameras.count() ? cameras.at(i)->videoFilePath() : QString();
+
+            if (closedVideoFiles.contains(path))
+            {
+                enqueueMuxJob(pending, closedVideoFiles.take(path));
+            }
+            else if (i < cameras.count() && cameras.at(i)->isWriting())
+            {
+                pendingMuxJobs.insert(path, pending);
+            }
+            else
+            {
+                enqueueMuxJob(pending, i < cameras.count() ? cameras.at(i)->videoTiming() : VideoTiming());
+            }
+
+            queuedJobs++;
         }
 
-        /* If users wishes to use compression, apply here */
-        if (ui->checkBoxCompression->isChecked())
+        if (queuedJobs == 0)
         {
+            // every camera encoded in-process; nothing left in the workspace
+            MuxJobQueue::removeWorkspace(sessionWorkspace);
 
-#ifdef QT_DEBUG
-        qDebug() << QString("%1 -y -i %2 -i %3 -async 1 -vcodec libx264 -crf 24 %4/%5/%6/%7-%8.%9")
-                    .arg(program)
-                    .arg(VIDEOSTRING)
-                    .arg("audio.wav")
-                    .arg(lineEditOutputDirectory)
-                    .arg(id)
-                    .arg(ui->lineEditTx->text())
-                    .arg(sessNumber)
-                    .arg(ui->lineEditCond->text())
-                    .arg(VIDEOEXT);
-#endif
-
-            combineStreamProcess->start(QString("%1 -y -i %2 -i %3 -async 1 -vcodec libx264 -crf 24 %4/%5/%6/%7-%8.%9")
-                                        .arg(program)
-                                        .arg(VIDEOSTRING)
-                                        .arg("audio.wav")
-                                        .arg(lineEditOutputDirectory)
-                                        .arg(id)
-                                        .arg(ui->lineEditTx->text())
-                                        .arg(sessNumber)
-                                        .arg(ui->lineEditCond->text())
-                                        .arg(VIDEOEXT));
-
-            statusMessage = tr("Converting files...");
+            statusMessage = tr("Recording saved.");
         }
         else
         {
-#ifdef QT_DEBUG
-        qDebug() << QString("%1 -y -i %2 -i %3 -async 1 -c copy %4/%5/%6/%7-%8.%9")
-                    .arg(program)
-                    .arg(VIDEOSTRING)
-                    .arg("audio.wav")
-                    .arg(lineEditOutputDirectory)
-                    .arg(id)
-                    .arg(ui->lineEditTx->text())
-                    .arg(sessNumber)
-                    .arg(ui->lineEditCond->text())
-                    .arg(VIDEOEXT);
-#endif
+            statusMessage = tr("Recording saved; %1 file(s) queued for %2.")
+                    .arg(queuedJobs)
+                    .arg(ui->checkBoxCompression->isChecked() ? tr("conversion") : tr("combining"));
+        }
 
-            combineStreamProcess->start(QString("%1 -y -i %2 -i %3 -async 1 -c copy %4/%5/%6/%7-%8.%9")
-                                        .arg(program)
-                                        .arg(VIDEOSTRING)
-                                        .arg("audio.wav")
-                                        .arg(lineEditOutputDirectory)
-                                        .arg(id)
-                                        .arg(ui->lineEditTx->text())
-                                        .arg(sessNumber)
-                                        .arg(ui->lineEditCond->text())
-                                        .arg(VIDEOEXT));
-
-            statusMessage = tr("Combining files...");
+        // static-scene savings for the session just finished
+        for (int i = 0; i < cameras.count(); ++i)
+        {
+            SceneStats stats = cameras.at(i)->sceneStats();
+
+            if (stats.frames == 0)
+            {
+                continue;
+            }
+
+            statusMessage += tr(" Camera %1: %2% static, %3 of %4 frames skipped (threshold %5).")
+                    .arg(i)
+                    .arg(stats.staticFrames * 100 / stats.frames)
+                    .arg(stats.skippedFrames)
+                    .arg(stats.frames)
+                    .arg(stats.threshold, 0, 'f', 1);
         }
 
+        catalogSession();
+
+        advanceSession();
+
         ui->statusbar->showMessage(statusMessage);
 
         break;
@@ -458,64 +587,440 @@ void AvRecorder::updateStatus(QMediaRecorder::Status status)
 }
 
 ///
-/// \brief AvRecorder::readyReadStandardOutput
+/// \brief AvRecorder::advanceSession
+///
+/// Once per finished session, however many mux jobs it needed
 ///
-void AvRecorder::readyReadStandardOutput()
+void AvRecorder::advanceSession()
 {
+    /* If user wishes, increment session number, past any already recorded */
+    if (ui->checkBoxIncrement->isChecked())
+    {
+        ui->lineEditSession->setText(QString::number(qMax(sessionNumber + 1,
+                                                          catalog->nextSession(ui->lineEditId->text(),
+                                                                               ui->lineEditTx->text()))));
+    }
 
-#ifdef QT_DEBUG
-    qDebug() << combineStreamProcess->readAllStandardOutput();
-#endif
+    SaveCurrentOptions();
+}
+
+///
+/// \brief AvRecorder::catalogSession
+///
+/// Record the files of the session just finished; sizes and checksums
+/// follow once each file is closed
+///
+void AvRecorder::catalogSession()
+{
+    for (int i = 0; i < qMax(1, cameras.count()); ++i)
+    {
+        bool inProcess = i < cameras.count() && cameras.at(i)->isMuxedInProcess();
+
+        CatalogEntry entry = catalogEntry(i, sessionFilePath(i, inProcess ? MUXEXT : VIDEOEXT));
+        entry.durationMs = rec_started.msecsTo(QDateTime::currentDateTime());
+
+        catalog->addRecording(entry);
+    }
+}
 
+///
+/// \brief AvRecorder::catalogEntry
+///
+/// Catalog details of a file of the current session
+///
+/// \param camera
+/// \param path
+/// \return
+///
+CatalogEntry AvRecorder::catalogEntry(int camera, const QString &path) const
+{
+    CatalogEntry entry;
+    entry.path = path;
+    entry.id = ui->lineEditId->text();
+    entry.treatment = ui->lineEditTx->text();
+    entry.session = ui->lineEditSession->text().toInt();
+    entry.condition = ui->lineEditCond->text();
+    entry.camera = camera;
+    entry.recorded = rec_started;
+
+    return entry;
 }
 
 ///
-/// \brief AvRecorder::processStarted
+/// \brief AvRecorder::suggestSession
 ///
-void AvRecorder::processStarted()
+/// Offer the next unrecorded session number for this id and treatment
+///
+void AvRecorder::suggestSession()
 {
+    ui->lineEditSession->setPlaceholderText(QString::number(catalog->nextSession(ui->lineEditId->text(),
+                                                                                  ui->lineEditTx->text())));
+}
 
-#ifdef QT_DEBUG
-    qDebug() << "processStarted()";
-#endif
+///
+/// \brief AvRecorder::showSessionList
+///
+void AvRecorder::showSessionList()
+{
+    if (!sessionList)
+    {
+        sessionList = new SessionListDialog(catalog, this);
+    }
 
-    ui->recordButton->setEnabled(false);
+    sessionList->show();
+    sessionList->raise();
+    sessionList->activateWindow();
+}
 
-    /* If user wishes, increment session number */
-    if (ui->checkBoxIncrement->isChecked())
+///
+/// \brief AvRecorder::sessionFilePath
+///
+/// Output file for a camera of the current session
+///
+/// \param camera
+///
+/// Camera number; cameras after the first get a -camN suffix
+///
+/// \param ext
+/// \return
+///
+QString AvRecorder::sessionFilePath(int camera, const QString &ext) const
+{
+    QString name = QString("%1-%2").arg(QString::number(ui->lineEditSession->text().toInt()))
+                                   .arg(ui->lineEditCond->text());
+
+    if (camera > 0)
     {
-        ui->lineEditSession->setText(QString::number(sessionNumber + 1));
+        name += QString("-cam%1").arg(camera);
     }
 
-    SaveCurrentOptions();
+    return QString("%1/%2/%3/%4.%5").arg(lineEditOutputDirectory)
+            .arg(ui->lineEditId->text())
+            .arg(ui->lineEditTx->text())
+            .arg(name)
+            .arg(ext);
+}
+
+///
+/// \brief AvRecorder::stagedFilePath
+///
+/// Local counterpart of sessionFilePath: where the file is produced before
+/// it is shipped to the output directory
+///
+/// \param camera
+/// \param ext
+/// \return
+///
+QString AvRecorder::stagedFilePath(int camera, const QString &ext) const
+{
+    return (onSecondary ? secondaryOutbox : outboxDirectory) + "/" +
+            QDir(lineEditOutputDirectory).relativeFilePath(sessionFilePath(camera, ext));
+}
+
+///
+/// \brief AvRecorder::segmentFilePath
+///
+/// Staged file an in-process recording continues in after rolling over
+///
+/// \param camera
+/// \param segment
+///
+/// 1 for the first rollover; the file before it is segment 0
+///
+/// \return
+///
+QString AvRecorder::segmentFilePath(int camera, int segment) const
+{
+    QString path = stagedFilePath(camera, MUXEXT);
+    path.chop(QString(MUXEXT).length() + 1);
+
+    return QString("%1-part%2.%3").arg(path).arg(segment + 1).arg(MUXEXT);
 }
 
 ///
-/// \brief AvRecorder::encodingFinished
+/// \brief AvRecorder::destinationPath
+///
+/// Where a staged file is delivered to
+///
+/// \param staged
+/// \return
 ///
-void AvRecorder::encodingFinished()
+/// Empty if the file is not staged
+///
+QString AvRecorder::destinationPath(const QString &staged) const
 {
+    QStringList outboxes = QStringList() << outboxDirectory;
+
+    if (!secondaryOutbox.isEmpty())
+    {
+        outboxes << secondaryOutbox;
+    }
+
+    foreach (const QString &outbox, outboxes)
+    {
+        if (staged.startsWith(outbox + "/"))
+        {
+            return QDir(lineEditOutputDirectory).filePath(QDir(outbox).relativeFilePath(staged));
+        }
+    }
+
+    return QString();
+}
+
+///
+/// \brief AvRecorder::stagingLocation
+///
+/// Volume sessions are recorded on
+///
+/// \return
+///
+QString AvRecorder::stagingLocation() const
+{
+    return onSecondary ? secondaryDirectory : tempWriteLocation;
+}
+
+///
+/// \brief AvRecorder::deliverFile
+///
+/// Hand a finished local file to the shipper
+///
+/// \param staged
+///
+void AvRecorder::deliverFile(const QString &staged)
+{
+    QString destination = destinationPath(staged);
+
+    // written straight to the output directory (jobs from older versions)
+    if (destination.isEmpty())
+    {
+        catalog->verify(staged);
+        return;
+    }
+
+    shipper->enqueue(staged, destination);
+}
+
+///
+/// \brief AvRecorder::fileDelivered
+/// \param destination
+/// \param size
+/// \param checksum
+///
+void AvRecorder::fileDelivered(const QString &destination, qint64 size, const QString &checksum)
+{
+    catalog->setVerified(destination, size, checksum);
+
+    ui->statusbar->showMessage(tr("Delivered %1").arg(QFileInfo(destination).fileName()));
+}
+
+///
+/// \brief AvRecorder::fileDeliveryFailed
+/// \param destination
+/// \param error
+/// \param attempts
+///
+void AvRecorder::fileDeliveryFailed(const QString &destination, const QString &error, int attempts)
+{
+    displayErrorMessage(tr("Could not deliver %1 (attempt %2): %3. The local copy is kept and will be retried.")
+                        .arg(QFileInfo(destination).fileName())
+                        .arg(attempts)
+                        .arg(error));
+}
 
+///
+/// \brief AvRecorder::updateStorageStatus
+///
+/// Free space and, while recording, time until the staging and output
+/// volumes fill at the current write rate. Rolls the recording over to the
+/// secondary volume before the staging volume runs out.
+///
+void AvRecorder::updateStorageStatus()
+{
+    bool recording = audioRecorder->state() != QMediaRecorder::StoppedState;
+
+    // files pass through staging and end up in the output at the same rate
+    int volumes[] = { onSecondary ? SecondaryVolume : StagingVolume, OutputVolume };
+    QString names[] = { onSecondary ? tr("secondary") : tr("local"), tr("output") };
+    qint64 seconds[] = { -1, -1 };
+
+    QStringList summary;
+    bool low = false;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        qint64 available = storageMonitor->bytesAvailable(volumes[i]);
+
+        if (available < 0)
+        {
+            continue;
+        }
+
+        if (recording)
+        {
+            seconds[i] = writeRate.secondsUntil(qMax<qint64>(0, available - storageReserveBytes));
+        }
+
+        // recording and output on one volume: the first entry says it all
+        if (i > 0 && storageMonitor->rootPath(volumes[i]) == storageMonitor->rootPath(volumes[0]))
+        {
+            continue;
+        }
+
+        QString item = tr("%1 %2 GB free").arg(names[i]).arg(available / 1073741824.0, 0, 'f', 1);
+
+        if (seconds[i] >= 0)
+        {
+            item += seconds[i] < 6000 ? tr(" (~%1 min)").arg(seconds[i] / 60) : tr(" (~%1 h)").arg(seconds[i] / 3600);
+        }
+
+        low |= (seconds[i] >= 0 && seconds[i] < storageWarnMinutes * 60) ||
+               available < storageReserveBytes;
+
+        summary << item;
+    }
+
+    storageLabel->setText(summary.join(", "));
+    storageLabel->setStyleSheet(low ? QStringLiteral("QLabel { color: red }") : QString());
+    storageLabel->setToolTip(tr("Writing %1 MB/s").arg(writeRate.bytesPerSecond() / 1048576.0, 0, 'f', 2));
+
+    if (recording && !onSecondary && seconds[0] >= 0 && seconds[0] < failoverMinutes * 60)
+    {
+        rollOverToSecondary();
+    }
+}
+
+///
+/// \brief AvRecorder::rollOverToSecondary
+///
+/// Continue the current session, and record later ones, on the secondary
+/// volume. In-process files are split at the next frame; VideoWriter files
+/// and audio.wav cannot be and stay where they are.
+///
+void AvRecorder::rollOverToSecondary()
+{
+    if (secondaryOutbox.isEmpty())
+    {
+        return;
+    }
+
+    qint64 secondaryFree = storageMonitor->bytesAvailable(SecondaryVolume);
+
+    if (secondaryFree < storageReserveBytes ||
+        storageMonitor->rootPath(SecondaryVolume) == storageMonitor->rootPath(StagingVolume))
+    {
 #ifdef QT_DEBUG
-    qDebug() << "encodingFinished()";
+        qDebug() << "AvRecorder: no room to roll over to" << secondaryDirectory;
 #endif
 
-    ui->statusbar->showMessage(tr("Video operations completed."));
-    ui->recordButton->setEnabled(true);
+        return;
+    }
+
+    onSecondary = true;
+    segmentNumber++;
+
+    int rolled = 0;
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        QString path = segmentFilePath(i, segmentNumber);
+
+        QDir().mkpath(QFileInfo(path).absolutePath());
+
+        if (cameras.at(i)->rollOver(path))
+        {
+            rolled++;
+        }
+    }
+
+    displayErrorMessage(rolled == cameras.count() ?
+                            tr("%1 is almost full; recording continues on %2.")
+                            .arg(tempWriteLocation).arg(secondaryDirectory) :
+                            tr("%1 is almost full; %2 of %3 camera(s) continue on %4, the others cannot be split.")
+                            .arg(tempWriteLocation).arg(rolled).arg(cameras.count()).arg(secondaryDirectory));
 }
 
 ///
-/// \brief AvRecorder::processError
-/// \param err
+/// \brief AvRecorder::segmentStarted
 ///
-void AvRecorder::processError(QProcess::ProcessError err)
+/// A camera has rolled over; the new file is catalogued like the first
+///
+/// \param path
+///
+void AvRecorder::segmentStarted(const QString &path)
+{
+    int camera = cameras.indexOf(qobject_cast<CameraThread*>(sender()));
+
+    if (path.isEmpty())
+    {
+        displayErrorMessage(tr("Camera %1 could not continue in a new file; its recording has stopped.").arg(camera));
+        return;
+    }
+
+    if (!path.startsWith(secondaryOutbox + "/"))
+    {
+        displayErrorMessage(tr("Camera %1 could not switch volumes and continues in %2.").arg(camera).arg(path));
+    }
+
+    QString destination = destinationPath(path);
+
+    if (!destination.isEmpty())
+    {
+        catalog->addRecording(catalogEntry(camera, destination));
+    }
+}
+
+///
+/// \brief AvRecorder::muxJobStarted
+/// \param id
+/// \param output
+///
+void AvRecorder::muxJobStarted(int id, const QString &output)
 {
 #ifdef QT_DEBUG
-    qDebug() << err;
+    qDebug() << "Mux job" << id << "started:" << output;
 #else
-    Q_UNUSED(err);
+    Q_UNUSED(id);
 #endif
 
+    muxStatus = tr("Processing %1...").arg(QFileInfo(output).fileName());
+    muxLabel->setText(muxStatus);
+}
+
+///
+/// \brief AvRecorder::muxJobProgress
+/// \param id
+/// \param percent
+///
+void AvRecorder::muxJobProgress(int id, int percent)
+{
+    Q_UNUSED(id);
+
+    muxLabel->setText(tr("%1 %2% (%3 queued)").arg(muxStatus).arg(percent).arg(muxQueue->pending()));
+}
+
+///
+/// \brief AvRecorder::muxJobFinished
+/// \param id
+/// \param output
+/// \param ok
+///
+void AvRecorder::muxJobFinished(int id, const QString &output, bool ok)
+{
+    Q_UNUSED(id);
+
+    if (!ok)
+    {
+        displayErrorMessage(tr("Failed to process %1; the recording was kept in the temporary folder.").arg(output));
+
+        catalog->removeRecording(destinationPath(output));
+    }
+    else
+    {
+        deliverFile(output);
+    }
+
+    muxLabel->setText(muxQueue->pending() ? tr("%1 file(s) queued").arg(muxQueue->pending()) :
+                                            QString());
 }
 
 ///
@@ -541,6 +1046,23 @@ void AvRecorder::onStateChanged(QMediaRecorder::State state)
     }
 
     emit stateChanged(state);
+
+    if (audioPreroll)
+    {
+        if (state == QMediaRecorder::RecordingState && !audioPreroll->isLive())
+        {
+            // audio pre-roll goes first; a camera still finalizing its last
+            // file holds it until the new one is open
+            foreach (const AudioBlock &block, audioPreroll->takeBuffered())
+            {
+                forwardAudio(block.pcm, block.arrival_us);
+            }
+        }
+        else if (state == QMediaRecorder::StoppedState)
+        {
+            audioPreroll->setLive(false);
+        }
+    }
 }
 
 ///
@@ -558,6 +1080,12 @@ void AvRecorder::toggleRecord()
     ui->lineEditCond->setText(ui->lineEditCond->text().toUpper());
     qApp->processEvents();
 
+    /* Empty session: take the suggested one */
+    if (ui->lineEditSession->text().isEmpty())
+    {
+        ui->lineEditSession->setText(ui->lineEditSession->placeholderText());
+    }
+
     /* Check here if session is something that can be incremented*/
     if (!isSessionAnInt())
     {
@@ -568,13 +1096,11 @@ void AvRecorder::toggleRecord()
 
     /*If nagging the user*/
     if(ui->checkBoxNag->isChecked() &&
-            QFile::exists(QString("%1/%2/%3/%4-%5.mp4")
-                          .arg(lineEditOutputDirectory)
-                          .arg(ui->lineEditId->text())
-                          .arg(ui->lineEditTx->text())
-                          .arg(QString::number(ui->lineEditSession->text().toInt()).rightJustified(4, '0'))
-                          .arg(ui->lineEditCond->text())) &&
-            audioRecorder->state() == QMediaRecorder::StoppedState)
+            audioRecorder->state() == QMediaRecorder::StoppedState &&
+            catalog->contains(ui->lineEditId->text(),
+                              ui->lineEditTx->text(),
+                              sessionNumber,
+                              ui->lineEditCond->text()))
     {
         QMessageBox::StandardButton reply;
         reply = QMessageBox::question(this,
@@ -598,7 +1124,37 @@ void AvRecorder::toggleRecord()
 
         audioRecorder->setAudioInput(comboBoxAudioDevice);
 
-        audioRecorder->setOutputLocation(QUrl::fromLocalFile(tempWriteLocation+"/audio.wav"));
+        // every session records into its own workspace, so the next one can
+        // start while this one is still being muxed
+        sessionWorkspace = QString("%1/.sessionrecorder/%2").arg(stagingLocation())
+                .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz"));
+        QDir().mkpath(sessionWorkspace);
+
+        // left over only when a close raced the last stop status
+        closedVideoFiles.clear();
+
+        for (int i = 0; i < cameras.count(); ++i)
+        {
+            cameras.at(i)->setWorkspace(sessionWorkspace);
+        }
+
+        audioRecorder->setOutputLocation(QUrl::fromLocalFile(sessionWorkspace+"/audio.wav"));
+        audioClock.reset();
+
+        audioBytes = 0;
+        writeRate.reset();
+        segmentNumber = 0;
+
+        // encode straight into the final files where possible; audio.wav
+        // is still recorded for cameras that fall back to ffmpeg. Files are
+        // produced locally and shipped once complete
+        QDir().mkpath(QFileInfo(stagedFilePath(0, MUXEXT)).absolutePath());
+
+        for (int i = 0; i < cameras.count(); ++i)
+        {
+            cameras.at(i)->setMuxTarget((inProcessMux && MediaMuxer::isAvailable()) ? stagedFilePath(i, MUXEXT) : QString(),
+                                        ui->checkBoxCompression->isChecked());
+        }
 
         emit sendSessionDetails(ui->lineEditId->text(),
                                 ui->lineEditSession->text(),
@@ -699,6 +1255,17 @@ void AvRecorder::LoadCurrentOptions()
     ui->checkBoxIncrement->setChecked(settings.value(QLatin1String("checkBoxIncrement")).toBool());
     ui->checkBoxNag->setChecked(settings.value(QLatin1String("checkBoxNag")).toBool());
 
+    previewFPS = settings.value(QLatin1String("previewFPS"), 10).toInt();
+    meterFPS = settings.value(QLatin1String("meterFPS"), 30).toInt();
+
+    inProcessMux = settings.value(QLatin1String("inProcessMux"), true).toBool();
+    prerollSeconds = settings.value(QLatin1String("prerollSeconds"), 0).toInt();
+
+    secondaryDirectory = settings.value(QLatin1String("secondaryDirectory")).toString();
+    storageWarnMinutes = settings.value(QLatin1String("storageWarnMinutes"), 10).toInt();
+    failoverMinutes = settings.value(QLatin1String("failoverMinutes"), 3).toInt();
+    storageReserveBytes = settings.value(QLatin1String("storageReserveMB"), 512).toLongLong() << 20;
+
     settings.endGroup();
     settings.sync();
 }
@@ -740,156 +1307,326 @@ void AvRecorder::displayErrorMessage(const QString &e)
 }
 
 ///
-/// \brief getPeakValue
+/// \brief AvRecorder::refreshLevels
 ///
-/// This function returns the maximum possible sample value for a given audio format
+/// Display tick for the audio meters
 ///
-/// \param format
-/// \return
+void AvRecorder::refreshLevels()
+{
+    int channels = levelMonitor->channelCount();
+
+    if (audioLevels.count() != channels) {
+        qDeleteAll(audioLevels);
+        audioLevels.clear();
+        for (int i = 0; i < channels; ++i) {
+            QAudioLevel *level = new QAudioLevel(ui->centralwidget);
+            audioLevels.append(level);
+            ui->levelsLayout->addWidget(level);
+        }
+    }
+
+    for (int i = 0; i < audioLevels.count(); ++i)
+    {
+        qreal peak = 0;
+        qreal rms = 0;
+        bool fresh = levelMonitor->takeLevels(i, peak, rms);
+
+        audioLevels.at(i)->updateLevels(peak, rms, fresh);
+    }
+}
+
+///
+/// \brief AvRecorder::processBuffer
+/// \param buffer
 ///
-qreal getPeakValue(const QAudioFormat& format)
+void AvRecorder::processBuffer(const QAudioBuffer& buffer)
 {
-    // Note: Only the most common sample formats are supported
-    if (!format.isValid())
-        return qreal(0);
+    // the same buffers are written to audio.wav
+    audioClock.addBuffer(SessionClock::elapsedMicroseconds(), buffer.frameCount(), buffer.format().sampleRate());
+    audioBytes += buffer.byteCount();
 
-    if (format.codec() != "audio/pcm")
-        return qreal(0);
+    // same samples go into every in-process file, unless the pre-roll
+    // capture is supplying them
+    if (!audioPreroll)
+    {
+        for (int i = 0; i < cameras.count(); ++i)
+            cameras.at(i)->writeAudio(buffer);
+    }
+}
 
-    switch (format.sampleType()) {
-    case QAudioFormat::Unknown:
-        break;
-    case QAudioFormat::Float:
-        if (format.sampleSize() != 32) // other sample formats are not supported
-            return qreal(0);
-        return qreal(1.00003);
-    case QAudioFormat::SignedInt:
-        if (format.sampleSize() == 32)
-            return qreal(INT_MAX);
-        if (format.sampleSize() == 16)
-            return qreal(SHRT_MAX);
-        if (format.sampleSize() == 8)
-            return qreal(CHAR_MAX);
-        break;
-    case QAudioFormat::UnSignedInt:
-        if (format.sampleSize() == 32)
-            return qreal(UINT_MAX);
-        if (format.sampleSize() == 16)
-            return qreal(USHRT_MAX);
-        if (format.sampleSize() == 8)
-            return qreal(UCHAR_MAX);
-        break;
+///
+/// \brief AvRecorder::forwardAudio
+///
+/// PCM from the pre-roll capture, to every in-process file
+///
+/// \param pcm
+/// \param arrivalUs
+///
+void AvRecorder::forwardAudio(const QByteArray &pcm, qint64 arrivalUs)
+{
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        cameras.at(i)->writeAudio(pcm.constData(), pcm.size(), audioPreroll->format(), arrivalUs);
     }
+}
+
+///
+/// \brief AvRecorder::addCamera
+///
+/// Register a camera and give it a viewfinder; the first camera uses
+/// viewfinder_0, later ones are laid out with it in a grid
+///
+/// \param cam
+///
+void AvRecorder::addCamera(CameraThread *cam)
+{
+    if (cameras.count() >= viewfinders.count())
+    {
+        PreviewWidget *viewfinder = new PreviewWidget(this);
+        viewfinder->setFrameShape(QFrame::Box);
+        viewfinder->setMinimumSize(320, 240);
+        viewfinder->setSizePolicy(ui->viewfinder_0->sizePolicy());
+
+        viewfinders.append(viewfinder);
+
+        ui->viewfinder_0->setMinimumSize(320, 240);
+
+        layoutViewfinders();
+    }
+
+    PreviewWidget *viewfinder = viewfinders.at(cameras.count());
 
-    return qreal(0);
+    cameras.append(cam);
+    previewSequence.append(0);
+
+    // each camera scales straight to the size of its own viewfinder
+    connect(viewfinder, SIGNAL(sizeChanged(QSize)), cam, SLOT(setPreviewSize(QSize)));
+    cam->setPreviewSize(viewfinder->imageArea());
+
+    // in-process files can be shipped once the camera closes them
+    connect(cam, SIGNAL(fileFinished(QString)), this, SLOT(deliverFile(QString)));
+    connect(cam, SIGNAL(segmentStarted(QString)), this, SLOT(segmentStarted(QString)));
+    connect(cam, SIGNAL(videoFileClosed(QString,VideoTiming)), this, SLOT(videoFileClosed(QString,VideoTiming)));
+
+    updatePreviewActivity();
 }
 
 ///
-/// \brief getBufferLevels
+/// \brief AvRecorder::videoFileClosed
 ///
-/// returns the audio level for each channel
+/// A camera released its temporary file; its mux job can run now
 ///
-/// \param buffer
-/// \return
+/// \param path
+/// \param timing
 ///
-QVector<qreal> getBufferLevels(const QAudioBuffer& buffer)
-{
-    QVector<qreal> values;
-
-    if (!buffer.format().isValid() || buffer.format().byteOrder() != QAudioFormat::LittleEndian)
-        return values;
-
-    if (buffer.format().codec() != "audio/pcm")
-        return values;
-
-    int channelCount = buffer.format().channelCount();
-    values.fill(0, channelCount);
-    qreal peak_value = getPeakValue(buffer.format());
-    if (qFuzzyCompare(peak_value, qreal(0)))
-        return values;
-
-    switch (buffer.format().sampleType()) {
-    case QAudioFormat::Unknown:
-    case QAudioFormat::UnSignedInt:
-        if (buffer.format().sampleSize() == 32)
-            values = getBufferLevels(buffer.constData<quint32>(), buffer.frameCount(), channelCount);
-        if (buffer.format().sampleSize() == 16)
-            values = getBufferLevels(buffer.constData<quint16>(), buffer.frameCount(), channelCount);
-        if (buffer.format().sampleSize() == 8)
-            values = getBufferLevels(buffer.constData<quint8>(), buffer.frameCount(), channelCount);
-        for (int i = 0; i < values.size(); ++i)
-            values[i] = qAbs(values.at(i) - peak_value / 2) / (peak_value / 2);
-        break;
-    case QAudioFormat::Float:
-        if (buffer.format().sampleSize() == 32) {
-            values = getBufferLevels(buffer.constData<float>(), buffer.frameCount(), channelCount);
-            for (int i = 0; i < values.size(); ++i)
-                values[i] /= peak_value;
-        }
-        break;
-    case QAudioFormat::SignedInt:
-        if (buffer.format().sampleSize() == 32)
-            values = getBufferLevels(buffer.constData<qint32>(), buffer.frameCount(), channelCount);
-        if (buffer.format().sampleSize() == 16)
-            values = getBufferLevels(buffer.constData<qint16>(), buffer.frameCount(), channelCount);
-        if (buffer.format().sampleSize() == 8)
-            values = getBufferLevels(buffer.constData<qint8>(), buffer.frameCount(), channelCount);
-        for (int i = 0; i < values.size(); ++i)
-            values[i] /= peak_value;
-        break;
+void AvRecorder::videoFileClosed(const QString &path, const VideoTiming &timing)
+{
+    if (pendingMuxJobs.contains(path))
+    {
+        enqueueMuxJob(pendingMuxJobs.take(path), timing);
+    }
+    else
+    {
+        // closed ahead of the recorder's stop status
+        closedVideoFiles.insert(path, timing);
     }
+}
 
-    return values;
+///
+/// \brief AvRecorder::enqueueMuxJob
+/// \param pending
+/// \param timing
+///
+void AvRecorder::enqueueMuxJob(PendingMuxJob pending, const VideoTiming &timing)
+{
+    pending.job.arguments = CameraThread::muxArguments(pending.videoFile,
+                                                       timing,
+                                                       pending.audio,
+                                                       pending.compress);
+    pending.job.arguments << pending.job.output;
+
+    muxQueue->enqueue(pending.job);
 }
 
 ///
+/// \brief AvRecorder::layoutViewfinders
 ///
+/// Arrange viewfinders in a near-square grid where viewfinder_0 was
 ///
-template <class T> QVector<qreal> getBufferLevels(const T *buffer, int frames, int channels)
+void AvRecorder::layoutViewfinders()
 {
-    QVector<qreal> max_values;
-    max_values.fill(0, channels);
+    if (!previewGrid)
+    {
+        previewGrid = new QGridLayout;
+        previewGrid->setSpacing(2);
 
-    for (int i = 0; i < frames; ++i) {
-        for (int j = 0; j < channels; ++j) {
-            qreal value = qAbs(qreal(buffer[i * channels + j]));
-            if (value > max_values.at(j))
-                max_values.replace(j, value);
-        }
+        ui->horizontalLayout_3->removeWidget(ui->viewfinder_0);
+        ui->horizontalLayout_3->insertLayout(0, previewGrid);
+    }
+
+    int columns = qCeil(qSqrt(viewfinders.count()));
+
+    for (int i = 0; i < viewfinders.count(); ++i)
+    {
+        previewGrid->removeWidget(viewfinders.at(i));
+    }
+
+    for (int i = 0; i < viewfinders.count(); ++i)
+    {
+        previewGrid->addWidget(viewfinders.at(i), i / columns, i % columns);
     }
+}
 
-    return max_values;
+///
+/// \brief AvRecorder::pullPreviews
+///
+/// Timer slot: paint the newest image from each camera, if there is one
+///
+void AvRecorder::pullPreviews()
+{
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        QImage qimg;
+
+        if (cameras.at(i)->previewMailbox()->take(qimg, previewSequence[i]))
+        {
+            // already scaled to fit on the camera's preview thread
+            viewfinders.at(i)->setImage(qimg);
+        }
+    }
 }
 
 ///
-/// \brief AvRecorder::processBuffer
-/// \param buffer
+/// \brief AvRecorder::updateLatencyStatus
 ///
-void AvRecorder::processBuffer(const QAudioBuffer& buffer)
+/// Show per-stage p95 in the status bar, full percentiles in the tooltip
+///
+void AvRecorder::updateLatencyStatus()
 {
-    if (audioLevels.count() != buffer.format().channelCount()) {
-        qDeleteAll(audioLevels);
-        audioLevels.clear();
-        for (int i = 0; i < buffer.format().channelCount(); ++i) {
-            QAudioLevel *level = new QAudioLevel(ui->centralwidget);
-            audioLevels.append(level);
-            ui->levelsLayout->addWidget(level);
+    static const char *stageNames[LatencyStageCount] = { "grab", "overlay", "encode", "preview", "pacing", "disk" };
+
+    QStringList summary;
+    QStringList details;
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        QStringList p95s;
+
+        details << tr("Camera %1 (ms): p50 / p95 / p99 / max").arg(i);
+
+        for (int s = 0; s < LatencyStageCount; ++s)
+        {
+            LatencySummary stats = cameras.at(i)->latencySummary(static_cast<LatencyStage>(s));
+
+            p95s << QString("%1 %2").arg(stageNames[s]).arg(stats.p95 / 1000.0, 0, 'f', 1);
+
+            details << QString("  %1: %2 / %3 / %4 / %5 (n=%6)")
+                       .arg(stageNames[s])
+                       .arg(stats.p50 / 1000.0, 0, 'f', 1)
+                       .arg(stats.p95 / 1000.0, 0, 'f', 1)
+                       .arg(stats.p99 / 1000.0, 0, 'f', 1)
+                       .arg(stats.max / 1000.0, 0, 'f', 1)
+                       .arg(stats.count);
         }
+
+        summary << tr("cam %1 p95 ms: %2").arg(i).arg(p95s.join(", "));
+    }
+
+    qint64 prerollBytes = audioPreroll ? audioPreroll->bytes() : 0;
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        prerollBytes += cameras.at(i)->prerollBytes();
+    }
+
+    if (prerollSeconds > 0)
+    {
+        summary << tr("pre-roll %1 MB").arg(prerollBytes / 1048576.0, 0, 'f', 1);
+    }
+
+    // I/O pressure: encoded data the disk has not taken yet
+    qint64 diskQueue = 0;
+    qint64 diskPeak = 0;
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        diskQueue += cameras.at(i)->diskQueueBytes();
+        diskPeak = qMax(diskPeak, cameras.at(i)->peakDiskQueueBytes());
+    }
+
+    if (diskPeak > 0)
+    {
+        summary << tr("disk queue %1 MB (peak %2)").arg(diskQueue / 1048576.0, 0, 'f', 1)
+                                                   .arg(diskPeak / 1048576.0, 0, 'f', 1);
+    }
+
+    latencyLabel->setText(summary.join("  |  "));
+    latencyLabel->setToolTip(details.join("\n"));
+}
+
+///
+/// \brief AvRecorder::updatePreviewActivity
+///
+/// Only convert and paint preview frames while they can be seen
+///
+void AvRecorder::updatePreviewActivity()
+{
+    if (!previewTimer)
+    {
+        return;
+    }
+
+    bool visible = isVisible() && !isMinimized() && ui->viewfinder_0->isVisible();
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        cameras.at(i)->setPreviewEnabled(visible);
+    }
+
+    if (visible && !previewTimer->isActive())
+    {
+        previewTimer->start();
+    }
+    else if (!visible)
+    {
+        previewTimer->stop();
+    }
+}
+
+///
+/// \brief AvRecorder::changeEvent
+/// \param event
+///
+void AvRecorder::changeEvent(QEvent *event)
+{
+    QMainWindow::changeEvent(event);
+
+    if (event->type() == QEvent::WindowStateChange)
+    {
+        updatePreviewActivity();
     }
+}
 
-    QVector<qreal> levels = getBufferLevels(buffer);
-    for (int i = 0; i < levels.count(); ++i)
-        audioLevels.at(i)->setLevel(levels.at(i));
+///
+/// \brief AvRecorder::showEvent
+/// \param event
+///
+void AvRecorder::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+
+    updatePreviewActivity();
 }
 
 ///
-/// \brief AvRecorder::processQImage
-/// \param qimg
+/// \brief AvRecorder::hideEvent
+/// \param event
 ///
-void AvRecorder::processQImage(const QImage qimg) {
-    ui->viewfinder_0->setPixmap(QPixmap::fromImage(qimg.scaled(ui->viewfinder_0->width(), ui->viewfinder_0->height(),
-                                                               Qt::KeepAspectRatio)));
-    ui->viewfinder_0->show();
+void AvRecorder::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+
+    updatePreviewActivity();
 }
 
 ///
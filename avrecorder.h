@@ -96,8 +96,13 @@
 #include <QSettings>
 #include <QProcess>
 #include <QMessageBox>
+#include <QHash>
 
 #include "recordsettings.h"
+#include "audioclock.h"
+#include "storagemonitor.h"
+#include "muxjobqueue.h"
+#include "framepipeline.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class AvRecorder; }
@@ -107,6 +112,18 @@ class QAudioBuffer;
 QT_END_NAMESPACE
 
 class QAudioLevel;
+class QTimer;
+class QLabel;
+class CameraThread;
+class PreviewWidget;
+class QGridLayout;
+class AudioPreroll;
+class AudioLevelMonitor;
+class RecordingCatalog;
+struct CatalogEntry;
+class SessionListDialog;
+class FileShipper;
+class QThread;
 
 class AvRecorder : public QMainWindow
 {
@@ -115,6 +132,7 @@ class AvRecorder : public QMainWindow
 public:
     AvRecorder(RecordSettingsData* recordSettings, QWidget *parent = 0);
     void LoadPreviousOptions(RecordSettingsData *mSettings);
+    void addCamera(CameraThread *cam);
     ~AvRecorder();
 
 signals:
@@ -129,7 +147,6 @@ signals:
 
 public slots:
     void processBuffer(const QAudioBuffer&);
-    void processQImage(const QImage qimg);
     void displayErrorMessage(const QString&);
     void setCameraStatus(bool value);
 
@@ -138,9 +155,6 @@ public slots:
     void changeTreatmentSlot(QString);
     void changeConditionSlot(QString);
 
-    void processStarted();
-    void readyReadStandardOutput();
-    void encodingFinished();
 
 private slots:
     void togglePause();
@@ -156,9 +170,51 @@ private slots:
 
     void displayErrorMessage();
 
-    void processError(QProcess::ProcessError err);
+    void forwardAudio(const QByteArray &pcm, qint64 arrivalUs);
+    void refreshLevels();
+
+    void muxJobStarted(int id, const QString &output);
+    void muxJobProgress(int id, int percent);
+    void muxJobFinished(int id, const QString &output, bool ok);
+
+    void pullPreviews();
+    void updateLatencyStatus();
+
+    void suggestSession();
+    void showSessionList();
+
+    void deliverFile(const QString &staged);
+    void fileDelivered(const QString &destination, qint64 size, const QString &checksum);
+    void fileDeliveryFailed(const QString &destination, const QString &error, int attempts);
+
+    void updateStorageStatus();
+    void segmentStarted(const QString &path);
+
+    void videoFileClosed(const QString &path, const VideoTiming &timing);
+
+protected:
+    void changeEvent(QEvent *event);
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
 
 private:
+    void updatePreviewActivity();
+    void layoutViewfinders();
+
+    void advanceSession();
+    void catalogSession();
+    CatalogEntry catalogEntry(int camera, const QString &path) const;
+
+    QString sessionFilePath(int camera, const QString &ext) const;
+    QString stagedFilePath(int camera, const QString &ext) const;
+    QString segmentFilePath(int camera, int segment) const;
+    QString destinationPath(const QString &staged) const;
+    QString stagingLocation() const;
+
+    void rollOverToSecondary();
+
+    void enqueueMuxJob(PendingMuxJob pending, const VideoTiming &timing);
+
     void changeShownResolution(QString val);
 
     bool isSessionAnInt();
@@ -168,12 +224,84 @@ private:
 
     Ui::AvRecorder *ui;
 
-    QProcess *combineStreamProcess;
+    MuxJobQueue *muxQueue;
+
+    // by temporary video path: jobs whose file is still being written, and
+    // files closed before their job was built
+    QHash<QString, PendingMuxJob> pendingMuxJobs;
+    QHash<QString, VideoTiming> closedVideoFiles;
+
+    // what has been recorded, without probing the output directory
+    RecordingCatalog *catalog;
+    SessionListDialog *sessionList = nullptr;
+
+    // finished files wait in outboxDirectory until delivered
+    FileShipper *shipper;
+    QString outboxDirectory;
+
+    // free space of the staging, output and secondary volumes, queried on storageThread
+    QThread *storageThread;
+    StorageMonitor *storageMonitor;
+    QLabel *storageLabel;
+
+    // bytes of the current recording, counted rather than looked up
+    qint64 audioBytes = 0;
+    ThroughputEstimator writeRate;
+
+    // staging moves here once tempWriteLocation is about to fill; empty for none
+    QString secondaryDirectory;
+    QString secondaryOutbox;
+    bool onSecondary = false;
+
+    // warn this long before a volume fills; roll over this long before
+    int storageWarnMinutes = 10;
+    int failoverMinutes = 3;
+
+    // never planned into
+    qint64 storageReserveBytes = qint64(512) << 20;
+
+    // rollovers in the current session
+    int segmentNumber = 0;
 
     QAudioRecorder *audioRecorder;
     QAudioProbe *probe;
     QList<QAudioLevel*> audioLevels;
 
+    // where audio.wav sits on the SessionClock, for the ffmpeg mux
+    AudioClock audioClock;
+
+    // metering runs on meterThread; the meters are polled at meterFPS
+    QThread *meterThread;
+    AudioLevelMonitor *levelMonitor;
+    QTimer *meterTimer;
+    int meterFPS = 30;
+
+    QList<CameraThread*> cameras;
+    QVector<quint64> previewSequence;
+
+    // viewfinders.at(n) shows cameras.at(n)
+    QList<PreviewWidget*> viewfinders;
+    QGridLayout *previewGrid = nullptr;
+
+    QLabel *muxLabel;
+    QString muxStatus;
+
+    // temporary files of the current (or last) session
+    QString sessionWorkspace;
+
+    // encode and mux during recording instead of afterwards with ffmpeg
+    bool inProcessMux = true;
+
+    // seconds kept from before Record; 0 = off
+    int prerollSeconds = 0;
+    AudioPreroll *audioPreroll = nullptr;
+
+    QTimer *previewTimer = nullptr;
+    int previewFPS = 10;
+
+    QTimer *statsTimer;
+    QLabel *latencyLabel;
+
     QDateTime rec_started;
 
     int sessionNumber;
@@ -0,0 +1,517 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QAudioFormat>
+#include <QImage>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "audiometer.h"
+#include "camerathread.h"
+#include "capturesource.h"
+#include "framepipeline.h"
+#include "framescheduler.h"
+#include "previewscaler.h"
+#include "timestamprenderer.h"
+
+typedef std::chrono::steady_clock Clock;
+
+///
+/// \brief The Reporter class
+///
+/// One record per measurement, as JSON lines or CSV
+///
+class Reporter
+{
+public:
+    explicit Reporter(bool csv) : csv(csv), out(stdout) {}
+
+    void environment()
+    {
+        QJsonObject record;
+        record["type"] = "environment";
+        record["version"] = QString("%1.%2.%3").arg(VERSION_MAJOR).arg(VERSION_MINOR).arg(VERSION_BUILD);
+        record["qt"] = QT_VERSION_STR;
+        record["opencv"] = CV_VERSION;
+        record["cpu"] = QSysInfo::currentCpuArchitecture();
+        record["os"] = QSysInfo::prettyProductName();
+        record["host"] = QSysInfo::machineHostName();
+        record["threads"] = QThread::idealThreadCount();
+#if defined(__SSE2__) || defined(_M_X64)
+        record["sse2"] = true;
+#else
+        record["sse2"] = false;
+#endif
+
+        if (csv)
+        {
+            out << "benchmark,width,height,channels,format,iterations,ns_per_op,ns_min,mb_per_s,extra\n";
+        }
+        else
+        {
+            out << QJsonDocument(record).toJson(QJsonDocument::Compact) << "\n";
+        }
+
+        out.flush();
+    }
+
+    void result(QJsonObject record)
+    {
+        record["type"] = "result";
+
+        if (csv)
+        {
+            QJsonObject extra = record.value("extra").toObject();
+
+            out << record.value("benchmark").toString() << ","
+                << record.value("width").toInt() << ","
+                << record.value("height").toInt() << ","
+                << record.value("channels").toInt() << ","
+                << record.value("format").toString() << ","
+                << qint64(record.value("iterations").toDouble()) << ","
+                << record.value("ns_per_op").toDouble() << ","
+                << record.value("ns_min").toDouble() << ","
+                << record.value("mb_per_s").toDouble() << ","
+                << QString(QJsonDocument(extra).toJson(QJsonDocument::Compact)).replace(',', ';') << "\n";
+        }
+        else
+        {
+            out << QJsonDocument(record).toJson(QJsonDocument::Compact) << "\n";
+        }
+
+        out.flush();
+    }
+
+private:
+    bool csv;
+    QTextStream out;
+};
+
+///
+/// \brief measure
+///
+/// Runs op in batches until minMs has passed, in five repetitions; reports
+/// the median and the fastest repetition per operation
+///
+/// \param op
+/// \param minMs
+/// \param bytesPerOp
+///
+/// Input bytes touched by one op, for throughput; 0 to leave it out
+///
+/// \return
+///
+static QJsonObject measure(const std::function<void()> &op, int minMs, double bytesPerOp)
+{
+    const int repetitions = 5;
+    const auto budget = std::chrono::milliseconds(qMax(1, minMs / repetitions));
+
+    // warm caches and lazily built tables
+    op();
+
+    std::vector<double> samples;
+    qint64 iterations = 0;
+
+    for (int r = 0; r < repetitions; ++r)
+    {
+        qint64 n = 0;
+        Clock::time_point start = Clock::now();
+        Clock::duration elapsed;
+
+        do
+        {
+            op();
+            n++;
+            elapsed = Clock::now() - start;
+        }
+        while (elapsed < budget);
+
+        samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / n);
+        iterations += n;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    QJsonObject record;
+    record["iterations"] = double(iterations);
+    record["ns_per_op"] = samples[samples.size() / 2];
+    record["ns_min"] = samples.front();
+
+    if (bytesPerOp > 0)
+    {
+        record["mb_per_s"] = bytesPerOp / samples[samples.size() / 2] * 1000.0;
+    }
+
+    return record;
+}
+
+///
+/// \brief describe
+/// \param record
+/// \param name
+/// \param size
+/// \return
+///
+static QJsonObject describe(QJsonObject record, const QString &name, cv::Size size)
+{
+    record["benchmark"] = name;
+    record["width"] = size.width;
+    record["height"] = size.height;
+
+    return record;
+}
+
+///
+/// \brief testFrame
+///
+/// Colour bars with a box on them, like a busy camera frame
+///
+static cv::Mat testFrame(cv::Size size)
+{
+    SyntheticSource source(size, SyntheticSource::Bars, 7, true);
+    cv::Mat frame;
+
+    source.open(size);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        source.read(frame);
+    }
+
+    return frame;
+}
+
+///
+/// \brief frameKernels
+///
+/// Per-frame work on the overlay, preview and capture threads
+///
+static void frameKernels(Reporter &reporter, cv::Size size, int minMs, const QString &filter)
+{
+    const cv::Mat source = testFrame(size);
+    const double frameBytes = double(source.total() * source.elemSize());
+
+    cv::Mat frame = source.clone();
+    qint64 stamp = 1500000000000LL;
+
+    if (filter.isEmpty() || QString("copy").contains(filter))
+    {
+        // baseline for kernels that need a fresh frame every time
+        reporter.result(describe(measure([&]() { source.copyTo(frame); }, minMs, frameBytes), "copy", size));
+    }
+
+    if (filter.isEmpty() || QString("overlay").contains(filter))
+    {
+        OverlayStage overlay(nullptr, nullptr);
+        overlay.setSessionConditions("ID-0001", "0001", "Baseline", "A");
+
+        reporter.result(describe(measure([&]() { overlay.drawOverlay(frame, stamp += 33); }, minMs, frameBytes), "overlay", size));
+
+        overlay.setTimestampFormat("yyyy-MM-dd hh:mm:ss.zzz");
+
+        reporter.result(describe(measure([&]() { overlay.drawOverlay(frame, stamp += 33); }, minMs, frameBytes), "overlay_ms", size));
+    }
+
+    if (filter.isEmpty() || QString("timestamp").contains(filter))
+    {
+        TimestampRenderer renderer(cv::FONT_ITALIC, 0.5, cv::Scalar(255, 255, 255), cv::Scalar(0, 0, 0));
+
+        reporter.result(describe(measure([&]() { renderer.render(frame, stamp += 33); }, minMs, 0), "timestamp", size));
+
+        renderer.setFormat("hh:mm:ss.zzz");
+
+        reporter.result(describe(measure([&]() { renderer.render(frame, stamp += 33); }, minMs, 0), "timestamp_ms", size));
+    }
+
+    if (filter.isEmpty() || QString("mat2qimage").contains(filter))
+    {
+        QImage image;
+
+        reporter.result(describe(measure([&]() { image = PreviewStage::Mat2QImage(source); }, minMs, frameBytes), "mat2qimage", size));
+    }
+
+    if (filter.isEmpty() || QString("resize_ar").contains(filter))
+    {
+        // 16:9 target, so 4:3 input is letterboxed and 16:9 input is a plain resize
+        cv::Size target(size.width / 2, size.width / 2 * 9 / 16);
+        cv::Mat resized(target, CV_8UC3);
+
+        QJsonObject record = measure([&]() { CameraThread::resizeAR(source, resized); }, minMs, frameBytes);
+
+        QJsonObject extra;
+        extra["target_width"] = target.width;
+        extra["target_height"] = target.height;
+        record["extra"] = extra;
+
+        reporter.result(describe(record, "resize_ar", size));
+    }
+
+    if (filter.isEmpty() || QString("preview_scale").contains(filter))
+    {
+        PreviewScaler scaler;
+        scaler.configure(size, PreviewScaler::fitInside(size, cv::Size(640, 480)));
+
+        QImage image(scaler.targetSize().width, scaler.targetSize().height, QImage::Format_RGB32);
+
+        QJsonObject record = measure([&]() { scaler.scale(source, image.bits(), image.bytesPerLine()); }, minMs, frameBytes);
+
+        QJsonObject extra;
+        extra["target_width"] = image.width();
+        extra["target_height"] = image.height();
+        record["extra"] = extra;
+
+        reporter.result(describe(record, "preview_scale", size));
+    }
+}
+
+///
+/// \brief audioKernels
+///
+/// Level metering of one 1024-frame buffer, for every sample format
+///
+static void audioKernels(Reporter &reporter, const QList<int> &channelCounts, int minMs)
+{
+    struct SampleFormat
+    {
+        const char *name;
+        QAudioFormat::SampleType type;
+        int bits;
+    };
+
+    static const SampleFormat formats[] = {
+        { "s8",  QAudioFormat::SignedInt,   8 },
+        { "u8",  QAudioFormat::UnSignedInt, 8 },
+        { "s16", QAudioFormat::SignedInt,   16 },
+        { "u16", QAudioFormat::UnSignedInt, 16 },
+        { "s32", QAudioFormat::SignedInt,   32 },
+        { "u32", QAudioFormat::UnSignedInt, 32 },
+        { "f32", QAudioFormat::Float,       32 }
+    };
+
+    const int frames = 1024;
+
+    foreach (int channels, channelCounts)
+    {
+        for (const SampleFormat &f : formats)
+        {
+            QAudioFormat format;
+            format.setCodec("audio/pcm");
+            format.setByteOrder(QAudioFormat::Endian(QSysInfo::ByteOrder));
+            format.setSampleRate(48000);
+            format.setChannelCount(channels);
+            format.setSampleType(f.type);
+            format.setSampleSize(f.bits);
+
+            AudioMeter::Kernel kernel = AudioMeter::select(format);
+
+            if (!kernel)
+            {
+                continue;
+            }
+
+            // random samples; floats are a ramp within full scale
+            std::vector<uchar> data(size_t(frames) * channels * f.bits / 8);
+            cv::Mat noise(1, int(data.size()), CV_8UC1, data.data());
+            cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+
+            if (f.type == QAudioFormat::Float)
+            {
+                float *samples = reinterpret_cast<float*>(data.data());
+                for (int i = 0; i < frames * channels; ++i)
+                    samples[i] = float(i % 200 - 100) / 200.0f;
+            }
+
+            AudioLevels levels;
+
+            QJsonObject record = measure([&]() { kernel(data.data(), frames, channels, levels); }, minMs, double(data.size()));
+            record["benchmark"] = "audio_levels";
+            record["channels"] = channels;
+            record["format"] = f.name;
+
+            QJsonObject extra;
+            extra["frames"] = frames;
+            extra["msamples_per_s"] = double(frames) * channels / record.value("ns_per_op").toDouble() * 1000.0;
+            record["extra"] = extra;
+
+            reporter.result(record);
+        }
+    }
+}
+
+///
+/// \brief pacingOverhead
+///
+/// The capture loop's FrameScheduler wait at a high rate: how late each
+/// wake-up is and how much CPU the waiting itself costs
+///
+static void pacingOverhead(Reporter &reporter, int minMs)
+{
+    const int rates[] = { 30, 240 };
+    const int spinWindows[] = { 0, 200 };
+
+    for (int fps : rates)
+    {
+        for (int spin : spinWindows)
+        {
+            FrameScheduler scheduler(fps, spin);
+
+            std::vector<qint64> lateness;
+
+            std::clock_t cpuStart = std::clock();
+            Clock::time_point start = Clock::now();
+
+            // at least a hundred frames
+            while (Clock::now() - start < std::chrono::milliseconds(qMax(minMs, 100 * 1000 / fps)))
+            {
+                lateness.push_back(scheduler.waitForNextFrame());
+            }
+
+            double cpuUs = double(std::clock() - cpuStart) * 1000000.0 / CLOCKS_PER_SEC;
+            double wallUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+            // the first wait only aligns to the grid
+            if (lateness.size() > 1)
+            {
+                lateness.erase(lateness.begin());
+            }
+
+            std::sort(lateness.begin(), lateness.end());
+
+            QJsonObject extra;
+            extra["fps"] = fps;
+            extra["spin_us"] = spin;
+            extra["late_p50_us"] = double(lateness[lateness.size() / 2]);
+            extra["late_p99_us"] = double(lateness[lateness.size() * 99 / 100]);
+            extra["late_max_us"] = double(lateness.back());
+            extra["cpu_percent"] = cpuUs / wallUs * 100.0;
+
+            QJsonObject record;
+            record["benchmark"] = "pacing";
+            record["iterations"] = double(lateness.size());
+            record["ns_per_op"] = cpuUs * 1000.0 / lateness.size();
+            record["ns_min"] = cpuUs * 1000.0 / lateness.size();
+            record["extra"] = extra;
+
+            reporter.result(record);
+        }
+    }
+}
+
+///
+/// \brief parseSizes
+/// \param text
+/// \return
+///
+static QList<cv::Size> parseSizes(const QString &text)
+{
+    QList<cv::Size> sizes;
+
+    foreach (const QString &wxh, text.split(',', QString::SkipEmptyParts))
+    {
+        int w = wxh.section('x', 0, 0).toInt();
+        int h = wxh.section('x', 1, 1).toInt();
+
+        if (w > 0 && h > 0)
+        {
+            sizes.append(cv::Size(w, h));
+        }
+    }
+
+    return sizes;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("SessionRecorderBenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the per-frame and per-buffer kernels of Session Recorder");
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption("sizes", "Frame sizes, comma separated.", "WxH,...", "640x480,1280x720,1920x1080");
+    QCommandLineOption channelsOption("channels", "Audio channel counts, comma separated.", "n,...", "1,2,6,8");
+    QCommandLineOption timeOption("min-time", "Milliseconds spent on each measurement.", "ms", "500");
+    QCommandLineOption formatOption("format", "Output format: json (one object per line) or csv.", "format", "json");
+    QCommandLineOption filterOption("filter", "Only benchmarks whose name contains this.", "name");
+
+    parser.addOption(sizesOption);
+    parser.addOption(channelsOption);
+    parser.addOption(timeOption);
+    parser.addOption(formatOption);
+    parser.addOption(filterOption);
+
+    parser.process(app);
+
+    const int minMs = qMax(10, parser.value(timeOption).toInt());
+    const QString filter = parser.value(filterOption);
+
+    QList<int> channelCounts;
+
+    foreach (const QString &n, parser.value(channelsOption).split(',', QString::SkipEmptyParts))
+    {
+        if (n.toInt() > 0 && n.toInt() <= AudioLevels::MaxChannels)
+        {
+            channelCounts.append(n.toInt());
+        }
+    }
+
+    Reporter reporter(parser.value(formatOption) == "csv");
+
+    reporter.environment();
+
+    foreach (cv::Size size, parseSizes(parser.value(sizesOption)))
+    {
+        frameKernels(reporter, size, minMs, filter);
+    }
+
+    if (filter.isEmpty() || QString("audio_levels").contains(filter))
+    {
+        audioKernels(reporter, channelCounts, minMs);
+    }
+
+    if (filter.isEmpty() || QString("pacing").contains(filter))
+    {
+        pacingOverhead(reporter, minMs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+# Session Recorder
+# Kernel benchmarks; results go to stdout as JSON lines (or CSV)
+#
+#   qmake benchmark/benchmark.pro && make
+#   ./SessionRecorderBenchmark --sizes 1280x720 --format csv
+
+TARGET = SessionRecorderBenchmark
+TEMPLATE = app
+
+QT       += core gui multimedia
+QT       -= widgets
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+include(../common.pri)
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+    benchmark.cpp \
+    ../camerathread.cpp \
+    ../capturesource.cpp \
+    ../framescheduler.cpp \
+    ../sessionclock.cpp \
+    ../audioclock.cpp \
+    ../audiometer.cpp \
+    ../framepipeline.cpp \
+    ../framepool.cpp \
+    ../mediamuxer.cpp \
+    ../diskwriter.cpp \
+    ../prerollbuffer.cpp \
+    ../staticscenedetector.cpp \
+    ../latencyhistogram.cpp \
+    ../timestamprenderer.cpp \
+    ../previewscaler.cpp
+
+HEADERS += \
+    ../camerathread.h \
+    ../capturesource.h \
+    ../framescheduler.h \
+    ../sessionclock.h \
+    ../audioclock.h \
+    ../audiometer.h \
+    ../framepipeline.h \
+    ../framepool.h \
+    ../mediamuxer.h \
+    ../diskwriter.h \
+    ../prerollbuffer.h \
+    ../staticscenedetector.h \
+    ../latencyhistogram.h \
+    ../timestamprenderer.h \
+    ../previewscaler.h \
+    ../spscring.h \
+    ../enums.h
@@ -54,16 +54,17 @@
 
 #include <QDir>
 #include <QDateTime>
+#include <QFileInfo>
 #include <QTextStream>
-#include <QLinkedList>
 #include <QSettings>
 #include <QStandardPaths>
-
-#include "boost/date_time/posix_time/posix_time.hpp"
+#include <QScopedPointer>
 
 #include "camerathread.h"
+#include "framescheduler.h"
+#include "sessionclock.h"
+#include "capturesource.h"
 
-using namespace boost::posix_time;
 using namespace cv;
 
 ///
@@ -92,15 +93,23 @@ CameraThread::CameraThread(int i) : idx(i), is_active(false), was_active(false)
     QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
     settings.beginGroup(QLatin1String("AvRecorder"));
 
-    winId =         settings.value(QLatin1String("lineEditId")).toString();
-    winSession =    settings.value(QLatin1String("lineEditSession")).toString().rightJustified(4, '0');
-    winTreatment =  settings.value(QLatin1String("lineEditTx")).toString();
-    winCondition =  settings.value(QLatin1String("lineEditCond")).toString();
+    overlay_stage.setSessionConditions(settings.value(QLatin1String("lineEditId")).toString(),
+                                       settings.value(QLatin1String("lineEditSession")).toString().rightJustified(4, '0'),
+                                       settings.value(QLatin1String("lineEditTx")).toString(),
+                                       settings.value(QLatin1String("lineEditCond")).toString());
 
     settings.endGroup();
     settings.sync();
 
     tempWriteLocation = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
+    videoFile = VIDEOSTRING;
+
+    setupPipeline();
+
+    connect(&encode_stage, SIGNAL(muxedFileClosed(QString)), this, SIGNAL(fileFinished(QString)));
+    connect(&encode_stage, SIGNAL(videoFileClosed(QString,VideoTiming)), this, SIGNAL(videoFileClosed(QString,VideoTiming)));
+    connect(&encode_stage, SIGNAL(segmentOpened(QString)), this, SIGNAL(segmentStarted(QString)));
+    connect(&encode_stage, SIGNAL(writerClosed()), this, SLOT(writerClosed()));
 }
 
 ///
@@ -150,15 +159,443 @@ CameraThread::CameraThread(int i, QString wxh) : idx(i), is_active(false), was_a
     QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
     settings.beginGroup(QLatin1String("AvRecorder"));
 
-    winId =         settings.value(QLatin1String("lineEditId")).toString();
-    winSession =    settings.value(QLatin1String("lineEditSession")).toString().rightJustified(4, '0');
-    winTreatment =  settings.value(QLatin1String("lineEditTx")).toString();
-    winCondition =  settings.value(QLatin1String("lineEditCond")).toString();
+    overlay_stage.setSessionConditions(settings.value(QLatin1String("lineEditId")).toString(),
+                                       settings.value(QLatin1String("lineEditSession")).toString().rightJustified(4, '0'),
+                                       settings.value(QLatin1String("lineEditTx")).toString(),
+                                       settings.value(QLatin1String("lineEditCond")).toString());
 
     settings.endGroup();
     settings.sync();
 
     tempWriteLocation = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
+    videoFile = VIDEOSTRING;
+
+    setupPipeline();
+
+    connect(&encode_stage, SIGNAL(muxedFileClosed(QString)), this, SIGNAL(fileFinished(QString)));
+    connect(&encode_stage, SIGNAL(videoFileClosed(QString,VideoTiming)), this, SIGNAL(videoFileClosed(QString,VideoTiming)));
+    connect(&encode_stage, SIGNAL(segmentOpened(QString)), this, SIGNAL(segmentStarted(QString)));
+    connect(&encode_stage, SIGNAL(writerClosed()), this, SLOT(writerClosed()));
+}
+
+///
+/// \brief CameraThread::videoFileName
+///
+/// Temporary video file for the n:th camera of a session; the first camera
+/// keeps the historical name
+///
+/// \param n
+/// \return
+///
+QString CameraThread::videoFileName(int n)
+{
+    if (n <= 0)
+    {
+        return QString(VIDEOSTRING);
+    }
+
+    return QString("video_%1.%2").arg(n).arg(VIDEOEXT);
+}
+
+///
+/// \brief CameraThread::setVideoFile
+///
+/// Only takes effect for the next recording
+///
+/// \param name
+///
+/// File name inside the temporary write location
+///
+void CameraThread::setVideoFile(const QString &name)
+{
+    videoFile = name;
+}
+
+///
+/// \brief CameraThread::setWorkspace
+///
+/// Directory for this session's temporary video; takes effect at the next
+/// recording
+///
+/// \param dir
+///
+void CameraThread::setWorkspace(const QString &dir)
+{
+    tempWriteLocation = dir;
+}
+
+///
+/// \brief CameraThread::videoFilePath
+///
+/// File currently (or last) recorded into
+///
+/// \return
+///
+QString CameraThread::videoFilePath() const
+{
+    return muxed_in_process ? mux_target : tempWriteLocation + "/" + videoFile;
+}
+
+///
+/// \brief CameraThread::setMuxTarget
+///
+/// Final file for the next recording, encoded in-process. Falls back to the
+/// temporary VideoWriter file (muxed later by ffmpeg) if this cannot be opened.
+///
+/// \param path
+///
+/// Empty to always use the fallback
+///
+/// \param compress
+///
+void CameraThread::setMuxTarget(const QString &path, bool compress)
+{
+    mux_target = path;
+    mux_compress = compress;
+}
+
+///
+/// \brief CameraThread::writeAudio
+///
+/// Pass a probed audio buffer to the in-process muxer, if recording into one
+///
+/// \param buffer
+///
+void CameraThread::writeAudio(const QAudioBuffer &buffer)
+{
+    if (!buffer.isValid())
+    {
+        return;
+    }
+
+    writeAudio(buffer.constData(), buffer.byteCount(), buffer.format(), SessionClock::elapsedMicroseconds());
+}
+
+///
+/// \brief CameraThread::writeAudio
+///
+/// Raw interleaved PCM (e.g. the audio pre-roll). While the last file is
+/// still being finalized it is held until the new one is open.
+///
+/// \param data
+/// \param bytes
+/// \param format
+/// \param arrivalUs
+///
+/// SessionClock time the samples had all arrived by
+///
+void CameraThread::writeAudio(const void *data, int bytes, const QAudioFormat &format, qint64 arrivalUs)
+{
+    if (format.bytesPerFrame() <= 0)
+    {
+        return;
+    }
+
+    if (start_pending && !mux_target.isEmpty())
+    {
+        HeldAudio held;
+        held.pcm = QByteArray(static_cast<const char*>(data), bytes);
+        held.format = format;
+        held.arrival_us = arrivalUs;
+
+        held_audio.append(held);
+
+        return;
+    }
+
+    if (!muxed_in_process)
+    {
+        return;
+    }
+
+    encode_stage.writeAudio(data,
+                            bytes / format.bytesPerFrame(),
+                            format.sampleRate(),
+                            format.channelCount(),
+                            format.bytesPerFrame() / qMax(1, format.channelCount()),
+                            format.sampleType() == QAudioFormat::Float,
+                            arrivalUs);
+}
+
+///
+/// \brief CameraThread::writeHeldAudio
+///
+/// Audio that arrived before the file was open; dropped if it could not be
+/// opened in-process
+///
+void CameraThread::writeHeldAudio()
+{
+    QList<HeldAudio> held;
+    held.swap(held_audio);
+
+    for (int i = 0; i < held.count(); ++i)
+    {
+        writeAudio(held.at(i).pcm.constData(), held.at(i).pcm.size(), held.at(i).format, held.at(i).arrival_us);
+    }
+}
+
+///
+/// \brief CameraThread::prerollBytes
+///
+/// Memory held by the compressed pre-roll ring
+///
+/// \return
+///
+qint64 CameraThread::prerollBytes()
+{
+    return encode_stage.preroll().bytes();
+}
+
+///
+/// \brief CameraThread::bytesWritten
+///
+/// Size of the current (or last) recording. In-process output is counted
+/// as it is written; the VideoWriter fallback can only be looked up.
+///
+/// \return
+///
+qint64 CameraThread::bytesWritten() const
+{
+    if (muxed_in_process)
+    {
+        return encode_stage.bytesWritten();
+    }
+
+    return QFileInfo(videoFilePath()).size();
+}
+
+///
+/// \brief CameraThread::rollOver
+///
+/// Continue the in-process recording in path from the next frame on;
+/// segmentStarted follows once it has
+///
+/// \param path
+/// \return
+///
+/// False for VideoWriter output, which cannot be split
+///
+bool CameraThread::rollOver(const QString &path)
+{
+    if (!muxed_in_process || !encode_stage.isAccepting())
+    {
+        return false;
+    }
+
+    encode_stage.rollOver(path);
+
+    return true;
+}
+
+///
+/// \brief CameraThread::diskQueueBytes
+///
+/// Encoded data waiting for the disk writer
+///
+/// \return
+///
+qint64 CameraThread::diskQueueBytes() const
+{
+    return encode_stage.diskWriter().queuedBytes();
+}
+
+///
+/// \brief CameraThread::peakDiskQueueBytes
+///
+/// Highest diskQueueBytes of the current (or last) file
+///
+/// \return
+///
+qint64 CameraThread::peakDiskQueueBytes() const
+{
+    return encode_stage.diskWriter().peakQueuedBytes();
+}
+
+///
+/// \brief CameraThread::sceneStats
+/// \return
+///
+SceneStats CameraThread::sceneStats() const
+{
+    return overlay_stage.sceneStats();
+}
+
+///
+/// \brief CameraThread::muxArguments
+///
+/// ffmpeg inputs and codecs for combining a camera's temporary file with
+/// audio.wav. The temporary file plays frame n at n / fps; the audio is
+/// shifted by its measured start relative to the first frame and retimed
+/// by the ratio of the two clocks, so it stays in sync for the whole
+/// session. Without measurements, ffmpeg's -async is used as before.
+///
+/// \param videoFile
+///
+/// Temporary file name, relative to the session workspace
+///
+/// \param timing
+/// \param audio
+///
+/// Placement of audio.wav on the SessionClock
+///
+/// \param compress
+/// \return
+///
+QStringList CameraThread::muxArguments(const QString &videoFile, const VideoTiming &timing, const AudioClock &audio, bool compress)
+{
+    bool measured = audio.isValid() && timing.frames > 1 && timing.fps > 0 && timing.lastUs > timing.firstUs;
+
+    double offsetSeconds = 0.0;
+    double tempo = 1.0;
+
+    if (measured)
+    {
+        // file seconds per session second
+        double videoRate = (timing.frames - 1) / timing.fps / ((timing.lastUs - timing.firstUs) / 1000000.0);
+
+        offsetSeconds = (audio.startUs() - timing.firstUs) / 1000000.0 * videoRate;
+        tempo = audio.rate() / videoRate;
+
+        // a mismatch this large is a pause or missing frames, not drift
+        measured = qAbs(tempo - 1.0) < 0.05;
+
+#ifdef QT_DEBUG
+        qDebug() << "A/V sync" << videoFile << "offset" << offsetSeconds << "s, tempo" << tempo;
+#endif
+    }
+
+    bool retime = measured && qAbs(tempo - 1.0) > 0.0001;
+
+    QStringList arguments;
+
+    arguments << "-y"
+              << "-i" << videoFile;
+
+    if (measured)
+    {
+        arguments << "-itsoffset" << QString::number(offsetSeconds, 'f', 6);
+    }
+
+    arguments << "-i" << "audio.wav";
+
+    if (!measured)
+    {
+        arguments << "-async" << "1";
+    }
+    else if (retime)
+    {
+        arguments << "-af" << QString("atempo=%1").arg(tempo, 0, 'f', 6);
+    }
+
+    /* If users wishes to use compression, apply here */
+    if (compress)
+    {
+        arguments << "-vcodec" << "libx264" << "-crf" << "24";
+    }
+    else if (retime)
+    {
+        // filtered audio cannot be stream-copied
+        arguments << "-c:v" << "copy" << "-c:a" << "pcm_s16le";
+    }
+    else
+    {
+        arguments << "-c" << "copy";
+    }
+
+    return arguments;
+}
+
+///
+/// \brief CameraThread::setCaptureSource
+///
+/// Overrides the captureSource setting; takes effect when the thread starts
+///
+/// \param description
+///
+/// See CaptureSource
+///
+void CameraThread::setCaptureSource(const QString &description)
+{
+    capture_source = description;
+}
+
+///
+/// \brief CameraThread::videoTiming
+/// \return
+///
+VideoTiming CameraThread::videoTiming()
+{
+    return encode_stage.videoTiming();
+}
+
+///
+/// \brief CameraThread::setupPipeline
+///
+/// Load tuning options for the capture pipeline
+///
+void CameraThread::setupPipeline()
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("AvRecorder"));
+
+    overlay_stage.setTimestampFormat(settings.value(QLatin1String("timestampFormat")).toString());
+
+    spinWindow =    settings.value(QLatin1String("spinWindowMicroseconds"), 0).toInt();
+
+    // e.g. "synthetic:1280x720,pattern=bars" or "file:/path/session.avi"; empty = camera
+    capture_source = settings.value(QLatin1String("captureSource")).toString();
+
+    encode_stage.configure(settings.value(QLatin1String("encodeQueueDepth"), 16).toInt(), NeverDrop);
+    encode_stage.setFragmentSeconds(settings.value(QLatin1String("fragmentSeconds"), 2).toInt());
+
+    // in-process output is written by its own I/O thread; "fragment" syncs
+    // every finished fragment, "interval" every fsyncIntervalMs, "close" only at the end
+    QString fsync = settings.value(QLatin1String("fsyncPolicy"), QLatin1String("fragment")).toString();
+
+    encode_stage.configureDiskWriter(settings.value(QLatin1String("diskQueueMB"), 64).toInt(),
+                                     settings.value(QLatin1String("diskBatchKB"), 1024).toInt(),
+                                     settings.value(QLatin1String("preallocateMB"), 64).toInt(),
+                                     fsync == QLatin1String("close") ? FsyncOnClose :
+                                     fsync == QLatin1String("interval") ? FsyncInterval : FsyncOnFragment,
+                                     settings.value(QLatin1String("fsyncIntervalMs"), 2000).toInt());
+
+    // skip near-static frames in variable frame rate output
+    overlay_stage.setStaticSceneMode(settings.value(QLatin1String("skipStaticFrames"), false).toBool(),
+                                     settings.value(QLatin1String("staticThreshold"), 6.0).toDouble(),
+                                     settings.value(QLatin1String("staticKeepaliveMs"), 1000).toInt());
+
+    // compressed frames kept from before Record is pressed (0 = off)
+    encode_stage.preroll().configure(settings.value(QLatin1String("prerollSeconds"), 0).toInt(),
+                                     settings.value(QLatin1String("prerollMaxMB"), 64).toLongLong() * 1024 * 1024,
+                                     settings.value(QLatin1String("prerollJpegQuality"), 80).toInt());
+
+    preview_stage.setPreviewRate(settings.value(QLatin1String("previewFPS"), 10).toInt());
+
+    settings.endGroup();
+}
+
+///
+/// \brief CameraThread::previewMailbox
+///
+/// Latest preview image, pulled by the GUI on its own timer
+///
+/// \return
+///
+PreviewMailbox* CameraThread::previewMailbox()
+{
+    return preview_stage.mailbox();
+}
+
+///
+/// \brief CameraThread::setPreviewEnabled
+///
+/// Suspend preview conversion while nobody can see it
+///
+/// \param enabled
+///
+void CameraThread::setPreviewEnabled(bool enabled)
+{
+    preview_stage.setEnabled(enabled);
 }
 
 ///
@@ -184,10 +621,7 @@ void CameraThread::setDefaultDesiredInputSize()
 ///
 void CameraThread::updateSessionConditions(QString id, QString session, QString treatment, QString condition)
 {
-    winId = id;
-    winSession = session;
-    winTreatment = treatment;
-    winCondition = condition;
+    overlay_stage.setSessionConditions(id, session, treatment, condition);
 }
 
 ///
@@ -200,27 +634,19 @@ void CameraThread::updateSessionConditions(QString id, QString session, QString
 ///
 void CameraThread::updateSessionConditions(int index, QString value)
 {
-    switch (index) {
-    case 0:
-        winId = value;
-
-        break;
-    case 1:
-        winSession = value.rightJustified(4, '0');
-
-        break;
-    case 2:
-        winTreatment = value;
-
-        break;
-    case 3:
-        winCondition = value;
-
-        break;
+    overlay_stage.setSessionCondition(index, (index == 1) ? value.rightJustified(4, '0') : value);
+}
 
-    default:
-        break;
-    }
+///
+/// \brief CameraThread::setPreviewSize
+///
+/// SLOT for viewfinder geometry changes
+///
+/// \param size
+///
+void CameraThread::setPreviewSize(QSize size)
+{
+    preview_stage.setTargetSize(size.width(), size.height());
 }
 
 ///
@@ -237,19 +663,16 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
 
     QString result;
 
-    time_duration td, td1, td2;
-    ptime nextFrameTimestamp, currentFrameTimestamp;
-    ptime initialLoopTimestamp, processingDoneTimestamp, finalLoopTimestamp;
+    FrameScheduler::Clock::time_point grabStartTimestamp, grabDoneTimestamp;
+    FrameScheduler::Clock::time_point pacingStartTimestamp;
 
-    // initialize capture on default source
-    VideoCapture capture(idx);
+    // initialize capture on the configured source (the camera by default)
+    QScopedPointer<CaptureSource> capture(CaptureSource::create(capture_source, idx));
 
-    capture.set(CV_CAP_PROP_FRAME_WIDTH,  output_size.width  ? output_size.width  : input_size.width);
-    capture.set(CV_CAP_PROP_FRAME_HEIGHT, output_size.height ? output_size.height : input_size.height);
-
-    if (!capture.isOpened())
+    if (!capture->open(Size(output_size.width  ? output_size.width  : input_size.width,
+                            output_size.height ? output_size.height : input_size.height)))
     {
-        emit errorMessage(QString("Warning: Failed to initialize camera %1.").arg(idx));
+        emit errorMessage(QString("Warning: Failed to initialize %1.").arg(capture->name()));
 
         emit cameraConnected(false);
 
@@ -263,8 +686,7 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
 
     emit cameraConnected(true);
 
-    input_size.width =  capture.get(CV_CAP_PROP_FRAME_WIDTH);
-    input_size.height = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+    input_size = capture->frameSize();
 
 #ifdef QT_DEBUG
     qDebug() << "Camera" << idx
@@ -279,31 +701,33 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
     record_video = false;
 
 #ifdef QT_DEBUG
-    qDebug() << VIDEOSTRING;
+    qDebug() << videoFile;
 #endif
 
     fourcc = CV_FOURCC('m','p','4','v');
 
     output_size = Size(input_size.width, input_size.height);
 
-    nextFrameTimestamp = microsec_clock::local_time();
-    currentFrameTimestamp = nextFrameTimestamp;
-    td = (currentFrameTimestamp - nextFrameTimestamp);
+    FrameScheduler scheduler(framerate, spinWindow);
 
-    QLinkedList<time_duration> tdlist;
+    // all cameras tick on one grid so their frames line up in time
+    scheduler.setOrigin(SessionClock::origin());
 
     stopLoop = false;
     is_active = true;
 
-    topRect1 = Point(2, 4);
-    topRect2 = Point(180, 4 + (4 * 14));
+    preview_stage.setWindowSize(window_size);
+
+    // Enough buffers for every queue slot plus one in flight per stage;
+    // only re-created if the negotiated resolution differs from last run
+    capture_pool.reserve(input_size, CV_8UC3,
+                         overlay_stage.capacity() + encode_stage.capacity() + preview_stage.capacity() + 3);
 
-    topText1 = Point(8, 4 + 14 - 2);
-    topText2 = Point(8, 4 + 28 - 2);
-    topText3 = Point(8, 4 + 42 - 2);
-    topText4 = Point(8, 4 + 56 - 2);
+    // Start downstream stages before the first frame arrives
+    encode_stage.start();
+    preview_stage.start();
+    overlay_stage.start();
 
-    QDateTime datetime;
     for (;;)
     {
         if (stopLoop)
@@ -315,89 +739,38 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
             break;
         }
 
-        // Happens when Stop was pressed:
-        if (!record_video && video.isOpened())
+        // pick up framerate changes from the GUI
+        scheduler.setFramerate(framerate);
+
+        FrameItem item;
+        item.buffer = capture_pool.acquire();
+
+        grabStartTimestamp = FrameScheduler::Clock::now();
+        bool grabbed = capture->read(item.buffer.mat());
+        grabDoneTimestamp = FrameScheduler::Clock::now();
+
+        if (capture->atEnd())
         {
-            video.release();
+            emit errorMessage(QString("%1 has ended.").arg(capture->name()));
+
+            break;
         }
 
-        // determine time at start of loop
-        initialLoopTimestamp = microsec_clock::local_time();
+        grab_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(grabDoneTimestamp - grabStartTimestamp).count());
 
-        Mat frame;
-        capture >> frame;
-        nframe++;
+        item.frame = item.buffer.mat();
+        item.capture_us = SessionClock::elapsedMicroseconds(grabDoneTimestamp);
+        item.timestamp = SessionClock::toEpochMsecs(item.capture_us);
+        item.index = ++nframe;
 
         if (is_active)
         {
             was_active = true;
 
-          if (frame.cols && frame.rows)
+          if (grabbed)
           {
-              datetime = QDateTime::currentDateTime();
-
-              rectangle(frame,
-                        topRect1,
-                        topRect2,
-                        blackColor,
-                        CV_FILLED);
-
-              putText(frame,
-                      QString("ID: %1").arg(winId).toStdString().c_str(),
-                      topText1,
-                      fontStyle,
-                      fontScale,
-                      yellowColor);
-
-              putText(frame,
-                      QString("Session: %1").arg(winSession).toStdString().c_str(),
-                      topText2,
-                      fontStyle,
-                      fontScale,
-                      yellowColor);
-
-              putText(frame,
-                      QString("Treatment: %1").arg(winTreatment).toStdString().c_str(),
-                      topText3,
-                      fontStyle,
-                      fontScale,
-                      yellowColor);
-
-              putText(frame,
-                      QString("Condition: %1").arg(winCondition).toStdString().c_str(),
-                      topText4,
-                      fontStyle,
-                      fontScale,
-                      yellowColor);
-
-              // Each line is approx 14
-
-              rectangle(frame,
-                        Point(2,frame.rows-22),
-                        Point(static_cast<int>(datetime.toString().toStdString().length()) * 10, frame.rows-8),
-                        blackColor,
-                        CV_FILLED);
-
-              putText(frame,
-                      datetime.toString().toStdString().c_str(),
-                      Point(10,frame.rows-10),
-                      fontStyle,
-                      fontScale,
-                      yellowColor);
-
-              // Save frame to video
-              if (record_video && video.isOpened())
-              {
-                  video << frame;
-              }
-
-              Mat window;
-
-              resize(frame, window, window_size);
-
-              QImage qimg = Mat2QImage(window);
-
-              emit qimgReady(qimg);
+              // overlay, encode and preview run on their own threads
+              overlay_stage.submit(item);
           }
 
 #ifdef QT_DEBUG
@@ -411,55 +784,39 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
         else if (was_active)
         {
             was_active = false;
-            QImage qimg = Mat2QImage(Mat::zeros(window_size, CV_8UC3));
+            QImage qimg = PreviewStage::Mat2QImage(Mat::zeros(window_size, CV_8UC3));
 
-            emit qimgReady(qimg);
+            preview_stage.mailbox()->post(qimg);
         }
 
-      // determine time when all processing done
-      processingDoneTimestamp = microsec_clock::local_time();
-
-      // wait for X microseconds until 1second/framerate time has passed after previous frame write
-      while(td.total_microseconds() < 1000000/framerate)
-      {
-          //determine current elapsed time
-
-          currentFrameTimestamp = microsec_clock::local_time();
-          td = (currentFrameTimestamp - nextFrameTimestamp);
-      }
+      // sleep (on the monotonic clock) until the next frame deadline;
+      // the scheduler keeps deadlines on a fixed grid so drift cannot accumulate
+      // and skips whole periods if processing overran them.
+      pacingStartTimestamp = FrameScheduler::Clock::now();
 
-      // add 1second/framerate time for next loop pause
-      nextFrameTimestamp = nextFrameTimestamp + microsec(1000000/framerate);
+      // free-running sources (benchmarks, fast replay) are not paced
+      qint64 lateness = capture->isFreeRunning() ? 0 : scheduler.waitForNextFrame();
 
-      // reset time_duration so while loop engages
-      td = (currentFrameTimestamp - nextFrameTimestamp);
+      pacing_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(FrameScheduler::Clock::now() - pacingStartTimestamp).count());
 
-      //determine and print out delay in ms, should be less than 1000/FPS
-      //occasionally, if delay is larger than said value, correction will occur
-      //if delay is consistently larger than said value, then CPU is not powerful
-      // enough to capture/decompress/record/compress that fast.
-      finalLoopTimestamp = microsec_clock::local_time();
-      td1 = (processingDoneTimestamp - initialLoopTimestamp);
-      td2 = (finalLoopTimestamp - initialLoopTimestamp);
-
-      tdlist << td1;
-      size_t tdlistsize = tdlist.size();
-
-      if (tdlistsize > 100)
+#ifdef QT_DEBUG
+      if (lateness > scheduler.periodMicroseconds())
       {
-          tdlist.removeFirst();
+          qDebug() << "Camera" << idx << ": frame" << nframe << "late by" << lateness << "us";
       }
+#endif
 
-      long total_td = 0;
+      frameLateness = lateness;
+    }
 
-      QLinkedList<time_duration>::const_iterator it;
-      for (it = tdlist.constBegin(); it != tdlist.constEnd(); ++it)
-      {
-          total_td += it->total_microseconds();
-      }
+    // Drain in pipeline order so every queued frame reaches the writer
+    overlay_stage.stopStage();
+    encode_stage.stopStage();
+    preview_stage.stopStage();
 
-      avgload = total_td*framerate/(tdlistsize*1000000.0);
-    }
+#ifdef QT_DEBUG
+    qDebug() << "Camera" << idx << ": frame pool misses:" << poolMisses();
+#endif
 
     emit resultReady(result);
 }
@@ -467,30 +824,49 @@ void CameraThread::run() { //Q_DECL_OVERRIDE
 ///
 /// \brief CameraThread::resizeAR
 ///
-/// Resize mat to fit window (keeping aspect ratio)
+/// Resize src to fit dst (keeping aspect ratio). dst keeps its size and
+/// buffer: the picture is resized straight into its region of dst and
+/// only the bars around it are cleared.
 ///
-/// \param frame
-/// \param osize
+/// \param src
+/// \param dst
 ///
-void CameraThread::resizeAR(Mat &frame, Size osize)
+void CameraThread::resizeAR(const Mat &src, Mat &dst)
 {
+    Size osize = dst.size();
+
     float o_aspect_ratio = float(osize.width)/float(osize.height);
-    float f_aspect_ratio = float(frame.cols)/float(frame.rows);
+    float f_aspect_ratio = float(src.cols)/float(src.rows);
 
     if (fabs(f_aspect_ratio-o_aspect_ratio)<0.01)
     {
-        resize(frame, frame, osize);
+        resize(src, dst, osize);
         return;
     }
 
-    Mat newframe = Mat::zeros(osize, CV_8UC3);
-    int roi_width = int(f_aspect_ratio*osize.height);
-    int roi_displacement = int(osize.width-roi_width)/2;
-    Mat roi(newframe, Rect(roi_displacement, 0, roi_width, osize.height));
-    resize(frame, roi, roi.size());
-    newframe.copyTo(frame);
+    Rect picture;
+
+    if (f_aspect_ratio < o_aspect_ratio)
+    {
+        // narrower: bars left and right
+        int roi_width = int(f_aspect_ratio*osize.height);
+        picture = Rect((osize.width-roi_width)/2, 0, roi_width, osize.height);
 
-    return;
+        dst.colRange(0, picture.x).setTo(Scalar::all(0));
+        dst.colRange(picture.x + picture.width, osize.width).setTo(Scalar::all(0));
+    }
+    else
+    {
+        // wider: bars above and below
+        int roi_height = int(osize.width/f_aspect_ratio);
+        picture = Rect(0, (osize.height-roi_height)/2, osize.width, roi_height);
+
+        dst.rowRange(0, picture.y).setTo(Scalar::all(0));
+        dst.rowRange(picture.y + picture.height, osize.height).setTo(Scalar::all(0));
+    }
+
+    Mat roi(dst, picture);
+    resize(src, roi, roi.size());
 }
 
 ///
@@ -523,81 +899,129 @@ void CameraThread::onStateChanged(QMediaRecorder::State state)
         if (!is_active)
         {
             record_video = false;
+            muxed_in_process = false;
             break;
         }
 
-        if (!video.isOpened())
+        if (encode_stage.isAccepting())
         {
-#ifdef QT_DEBUG
-            qDebug() << QString("CameraThread::onStateChanged(): initializing "
-                    "VideoWriter for camera %1; Location %2").arg(idx).arg(tempWriteLocation + "/" + VIDEOSTRING);
-
-            qDebug() << "FourCC: " << fourcc;
-#endif
-
-
-
-            video.open(QString(tempWriteLocation + "/" + VIDEOSTRING).toStdString(),
-                       fourcc,
-                       framerate,
-                       (output_size.width ? output_size : input_size),
-                       true);
-
-#ifdef QT_DEBUG
-            qDebug() << "Opened window";
-#endif
-
+            record_video = true;
+            break;
         }
 
-        if (!video.isOpened())
+        // the last file is still being finalized on the encode thread;
+        // this one is opened once that is done
+        if (encode_stage.isOpen())
         {
-            emit errorMessage(QString("ERROR: Failed to initialize camera %1").arg(idx));
+            start_pending = true;
+            break;
         }
-        else
-        {
-#ifdef QT_DEBUG
-            qDebug() << QString("CameraThread::onStateChanged(): initialization ready for camera %1").arg(idx);
-#endif
 
-            record_video = true;
-        }
+        startRecording();
 
         break;
 
     case QMediaRecorder::PausedState:
         record_video = false;
+        start_pending = false;
+        held_audio.clear();
+
+        // writer is released once the encode queue drains
+        encode_stage.finish();
 
         break;
 
     case QMediaRecorder::StoppedState:
         record_video = false;
+        start_pending = false;
+        held_audio.clear();
+
+        encode_stage.finish();
 
         break;
     }
 }
 
 ///
-/// \brief CameraThread::Mat2QImage
+/// \brief CameraThread::startRecording
 ///
-/// Convert mat to QIMage for display
+/// Open the output for a new recording: in-process if a mux target is set,
+/// otherwise (or if that fails) the temporary VideoWriter file
 ///
-/// \param src
-/// \return
+void CameraThread::startRecording()
+{
+    // new file: new statistics
+    overlay_stage.resetSceneStats();
+
+    if (!mux_target.isEmpty())
+    {
+        muxed_in_process = encode_stage.openMuxed(mux_target,
+                                                  framerate,
+                                                  (output_size.width ? output_size : input_size),
+                                                  mux_compress);
+
+#ifdef QT_DEBUG
+        qDebug() << QString("CameraThread::startRecording(): in-process output for camera %1: %2 (%3)")
+                    .arg(idx).arg(mux_target).arg(muxed_in_process ? "ok" : "failed");
+#endif
+    }
+
+    if (!encode_stage.isAccepting())
+    {
+        muxed_in_process = false;
+
+#ifdef QT_DEBUG
+        qDebug() << QString("CameraThread::startRecording(): initializing "
+                "VideoWriter for camera %1; Location %2").arg(idx).arg(tempWriteLocation + "/" + videoFile);
+
+        qDebug() << "FourCC: " << fourcc;
+#endif
+
+        encode_stage.open(QString(tempWriteLocation + "/" + videoFile),
+                          fourcc,
+                          framerate,
+                          (output_size.width ? output_size : input_size));
+
+#ifdef QT_DEBUG
+        qDebug() << "Opened window";
+#endif
+
+    }
+
+    if (!encode_stage.isAccepting())
+    {
+        emit errorMessage(QString("ERROR: Failed to initialize camera %1").arg(idx));
+    }
+    else
+    {
+#ifdef QT_DEBUG
+        qDebug() << QString("CameraThread::startRecording(): initialization ready for camera %1").arg(idx);
+#endif
+
+        record_video = true;
+    }
+}
+
 ///
-QImage CameraThread::Mat2QImage(cv::Mat const& src)
+/// \brief CameraThread::writerClosed
+///
+/// The encode stage has finalized the previous file
+///
+void CameraThread::writerClosed()
 {
-     cv::Mat temp;
+    if (!start_pending)
+    {
+        return;
+    }
 
-     cvtColor(src, temp,CV_BGR2RGB);
+    start_pending = false;
 
-     QImage dest((const uchar *) temp.data,
-                 temp.cols,
-                 temp.rows,
-                 static_cast<int>(temp.step),
-                 QImage::Format_RGB888);
+    if (is_active)
+    {
+        startRecording();
+    }
 
-     dest.bits(); // enforce deep copy, see documentation
-     return dest;
+    writeHeldAudio();
 }
 
 ///
@@ -654,6 +1078,54 @@ void CameraThread::breakLoop()
     stopLoop = true;
 }
 
+///
+/// \brief CameraThread::latencySummary
+///
+/// Percentiles for one stage of the pipeline; safe to call from the GUI
+///
+/// \param stage
+/// \return
+///
+LatencySummary CameraThread::latencySummary(LatencyStage stage) const
+{
+    switch (stage) {
+    case LatencyGrab:
+        return grab_latency.summary();
+
+    case LatencyOverlay:
+        return overlay_stage.latency().summary();
+
+    case LatencyEncode:
+        return encode_stage.latency().summary();
+
+    case LatencyPreview:
+        return preview_stage.latency().summary();
+
+    case LatencyPacing:
+        return pacing_latency.summary();
+
+    case LatencyDisk:
+        return encode_stage.diskWriter().latency().summary();
+
+    default:
+        break;
+    }
+
+    return LatencySummary();
+}
+
+///
+/// \brief CameraThread::poolMisses
+///
+/// Buffers that had to be heap allocated because a pool was exhausted
+///
+/// \return
+///
+quint64 CameraThread::poolMisses() const
+{
+    return capture_pool.misses() + preview_stage.imageMisses();
+}
+
 ///
 /// \brief CameraThread::setCameraPower
 ///
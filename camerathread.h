@@ -54,12 +54,19 @@
 #include <QThread>
 #include <QImage>
 #include <QMediaRecorder>
+#include <QAudioBuffer>
+#include <QStringList>
 
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/core.hpp"
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 
+#include "framepipeline.h"
+#include "latencyhistogram.h"
+#include "audioclock.h"
+#include "enums.h"
+
 using namespace cv;
 
 class CameraThread : public QThread
@@ -69,12 +76,20 @@ class CameraThread : public QThread
     void run();
 
 signals:
-    void qimgReady(const QImage qimg);
     void resultReady(const QString &s);
     void cameraInfo(int, int, int);
     void errorMessage(const QString &e);
     void cameraConnected(bool);
 
+    // in-process output written and closed
+    void fileFinished(const QString &path);
+
+    // temporary VideoWriter file closed; ready for the external mux
+    void videoFileClosed(const QString &path, const VideoTiming &timing);
+
+    // after rollOver(): where recording continues, empty if it could not
+    void segmentStarted(const QString &path);
+
 public slots:
     void setOutputDirectory(const QString &d);
     void onStateChanged(QMediaRecorder::State);
@@ -85,16 +100,60 @@ public slots:
 
     void updateSessionConditions(int index, QString value);
 
+    void setPreviewSize(QSize size);
+    void setPreviewEnabled(bool enabled);
+
+private slots:
+    void writerClosed();
+
 public:
     CameraThread(int i);
     CameraThread(int i, QString wxh);
 
     void breakLoop();
 
+    quint64 poolMisses() const;
+
+    LatencySummary latencySummary(LatencyStage stage) const;
+
+    PreviewMailbox* previewMailbox();
+
+    static QString videoFileName(int n);
+    void setVideoFile(const QString &name);
+    void setWorkspace(const QString &dir);
+    QString videoFilePath() const;
+
+    void setMuxTarget(const QString &path, bool compress);
+    bool isMuxedInProcess() const { return muxed_in_process; }
+
+    // a file is still open; its close signal is yet to come
+    bool isWriting() { return encode_stage.isOpen(); }
+
+    void writeAudio(const QAudioBuffer &buffer);
+    void writeAudio(const void *data, int bytes, const QAudioFormat &format, qint64 arrivalUs);
+
+    qint64 prerollBytes();
+
+    qint64 bytesWritten() const;
+    bool rollOver(const QString &path);
+
+    qint64 diskQueueBytes() const;
+    qint64 peakDiskQueueBytes() const;
+
+    SceneStats sceneStats() const;
+    VideoTiming videoTiming();
+
+    void setCaptureSource(const QString &description);
+
+    static QStringList muxArguments(const QString &videoFile, const VideoTiming &timing, const AudioClock &audio, bool compress);
+
+    // letterboxed resize into dst at its current size, without reallocating
+    static void resizeAR(const cv::Mat &src, cv::Mat &dst);
+
 private:
-    QImage Mat2QImage(cv::Mat const& src);
+    void setupPipeline();
+    void startRecording();
 
-    void resizeAR(cv::Mat &, cv::Size);
     void setDefaultDesiredInputSize();
 
     int fourcc;
@@ -103,14 +162,17 @@ private:
     cv::Size desired_input_size;
     cv::Size input_size;
 
-    double fontScale = 0.50;
-    int fontStyle = cv::FONT_ITALIC;
-
     bool record_video;
     bool is_active;
     bool was_active;
 
-    cv::VideoWriter video;
+    // capture buffers, shared by every stage
+    FramePool capture_pool;
+
+    // capture -> overlay -> {encode, preview}
+    EncodeStage encode_stage;
+    PreviewStage preview_stage;
+    OverlayStage overlay_stage{&encode_stage, &preview_stage};
 
     cv::Size output_size;
     cv::Size window_size;
@@ -119,29 +181,45 @@ private:
 
     bool stopLoop;
 
-    QString winId = "";
-    QString winSession = "";
-    QString winTreatment = "";
-    QString winCondition = "";
+    size_t nframe = 0;
 
-    Point topRect1;
-    Point topRect2;
+    // capture-thread timings; stage timings live in each FrameStage
+    LatencyHistogram grab_latency;
+    LatencyHistogram pacing_latency;
 
-    Point topText1;
-    Point topText2;
-    Point topText3;
-    Point topText4;
+    // Lateness of the most recent frame against its deadline (microseconds)
+    qint64 frameLateness = 0;
 
-    double avgload = 0.0;
-    size_t nframe = 0;
-
-    // Default annotation values
-    Scalar yellowColor = Scalar(255, 255, 255);
-    Scalar blackColor = Scalar(0, 0, 0);
+    // Busy-wait window before each frame deadline; 0 sleeps the whole way
+    int spinWindow = 0;
 
     int framerate = 15;
 
     QString tempWriteLocation;
+    QString videoFile;
+
+    // CaptureSource description; empty for camera idx
+    QString capture_source;
+
+    // final output when encoding in-process; empty to use VideoWriter + ffmpeg
+    QString mux_target;
+    bool mux_compress = false;
+    bool muxed_in_process = false;
+
+    // Record arrived while the last file was still being finalized
+    bool start_pending = false;
+
+    struct HeldAudio
+    {
+        QByteArray pcm;
+        QAudioFormat format;
+        qint64 arrival_us;
+    };
+
+    // audio (pre-roll first) for a file that is not open yet
+    QList<HeldAudio> held_audio;
+
+    void writeHeldAudio();
 };
 
 #endif // CAMERATHREAD_H
@@ -0,0 +1,413 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "capturesource.h"
+
+#include <QMap>
+#include <QStringList>
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+///
+/// \brief CaptureSource::create
+///
+/// \param description
+///
+/// See the class documentation; empty for the camera at index
+///
+/// \param index
+///
+/// Device index, used when the description names none
+///
+/// \return
+///
+/// Never null; an unknown kind falls back to the camera
+///
+CaptureSource* CaptureSource::create(const QString &description, int index)
+{
+    QStringList parts = description.split(',');
+    QString head = parts.takeFirst().trimmed();
+
+    QString kind = head.section(':', 0, 0).toLower();
+    QString argument = head.section(':', 1);
+
+    // key=value options
+    QMap<QString, QString> options;
+
+    foreach (const QString &part, parts)
+    {
+        options.insert(part.section('=', 0, 0).trimmed().toLower(), part.section('=', 1).trimmed());
+    }
+
+    if (kind == QLatin1String("synthetic"))
+    {
+        cv::Size size;
+
+        if (argument.contains('x'))
+        {
+            size = cv::Size(argument.section('x', 0, 0).toInt(), argument.section('x', 1, 1).toInt());
+        }
+
+        return new SyntheticSource(size,
+                                   SyntheticSource::patternFromString(options.value(QLatin1String("pattern"))),
+                                   options.value(QLatin1String("motion"), QLatin1String("4")).toInt(),
+                                   options.value(QLatin1String("fast"), QLatin1String("0")).toInt() != 0);
+    }
+
+    if (kind == QLatin1String("file"))
+    {
+        return new FileSource(argument,
+                              options.value(QLatin1String("realtime"), QLatin1String("1")).toInt() != 0,
+                              options.value(QLatin1String("loop"), QLatin1String("0")).toInt() != 0);
+    }
+
+#ifdef QT_DEBUG
+    if (!kind.isEmpty() && kind != QLatin1String("camera"))
+    {
+        qDebug() << "CaptureSource: unknown source" << description << ", using camera" << index;
+    }
+#endif
+
+    bool ok = false;
+    int device = argument.toInt(&ok);
+
+    return new CameraSource(ok ? device : index);
+}
+
+///
+/// \brief CameraSource::open
+/// \param requested
+/// \return
+///
+bool CameraSource::open(cv::Size requested)
+{
+    capture.open(device);
+
+    capture.set(CV_CAP_PROP_FRAME_WIDTH,  requested.width);
+    capture.set(CV_CAP_PROP_FRAME_HEIGHT, requested.height);
+
+    if (!capture.isOpened())
+    {
+        return false;
+    }
+
+    size = cv::Size(capture.get(CV_CAP_PROP_FRAME_WIDTH), capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+
+    return true;
+}
+
+///
+/// \brief CameraSource::read
+/// \param frame
+/// \return
+///
+bool CameraSource::read(cv::Mat &frame)
+{
+    // a failed grab releases frame; keep hold of the caller's buffer
+    cv::Mat buffer = frame;
+
+    if (capture.read(frame) && !frame.empty())
+    {
+        return true;
+    }
+
+    frame = buffer;
+
+    return false;
+}
+
+///
+/// \brief SyntheticSource::SyntheticSource
+/// \param size
+///
+/// Empty to take the requested size at open()
+///
+/// \param pattern
+/// \param motion
+///
+/// Pixels the box moves per frame
+///
+/// \param fast
+///
+/// Free-running instead of paced at the recording rate
+///
+SyntheticSource::SyntheticSource(cv::Size size, Pattern pattern, int motion, bool fast) :
+    size(size),
+    pattern(pattern),
+    motion(qMax(0, motion)),
+    free_running(fast)
+{
+}
+
+///
+/// \brief SyntheticSource::patternFromString
+/// \param name
+/// \return
+///
+SyntheticSource::Pattern SyntheticSource::patternFromString(const QString &name)
+{
+    if (name == QLatin1String("gradient")) return Gradient;
+    if (name == QLatin1String("checker")) return Checker;
+    if (name == QLatin1String("noise")) return Noise;
+
+    return Bars;
+}
+
+///
+/// \brief SyntheticSource::open
+///
+/// Renders the background once
+///
+/// \param requested
+/// \return
+///
+bool SyntheticSource::open(cv::Size requested)
+{
+    if (size.width <= 0 || size.height <= 0)
+    {
+        size = (requested.width > 0 && requested.height > 0) ? requested : cv::Size(640, 480);
+    }
+
+    background.create(size, CV_8UC3);
+    frame_count = 0;
+
+    switch (pattern)
+    {
+    case Bars:
+    {
+        static const cv::Scalar bars[] = {
+            cv::Scalar(255, 255, 255), cv::Scalar(0, 255, 255), cv::Scalar(255, 255, 0), cv::Scalar(0, 255, 0),
+            cv::Scalar(255, 0, 255), cv::Scalar(0, 0, 255), cv::Scalar(255, 0, 0), cv::Scalar(0, 0, 0)
+        };
+
+        for (int i = 0; i < 8; ++i)
+        {
+            cv::rectangle(background,
+                          cv::Point(size.width * i / 8, 0),
+                          cv::Point(size.width * (i + 1) / 8, size.height),
+                          bars[i], CV_FILLED);
+        }
+
+        break;
+    }
+    case Gradient:
+        for (int y = 0; y < size.height; ++y)
+        {
+            uchar *row = background.ptr<uchar>(y);
+
+            for (int x = 0; x < size.width; ++x)
+            {
+                row[x * 3 + 0] = uchar(x * 255 / qMax(1, size.width - 1));
+                row[x * 3 + 1] = uchar(y * 255 / qMax(1, size.height - 1));
+                row[x * 3 + 2] = 128;
+            }
+        }
+        break;
+    case Checker:
+        background.setTo(cv::Scalar(32, 32, 32));
+
+        for (int y = 0; y < size.height; y += 32)
+        {
+            for (int x = (y / 32) % 2 * 32; x < size.width; x += 64)
+            {
+                cv::rectangle(background, cv::Point(x, y), cv::Point(x + 31, y + 31), cv::Scalar(224, 224, 224), CV_FILLED);
+            }
+        }
+        break;
+    case Noise:
+        break;
+    }
+
+    return true;
+}
+
+///
+/// \brief SyntheticSource::read
+/// \param frame
+/// \return
+///
+bool SyntheticSource::read(cv::Mat &frame)
+{
+    frame.create(size, CV_8UC3);
+
+    if (pattern == Noise)
+    {
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+    }
+    else
+    {
+        background.copyTo(frame);
+    }
+
+    if (motion > 0)
+    {
+        int box = qMax(8, size.width / 8);
+        qint64 travel = frame_count * motion;
+
+        int x = int(travel % qMax(1, size.width - box));
+        int y = int((travel / 3) % qMax(1, size.height - box));
+
+        cv::rectangle(frame, cv::Point(x, y), cv::Point(x + box, y + box), cv::Scalar(0, 128, 255), CV_FILLED);
+    }
+
+    frame_count++;
+
+    return true;
+}
+
+///
+/// \brief FileSource::FileSource
+/// \param path
+/// \param realtime
+/// \param loop
+///
+FileSource::FileSource(const QString &path, bool realtime, bool loop) :
+    path(path),
+    real_time(realtime),
+    loop(loop)
+{
+}
+
+///
+/// \brief FileSource::open
+///
+/// The file decides the frame size
+///
+/// \return
+///
+bool FileSource::open(cv::Size)
+{
+    if (!capture.open(path.toStdString()) || !nextFrame())
+    {
+        return false;
+    }
+
+    fps = capture.get(CV_CAP_PROP_FPS);
+
+    if (fps <= 0.0 || fps > 1000.0)
+    {
+        fps = 30.0;
+    }
+
+    size = current.size();
+    pending = true;
+    at_end = false;
+    started = std::chrono::steady_clock::now();
+
+#ifdef QT_DEBUG
+    qDebug() << "FileSource:" << path << size.width << "x" << size.height << "at" << fps << "fps";
+#endif
+
+    return true;
+}
+
+///
+/// \brief FileSource::read
+/// \param frame
+/// \return
+///
+bool FileSource::read(cv::Mat &frame)
+{
+    if (at_end)
+    {
+        return false;
+    }
+
+    if (real_time)
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        qint64 due = qint64(elapsed * fps);
+
+        // skip what is already late; if we're early the current frame repeats
+        while (position < due)
+        {
+            // a rewind restarts the clock
+            if (!nextFrame() || position == 0)
+            {
+                break;
+            }
+        }
+    }
+    else if (!pending)
+    {
+        nextFrame();
+    }
+
+    pending = false;
+
+    if (at_end || current.empty())
+    {
+        return false;
+    }
+
+    current.copyTo(frame);
+
+    return true;
+}
+
+///
+/// \brief FileSource::nextFrame
+///
+/// Advance one frame, rewinding at the end when looping
+///
+/// \return
+///
+bool FileSource::nextFrame()
+{
+    if (capture.read(current))
+    {
+        position++;
+
+        return true;
+    }
+
+    if (!loop || position < 0)
+    {
+        at_end = true;
+
+        return false;
+    }
+
+    // not every backend can seek; reopening always works
+    capture.release();
+
+    if (!capture.open(path.toStdString()) || !capture.read(current))
+    {
+        at_end = true;
+
+        return false;
+    }
+
+    position = 0;
+    started = std::chrono::steady_clock::now();
+
+    return true;
+}
@@ -0,0 +1,166 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef CAPTURESOURCE_H
+#define CAPTURESOURCE_H
+
+#include <QString>
+
+#include <chrono>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+///
+/// \brief The CaptureSource class
+///
+/// Where CameraThread gets its frames. Besides a real camera, frames can be
+/// generated or replayed from a file, so the pipeline can be measured on a
+/// machine without a webcam.
+///
+/// Sources are described by a string, "kind[:argument][,key=value...]":
+///
+///   camera[:index]
+///   synthetic[:WxH][,pattern=bars|gradient|checker|noise][,motion=px][,fast=1]
+///   file:path[,realtime=0][,loop=1]
+///
+/// An empty description is the camera given by the device index.
+///
+class CaptureSource
+{
+public:
+    virtual ~CaptureSource() {}
+
+    static CaptureSource* create(const QString &description, int index);
+
+    // requested is a hint; the source decides frameSize()
+    virtual bool open(cv::Size requested) = 0;
+    virtual cv::Size frameSize() const = 0;
+
+    // reuses frame's buffer when the size matches; false if nothing was read
+    virtual bool read(cv::Mat &frame) = 0;
+
+    // frames are taken as fast as they can be processed, without pacing
+    virtual bool isFreeRunning() const { return false; }
+
+    // a replay that has nothing more to give
+    virtual bool atEnd() const { return false; }
+
+    virtual QString name() const = 0;
+};
+
+///
+/// \brief The CameraSource class
+///
+class CameraSource : public CaptureSource
+{
+public:
+    explicit CameraSource(int index) : device(index) {}
+
+    bool open(cv::Size requested);
+    cv::Size frameSize() const { return size; }
+    bool read(cv::Mat &frame);
+    QString name() const { return QString("camera %1").arg(device); }
+
+private:
+    int device;
+    cv::Size size;
+    cv::VideoCapture capture;
+};
+
+///
+/// \brief The SyntheticSource class
+///
+/// A test pattern with a box moving across it; motion 0 gives a static
+/// scene
+///
+class SyntheticSource : public CaptureSource
+{
+public:
+    enum Pattern { Bars, Gradient, Checker, Noise };
+
+    SyntheticSource(cv::Size size, Pattern pattern, int motion, bool fast);
+
+    bool open(cv::Size requested);
+    cv::Size frameSize() const { return size; }
+    bool read(cv::Mat &frame);
+    bool isFreeRunning() const { return free_running; }
+    QString name() const { return QString("synthetic %1x%2").arg(size.width).arg(size.height); }
+
+    static Pattern patternFromString(const QString &name);
+
+private:
+    cv::Size size;
+    Pattern pattern;
+    int motion;
+    bool free_running;
+
+    cv::Mat background;
+    qint64 frame_count = 0;
+};
+
+///
+/// \brief The FileSource class
+///
+/// Replays a recording. In real time the frame shown is the one due at the
+/// elapsed time (frames are skipped or repeated to keep up); otherwise
+/// every frame is delivered as fast as the pipeline takes them.
+///
+class FileSource : public CaptureSource
+{
+public:
+    FileSource(const QString &path, bool realtime, bool loop);
+
+    bool open(cv::Size requested);
+    cv::Size frameSize() const { return size; }
+    bool read(cv::Mat &frame);
+    bool isFreeRunning() const { return !real_time; }
+    bool atEnd() const { return at_end; }
+    QString name() const { return path; }
+
+private:
+    bool nextFrame();
+
+    QString path;
+    bool real_time;
+    bool loop;
+
+    cv::VideoCapture capture;
+    cv::Size size;
+    double fps = 0.0;
+
+    cv::Mat current;
+    qint64 position = -1;
+    bool at_end = false;
+
+    // current has not been handed out yet
+    bool pending = false;
+
+    std::chrono::steady_clock::time_point started;
+};
+
+#endif // CAPTURESOURCE_H
@@ -0,0 +1,100 @@
+# Session Recorder
+# Build settings shared by the application and the benchmark
+
+CONFIG   += c++11
+
+CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
+
+VERSION_MAJOR = 0
+VERSION_MINOR = 0
+VERSION_BUILD = 3
+
+DEFINES += "VERSION_MAJOR=$$VERSION_MAJOR"\
+           "VERSION_MINOR=$$VERSION_MINOR"\
+           "VERSION_BUILD=$$VERSION_BUILD"\
+           "VERSION_TESTING=$$TEST_FEATURES"
+
+DEFINES += QT_DEPRECATED_WARNINGS\
+           VIDEOSTRING='\\"video.avi\\"'\
+           VIDEOEXT='\\"avi\\"'\
+           MUXEXT='\\"mp4\\"'
+
+# In-process H.264/AAC encoding (FFmpeg libraries); without it recordings
+# go through VideoWriter and are muxed by the external ffmpeg afterwards.
+# Opt in with "qmake CONFIG+=libav" (FFMPEGDIR=... for a non-default
+# install); on Linux it is enabled when pkg-config finds the libraries,
+# unless "CONFIG+=nolibav" is given
+LIBAV_MODULES = libavformat libavcodec libswscale libswresample libavutil
+
+unix:!macx:!libav:!nolibav {
+    packagesExist($$LIBAV_MODULES): CONFIG += libav
+}
+
+nolibav: CONFIG -= libav
+
+libav {
+    message(In-process encoding: FFmpeg libraries)
+    DEFINES += USE_LIBAV
+
+    unix:!macx {
+        CONFIG += link_pkgconfig
+        PKGCONFIG += $$LIBAV_MODULES
+    }
+
+    macx {
+        isEmpty(FFMPEGDIR): FFMPEGDIR = /usr/local
+        INCLUDEPATH += $$FFMPEGDIR/include
+        LIBS += -L$$FFMPEGDIR/lib -lavformat -lavcodec -lswscale -lswresample -lavutil
+    }
+
+    win32 {
+        isEmpty(FFMPEGDIR): FFMPEGDIR = C:\local\ffmpeg
+        INCLUDEPATH += $$FFMPEGDIR\include
+        LIBS += -L$$FFMPEGDIR\lib -lavformat -lavcodec -lswscale -lswresample -lavutil
+    }
+}
+
+macx {
+     message(Platform: Mac OS X)
+
+     BOOSTPATH = /usr/local
+     INCLUDEPATH += $$BOOSTPATH/include
+     LIBS += -L$$BOOSTPATH/lib
+
+     OPENCVDIR = /opt/local
+     INCLUDEPATH += $$OPENCVDIR/include
+     LIBS += -L$$OPENCVDIR/lib
+
+    CONFIG(debug, debug|release) {
+        DESTDIR = $$OUT_PWD/build/debug
+        LIBS += -lopencv_cored -lopencv_highguid -lopencv_imgprocd -lopencv_imgcodecsd -lopencv_videoiod
+    } else {
+        DESTDIR = $$OUT_PWD/build/release
+        LIBS += -lopencv_core -lopencv_highgui -lopencv_imgproc -lopencv_imgcodecs -lopencv_videoio
+    }
+}
+
+win32 {
+    message(Platform: Win32)
+    BOOSTDIR  = C:\Users\shawn\boost_1_58_0
+
+    INCLUDEPATH += $$BOOSTDIR
+    LIBS += -L$$BOOSTDIR\stage\lib
+
+    OPENCVDIR = C:\local\opencv\build
+    INCLUDEPATH += $$OPENCVDIR\include
+
+    LIBS += -L$$OPENCVDIR\x64\vc14\bin
+    LIBS += -L$$OPENCVDIR\x64\vc14\lib
+
+    INCLUDEPATH += -L$$OPENCVDIR\x64\vc14\bin
+    INCLUDEPATH += -L$$OPENCVDIR\x64\vc14\lib
+
+    CONFIG(debug, debug|release) {
+        DESTDIR = $$OUT_PWD/build/debug
+        LIBS += -lopencv_core2413d -lopencv_highgui2413d -lopencv_imgproc2413d
+    } else {
+        DESTDIR = $$OUT_PWD/build/release
+        LIBS += -lopencv_core2413 -lopencv_highgui2413 -lopencv_imgproc2413
+    }
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "devicescanner.h"
+
+#include <QAudioRecorder>
+#include <QCameraInfo>
+#include <QSettings>
+#include <QVariant>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#include <QElapsedTimer>
+#endif
+
+///
+/// \brief DeviceScanner::DeviceScanner
+/// \param parent
+///
+DeviceScanner::DeviceScanner(QObject *parent) : QObject(parent)
+{
+    qRegisterMetaType<DeviceList>("DeviceList");
+}
+
+///
+/// \brief DeviceScanner::scan
+///
+/// Blocking enumeration; run it on a worker thread
+///
+void DeviceScanner::scan()
+{
+#ifdef QT_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+#endif
+
+    DeviceList devices;
+
+    foreach (const QCameraInfo &device, QCameraInfo::availableCameras())
+    {
+        devices.cameras << device.description();
+    }
+
+    // created here so the backend is loaded on this thread, not the GUI's
+    QAudioRecorder audioRecorder;
+
+    devices.audioInputs = audioRecorder.audioInputs();
+    devices.audioCodecs = audioRecorder.supportedAudioCodecs();
+    devices.sampleRates = audioRecorder.supportedAudioSampleRates();
+
+#ifdef QT_DEBUG
+    qDebug() << "DeviceScanner::scan()" << timer.elapsed() << "ms";
+    qDebug() << "Cameras:" << devices.cameras;
+    qDebug() << "Microphones:" << devices.audioInputs;
+#endif
+
+    saveCached(devices);
+
+    emit scanned(devices);
+}
+
+///
+/// \brief DeviceScanner::loadCached
+/// \return
+///
+/// Empty on first run
+///
+DeviceList DeviceScanner::loadCached()
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("DeviceCache"));
+
+    DeviceList devices;
+    devices.cameras = settings.value(QLatin1String("cameras")).toStringList();
+    devices.audioInputs = settings.value(QLatin1String("audioInputs")).toStringList();
+    devices.audioCodecs = settings.value(QLatin1String("audioCodecs")).toStringList();
+
+    foreach (const QVariant &rate, settings.value(QLatin1String("sampleRates")).toList())
+    {
+        devices.sampleRates << rate.toInt();
+    }
+
+    settings.endGroup();
+
+    return devices;
+}
+
+///
+/// \brief DeviceScanner::saveCached
+/// \param devices
+///
+void DeviceScanner::saveCached(const DeviceList &devices)
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("DeviceCache"));
+
+    settings.setValue(QLatin1String("cameras"), devices.cameras);
+    settings.setValue(QLatin1String("audioInputs"), devices.audioInputs);
+    settings.setValue(QLatin1String("audioCodecs"), devices.audioCodecs);
+
+    QVariantList rates;
+    foreach (int rate, devices.sampleRates)
+    {
+        rates << rate;
+    }
+    settings.setValue(QLatin1String("sampleRates"), rates);
+
+    settings.endGroup();
+    settings.sync();
+}
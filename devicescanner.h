@@ -0,0 +1,81 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef DEVICESCANNER_H
+#define DEVICESCANNER_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QList>
+#include <QStringList>
+
+///
+/// \brief The DeviceList struct
+///
+/// Capture devices and audio capabilities, as offered in the InitializationDialog
+///
+struct DeviceList
+{
+    // index n is OpenCV capture index n
+    QStringList cameras;
+
+    QStringList audioInputs;
+    QStringList audioCodecs;
+    QList<int> sampleRates;
+
+    bool isEmpty() const
+    {
+        return cameras.isEmpty() && audioInputs.isEmpty() && audioCodecs.isEmpty() && sampleRates.isEmpty();
+    }
+};
+
+Q_DECLARE_METATYPE(DeviceList)
+
+///
+/// \brief The DeviceScanner class
+///
+/// Enumerates devices on whatever thread it lives on; USB hubs and virtual
+/// audio drivers can make this take seconds. The last result is cached in
+/// settings so the dialog can show it straight away.
+///
+class DeviceScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeviceScanner(QObject *parent = 0);
+
+    static DeviceList loadCached();
+    static void saveCached(const DeviceList &devices);
+
+signals:
+    void scanned(const DeviceList &devices);
+
+public slots:
+    void scan();
+};
+
+#endif // DEVICESCANNER_H
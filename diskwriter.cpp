@@ -0,0 +1,568 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "diskwriter.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutexLocker>
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+namespace
+{
+    // batches end on a block boundary; the remainder waits for more data
+    const qint64 BlockBytes = 4096;
+
+    // an idle queue still gets its partial batch written this soon
+    const unsigned long IdleFlushMs = 250;
+}
+
+#ifdef _WIN32
+const DiskWriter::Handle DiskWriter::InvalidHandle = INVALID_HANDLE_VALUE;
+#else
+const DiskWriter::Handle DiskWriter::InvalidHandle = -1;
+#endif
+
+///
+/// \brief DiskWriter::DiskWriter
+///
+DiskWriter::DiskWriter() : queued_bytes(0), peak_queued_bytes(0), write_failed(0), total_bytes(0), file_handle(InvalidHandle)
+{
+
+}
+
+///
+/// \brief DiskWriter::~DiskWriter
+///
+DiskWriter::~DiskWriter()
+{
+    close();
+}
+
+///
+/// \brief DiskWriter::configure
+///
+/// Takes effect at the next open()
+///
+/// \param queueMB
+///
+/// Data held for the I/O thread before writers block
+///
+/// \param batchKB
+/// \param preallocateMB
+///
+/// Extent reserved ahead of the write position; 0 = off
+///
+/// \param policy
+/// \param fsyncIntervalMs
+///
+/// For FsyncInterval
+///
+void DiskWriter::configure(int queueMB, int batchKB, int preallocateMB, FsyncPolicy policy, int fsyncIntervalMs)
+{
+    queue_limit = static_cast<qint64>(qBound(1, queueMB, 1024)) << 20;
+    batch_bytes = qBound(4, batchKB, 16384) * 1024;
+    preallocate_bytes = static_cast<qint64>(qMax(0, preallocateMB)) << 20;
+    fsync_policy = policy;
+    fsync_interval_ms = qMax(1, fsyncIntervalMs);
+}
+
+///
+/// \brief DiskWriter::open
+///
+/// Create (or truncate) the file and start the I/O thread
+///
+/// \param path
+/// \return
+///
+bool DiskWriter::open(const QString &path)
+{
+    close();
+
+#ifdef _WIN32
+    file_handle = CreateFileW(reinterpret_cast<LPCWSTR>(path.utf16()), GENERIC_WRITE, FILE_SHARE_READ,
+                              nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+    file_handle = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+
+    if (file_handle == InvalidHandle)
+    {
+        return false;
+    }
+
+    requests.clear();
+    closing = false;
+
+    queued_bytes.storeRelease(0);
+    peak_queued_bytes.storeRelease(0);
+    write_failed.storeRelease(0);
+
+    end_offset = 0;
+    batch.clear();
+    batch.reserve(batch_bytes + BlockBytes);
+    batch_offset = 0;
+    allocated_end = 0;
+    unsynced = false;
+    preallocating = preallocate_bytes > 0;
+
+    write_latency.reset();
+
+    start();
+
+    return true;
+}
+
+///
+/// \brief DiskWriter::close
+///
+/// Write everything still queued, sync and close
+///
+/// \return
+///
+/// False if any write failed, or the preallocation could not be trimmed
+///
+bool DiskWriter::close()
+{
+    if (file_handle == InvalidHandle)
+    {
+        return true;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        closing = true;
+        has_requests.wakeOne();
+    }
+
+    wait();
+
+    // give back extents reserved past the end
+    if (allocated_end > end_offset)
+    {
+#ifdef _WIN32
+        FILE_ALLOCATION_INFO info;
+        info.AllocationSize.QuadPart = end_offset;
+
+        bool trimmed = SetFileInformationByHandle(file_handle, FileAllocationInfo, &info, sizeof(info)) != 0;
+#else
+        bool trimmed = ::ftruncate(file_handle, end_offset) == 0;
+#endif
+
+        // the reserved tail would stay in the file past the trailer
+        if (!trimmed)
+        {
+            write_failed.storeRelease(1);
+
+#ifdef QT_DEBUG
+            qDebug() << "DiskWriter: could not trim preallocation to" << end_offset << "bytes";
+#endif
+        }
+    }
+
+#ifdef _WIN32
+    CloseHandle(file_handle);
+#else
+    ::close(file_handle);
+#endif
+
+    file_handle = InvalidHandle;
+
+#ifdef QT_DEBUG
+    LatencySummary stats = write_latency.summary();
+    qDebug() << "DiskWriter: closed," << end_offset << "bytes in" << stats.count << "writes, p99"
+             << stats.p99 << "us, peak queue" << peakQueuedBytes() << "bytes";
+#endif
+
+    return !failed();
+}
+
+///
+/// \brief DiskWriter::write
+///
+/// Queue a copy of the data for the I/O thread. Never drops: if the disk
+/// has fallen a whole queue behind, the caller waits for it.
+///
+/// \param offset
+/// \param data
+/// \param size
+/// \return
+///
+bool DiskWriter::write(qint64 offset, const char *data, int size)
+{
+    if (file_handle == InvalidHandle || failed())
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    while (queued_bytes.loadAcquire() > 0 && queued_bytes.loadAcquire() + size > queue_limit && !failed())
+    {
+        has_room.wait(&mutex);
+    }
+
+    Request request;
+    request.offset = offset;
+    request.data = QByteArray(data, size);
+    request.sync = false;
+
+    requests.append(request);
+
+    int queued = queued_bytes.fetchAndAddOrdered(size) + size;
+
+    if (queued > peak_queued_bytes.loadAcquire())
+    {
+        peak_queued_bytes.storeRelease(queued);
+    }
+
+    end_offset = qMax(end_offset, offset + size);
+
+    total_bytes.fetchAndAddRelaxed(size);
+
+    has_requests.wakeOne();
+
+    return true;
+}
+
+///
+/// \brief DiskWriter::syncPoint
+///
+/// Everything written so far forms a complete unit; with FsyncOnFragment it
+/// is synced to disk once written
+///
+void DiskWriter::syncPoint()
+{
+    if (file_handle == InvalidHandle || fsync_policy != FsyncOnFragment)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    Request request;
+    request.offset = -1;
+    request.sync = true;
+
+    requests.append(request);
+
+    has_requests.wakeOne();
+}
+
+///
+/// \brief DiskWriter::run
+///
+void DiskWriter::run()
+{
+    QElapsedTimer sinceSync;
+    sinceSync.start();
+
+    forever
+    {
+        QList<Request> taken;
+        bool finishing;
+
+        {
+            QMutexLocker locker(&mutex);
+
+            if (requests.isEmpty() && !closing)
+            {
+                has_requests.wait(&mutex, IdleFlushMs);
+            }
+
+            taken.swap(requests);
+            finishing = closing;
+        }
+
+        if (taken.isEmpty())
+        {
+            // idle: write the partial batch rather than hold it
+            flushBatch(true);
+        }
+
+        int processed = 0;
+
+        for (int i = 0; i < taken.count(); ++i)
+        {
+            process(taken[i]);
+            processed += taken.at(i).data.size();
+        }
+
+        if (processed > 0)
+        {
+            QMutexLocker locker(&mutex);
+
+            queued_bytes.fetchAndAddOrdered(-processed);
+            has_room.wakeAll();
+        }
+
+        if (fsync_policy == FsyncInterval && sinceSync.elapsed() >= fsync_interval_ms)
+        {
+            flushBatch(true);
+            sync();
+
+            sinceSync.restart();
+        }
+
+        if (finishing && taken.isEmpty())
+        {
+            break;
+        }
+    }
+
+    flushBatch(true);
+    sync();
+}
+
+///
+/// \brief DiskWriter::process
+/// \param request
+///
+void DiskWriter::process(Request &request)
+{
+    if (failed())
+    {
+        // keep draining so writers never wait on a dead file
+        return;
+    }
+
+    if (request.sync)
+    {
+        flushBatch(true);
+        sync();
+
+        return;
+    }
+
+    // a seek (e.g. patching a header): write out what is pending first
+    if (!batch.isEmpty() && request.offset != batch_offset + batch.size())
+    {
+        flushBatch(true);
+    }
+
+    if (batch.isEmpty())
+    {
+        batch_offset = request.offset;
+    }
+
+    batch.append(request.data);
+
+    if (batch.size() >= batch_bytes)
+    {
+        flushBatch(false);
+    }
+}
+
+///
+/// \brief DiskWriter::flushBatch
+///
+/// \param all
+///
+/// Also the part past the last block boundary
+///
+/// \return
+///
+bool DiskWriter::flushBatch(bool all)
+{
+    qint64 length = batch.size();
+
+    if (!all)
+    {
+        length = ((batch_offset + batch.size()) & ~(BlockBytes - 1)) - batch_offset;
+    }
+
+    if (length <= 0)
+    {
+        return true;
+    }
+
+    preallocate(batch_offset + length);
+
+    bool ok = writeAt(batch_offset, batch.constData(), length);
+
+    batch.remove(0, static_cast<int>(length));
+    batch_offset += length;
+    unsynced = true;
+
+    if (!ok)
+    {
+        write_failed.storeRelease(1);
+
+#ifdef QT_DEBUG
+        qDebug() << "DiskWriter: write failed at" << batch_offset - length;
+#endif
+    }
+
+    return ok;
+}
+
+///
+/// \brief DiskWriter::writeAt
+/// \param offset
+/// \param data
+/// \param size
+/// \return
+///
+bool DiskWriter::writeAt(qint64 offset, const char *data, qint64 size)
+{
+    auto started = std::chrono::steady_clock::now();
+
+    while (size > 0)
+    {
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written = 0;
+
+        if (!WriteFile(file_handle, data, static_cast<DWORD>(qMin<qint64>(size, 1 << 30)), &written, &position))
+        {
+            return false;
+        }
+#else
+        ssize_t written = ::pwrite(file_handle, data, static_cast<size_t>(size), offset);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+#endif
+
+        data += written;
+        offset += written;
+        size -= written;
+    }
+
+    write_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+
+    return true;
+}
+
+///
+/// \brief DiskWriter::preallocate
+///
+/// Reserve the next chunk once the write position reaches the reserved end;
+/// turned off for the file if the filesystem does not support it
+///
+/// \param end
+///
+void DiskWriter::preallocate(qint64 end)
+{
+    if (!preallocating || end <= allocated_end)
+    {
+        return;
+    }
+
+    qint64 target = (end / preallocate_bytes + 1) * preallocate_bytes;
+    bool ok = false;
+
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = target;
+
+    ok = SetFileInformationByHandle(file_handle, FileAllocationInfo, &info, sizeof(info)) != 0;
+#elif defined(__linux__)
+    // reserve without changing the file size
+    ok = ::fallocate(file_handle, FALLOC_FL_KEEP_SIZE, allocated_end, target - allocated_end) == 0;
+#elif defined(__APPLE__)
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, target - allocated_end, 0 };
+
+    ok = ::fcntl(file_handle, F_PREALLOCATE, &store) != -1;
+
+    if (!ok)
+    {
+        // no contiguous run free: any extents will do
+        store.fst_flags = F_ALLOCATEALL;
+        ok = ::fcntl(file_handle, F_PREALLOCATE, &store) != -1;
+    }
+#endif
+
+    if (!ok)
+    {
+#ifdef QT_DEBUG
+        qDebug() << "DiskWriter: preallocation unavailable, disabled for this file";
+#endif
+
+        preallocating = false;
+        return;
+    }
+
+    allocated_end = target;
+}
+
+///
+/// \brief DiskWriter::sync
+///
+/// Data (not necessarily metadata) to stable storage
+///
+void DiskWriter::sync()
+{
+    if (!unsynced)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    FlushFileBuffers(file_handle);
+#elif defined(__APPLE__)
+    // fsync alone leaves data in the drive cache on macOS
+    if (::fcntl(file_handle, F_FULLFSYNC) == -1)
+    {
+        ::fsync(file_handle);
+    }
+#elif defined(__linux__)
+    ::fdatasync(file_handle);
+#else
+    ::fsync(file_handle);
+#endif
+
+    unsynced = false;
+}
@@ -0,0 +1,162 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef DISKWRITER_H
+#define DISKWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QAtomicInt>
+
+#include "latencyhistogram.h"
+
+///
+/// \brief The FsyncPolicy enum
+///
+/// How much written data a crash or power loss can take
+///
+enum FsyncPolicy
+{
+    // only when the file is closed
+    FsyncOnClose,
+
+    // at every sync point (each finished MP4 fragment)
+    FsyncOnFragment,
+
+    // at most every fsync interval
+    FsyncInterval
+};
+
+///
+/// \brief The DiskWriter class
+///
+/// Owns one output file on a dedicated I/O thread. Writers hand over
+/// positioned byte ranges through a queue bounded in bytes and only block
+/// when it is full; the thread coalesces contiguous ranges and writes them
+/// in large batches ending on block boundaries, preallocates the file in
+/// chunks ahead of the write position so it does not fragment, and syncs
+/// it to disk according to the FsyncPolicy.
+///
+/// Write latency and queue depth are kept for the statistics display.
+///
+class DiskWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    DiskWriter();
+    ~DiskWriter();
+
+    void configure(int queueMB, int batchKB, int preallocateMB, FsyncPolicy policy, int fsyncIntervalMs);
+
+    bool open(const QString &path);
+    bool close();
+
+    bool isOpen() const { return file_handle != InvalidHandle; }
+    bool failed() const { return write_failed.loadAcquire() != 0; }
+
+    // blocks while the queue is full
+    bool write(qint64 offset, const char *data, int size);
+
+    // end of a self-contained unit (fragment)
+    void syncPoint();
+
+    // highest offset written so far, queued or not
+    qint64 size() const { return end_offset; }
+
+    // bytes accepted over every file so far; never reset, safe from any thread
+    qint64 totalBytes() const { return total_bytes.loadAcquire(); }
+
+    qint64 queuedBytes() const { return queued_bytes.loadAcquire(); }
+    qint64 peakQueuedBytes() const { return peak_queued_bytes.loadAcquire(); }
+
+    const LatencyHistogram& latency() const { return write_latency; }
+
+protected:
+    void run();
+
+private:
+    struct Request
+    {
+        qint64 offset;
+        QByteArray data;
+        bool sync;
+    };
+
+#ifdef _WIN32
+    typedef void* Handle;
+#else
+    typedef int Handle;
+#endif
+    static const Handle InvalidHandle;
+
+    void process(Request &request);
+    bool flushBatch(bool all);
+    bool writeAt(qint64 offset, const char *data, qint64 size);
+    void preallocate(qint64 end);
+    void sync();
+
+    QMutex mutex;
+    QWaitCondition has_requests;
+    QWaitCondition has_room;
+
+    QList<Request> requests;
+    bool closing = false;
+
+    QAtomicInt queued_bytes;
+    QAtomicInt peak_queued_bytes;
+    QAtomicInt write_failed;
+    QAtomicInteger<qint64> total_bytes;
+
+    qint64 queue_limit = 64 << 20;
+    int batch_bytes = 1 << 20;
+    qint64 preallocate_bytes = 64 << 20;
+    FsyncPolicy fsync_policy = FsyncOnFragment;
+    int fsync_interval_ms = 2000;
+
+    Handle file_handle;
+
+    // writer side
+    qint64 end_offset = 0;
+
+    // I/O thread side: contiguous data not yet written, starting at batch_offset
+    QByteArray batch;
+    qint64 batch_offset = 0;
+    qint64 allocated_end = 0;
+    bool unsynced = false;
+
+    // cleared for the rest of the file if the filesystem cannot preallocate
+    bool preallocating = false;
+
+    LatencyHistogram write_latency;
+};
+
+#endif // DISKWRITER_H
@@ -35,4 +35,22 @@ enum AspectRatio
     ExtraWidescreen
 };
 
+enum DropPolicy
+{
+    NeverDrop,
+    DropNewest,
+    LatestWins
+};
+
+enum LatencyStage
+{
+    LatencyGrab,
+    LatencyOverlay,
+    LatencyEncode,
+    LatencyPreview,
+    LatencyPacing,
+    LatencyDisk,
+    LatencyStageCount
+};
+
 #endif // ENUMS_H
@@ -0,0 +1,511 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "fileshipper.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QSettings>
+#include <QStorageInfo>
+#include <QThread>
+#include <QTimer>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+namespace
+{
+    const qint64 ChunkBytes = 1024 * 1024;
+
+    // first retry after 5 s, doubling up to 5 min
+    const int RetryBaseMs = 5000;
+    const int RetryMaxMs = 300000;
+}
+
+///
+/// \brief ShipWorker::ShipWorker
+/// \param parent
+///
+ShipWorker::ShipWorker(QObject *parent) : QObject(parent), aborting(0)
+{
+
+}
+
+///
+/// \brief ShipWorker::ship
+/// \param id
+/// \param source
+/// \param destination
+/// \param bytesPerSecond
+///
+/// 0 = unlimited
+///
+void ShipWorker::ship(int id, const QString &source, const QString &destination, qint64 bytesPerSecond)
+{
+    QString checksum;
+    QString error;
+
+    bool ok = copy(source, destination, bytesPerSecond, id, checksum, error);
+
+    emit finished(id, ok, ok ? QFileInfo(destination).size() : 0, checksum, error);
+}
+
+///
+/// \brief ShipWorker::copy
+/// \return
+///
+bool ShipWorker::copy(const QString &source, const QString &destination, qint64 bytesPerSecond,
+                      int id, QString &checksum, QString &error)
+{
+    QFile src(source);
+
+    if (!src.open(QIODevice::ReadOnly))
+    {
+        error = tr("Cannot read %1").arg(source);
+        return false;
+    }
+
+    const qint64 total = src.size();
+
+    if (!QDir().mkpath(QFileInfo(destination).absolutePath()))
+    {
+        error = tr("Cannot create %1").arg(QFileInfo(destination).absolutePath());
+        return false;
+    }
+
+    // same volume: nothing to copy
+    if (QStorageInfo(source).rootPath() == QStorageInfo(QFileInfo(destination).absolutePath()).rootPath())
+    {
+        src.close();
+
+        checksum = hashFile(source, aborting);
+
+        if (checksum.isEmpty())
+        {
+            error = tr("Interrupted");
+            return false;
+        }
+
+        QFile::remove(destination);
+
+        if (!QFile::rename(source, destination))
+        {
+            error = tr("Cannot move %1 to %2").arg(source).arg(destination);
+            return false;
+        }
+
+        return true;
+    }
+
+    QFile part(destination + ".part");
+
+    if (!part.open(QIODevice::ReadWrite))
+    {
+        error = part.errorString();
+        return false;
+    }
+
+    // resume: whatever already arrived is kept, and covered by the final check
+    qint64 offset = part.size();
+
+    if (offset > total)
+    {
+        part.resize(0);
+        offset = 0;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray chunk;
+
+    for (qint64 hashed = 0; hashed < offset; )
+    {
+        chunk = src.read(qMin(ChunkBytes, offset - hashed));
+
+        if (chunk.isEmpty())
+        {
+            error = src.errorString();
+            return false;
+        }
+
+        hash.addData(chunk);
+        hashed += chunk.size();
+    }
+
+    part.seek(offset);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 sent = 0;
+    int lastPercent = -1;
+
+    while (offset < total)
+    {
+        if (aborting.loadAcquire())
+        {
+            error = tr("Interrupted");
+            return false;
+        }
+
+        chunk = src.read(qMin(ChunkBytes, total - offset));
+
+        if (chunk.isEmpty())
+        {
+            error = src.errorString();
+            return false;
+        }
+
+        if (part.write(chunk) != chunk.size())
+        {
+            error = part.errorString();
+            return false;
+        }
+
+        hash.addData(chunk);
+        offset += chunk.size();
+        sent += chunk.size();
+
+        int percent = total > 0 ? static_cast<int>(offset * 100 / total) : 100;
+
+        if (percent != lastPercent)
+        {
+            lastPercent = percent;
+            emit progress(id, percent);
+        }
+
+        // hold the average rate since this attempt started to the limit
+        if (bytesPerSecond > 0)
+        {
+            qint64 dueMs = sent * 1000 / bytesPerSecond;
+            qint64 aheadMs = dueMs - timer.elapsed();
+
+            if (aheadMs > 0)
+            {
+                QThread::msleep(static_cast<unsigned long>(aheadMs));
+            }
+        }
+    }
+
+    if (!part.flush())
+    {
+        error = part.errorString();
+        return false;
+    }
+
+    part.close();
+
+    checksum = QString::fromLatin1(hash.result().toHex());
+
+    // read back what actually landed on the share
+    QString arrived = hashFile(part.fileName(), aborting);
+
+    if (arrived != checksum)
+    {
+        if (!aborting.loadAcquire())
+        {
+            // corrupt: start over next time
+            QFile::remove(part.fileName());
+            error = tr("Checksum mismatch for %1").arg(destination);
+        }
+        else
+        {
+            error = tr("Interrupted");
+        }
+
+        return false;
+    }
+
+    QFile::remove(destination);
+
+    if (!QFile::rename(part.fileName(), destination))
+    {
+        error = tr("Cannot rename %1").arg(part.fileName());
+        return false;
+    }
+
+    src.close();
+    QFile::remove(source);
+
+    return true;
+}
+
+///
+/// \brief ShipWorker::hashFile
+/// \param path
+/// \param aborting
+/// \return
+///
+/// SHA-256 in hex; empty if unreadable or interrupted
+///
+QString ShipWorker::hashFile(const QString &path, const QAtomicInt &aborting)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    while (!file.atEnd())
+    {
+        if (aborting.loadAcquire())
+        {
+            return QString();
+        }
+
+        QByteArray chunk = file.read(ChunkBytes);
+
+        if (chunk.isEmpty())
+        {
+            return QString();
+        }
+
+        hash.addData(chunk);
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+///
+/// \brief FileShipper::FileShipper
+///
+/// Picks up deliveries left over from a previous run
+///
+/// \param parent
+///
+FileShipper::FileShipper(QObject *parent) : QObject(parent)
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("AvRecorder"));
+
+    bytes_per_second = settings.value(QLatin1String("shipKBps"), 0).toLongLong() * 1024;
+    max_attempts = settings.value(QLatin1String("shipMaxAttempts"), 0).toInt();
+
+    settings.endGroup();
+
+    load();
+
+    worker_thread = new QThread(this);
+    worker = new ShipWorker;
+    worker->moveToThread(worker_thread);
+    connect(worker_thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(worker, SIGNAL(progress(int,int)), this, SIGNAL(jobProgress(int,int)));
+    connect(worker, SIGNAL(finished(int,bool,qint64,QString,QString)),
+            this, SLOT(workerFinished(int,bool,qint64,QString,QString)));
+    worker_thread->start(QThread::LowPriority);
+
+    retry_timer = new QTimer(this);
+    retry_timer->setSingleShot(true);
+    connect(retry_timer, SIGNAL(timeout()), this, SLOT(startNext()));
+
+    // once the owner has connected to our signals
+    QTimer::singleShot(0, this, SLOT(startNext()));
+}
+
+///
+/// \brief FileShipper::~FileShipper
+///
+/// An interrupted copy resumes from its .part file next time
+///
+FileShipper::~FileShipper()
+{
+    worker->abort();
+
+    worker_thread->quit();
+    worker_thread->wait();
+}
+
+///
+/// \brief FileShipper::enqueue
+/// \param source
+/// \param destination
+/// \return
+///
+/// Job id, as reported by jobProgress
+///
+int FileShipper::enqueue(const QString &source, const QString &destination)
+{
+    ShipJob job;
+    job.id = next_id++;
+    job.source = source;
+    job.destination = destination;
+
+    queued.append(job);
+
+    save();
+
+    emit queueChanged(pending());
+
+    startNext();
+
+    return job.id;
+}
+
+///
+/// \brief FileShipper::startNext
+///
+void FileShipper::startNext()
+{
+    if (active.id || queued.isEmpty() || retry_timer->isActive())
+    {
+        return;
+    }
+
+    active = queued.takeFirst();
+
+#ifdef QT_DEBUG
+    qDebug() << "FileShipper: shipping" << active.source << "to" << active.destination
+             << "attempt" << active.attempts + 1;
+#endif
+
+    QMetaObject::invokeMethod(worker, "ship", Qt::QueuedConnection,
+                              Q_ARG(int, active.id),
+                              Q_ARG(QString, active.source),
+                              Q_ARG(QString, active.destination),
+                              Q_ARG(qint64, bytes_per_second));
+}
+
+///
+/// \brief FileShipper::workerFinished
+/// \param id
+/// \param ok
+/// \param size
+/// \param checksum
+/// \param error
+///
+void FileShipper::workerFinished(int id, bool ok, qint64 size, const QString &checksum, const QString &error)
+{
+    if (id != active.id)
+    {
+        return;
+    }
+
+    ShipJob job = active;
+    active = ShipJob();
+
+    if (ok)
+    {
+        emit delivered(job.destination, size, checksum);
+    }
+    else
+    {
+        job.attempts++;
+
+#ifdef QT_DEBUG
+        qDebug() << "FileShipper: attempt" << job.attempts << "failed:" << error;
+#endif
+
+        emit deliveryFailed(job.destination, error, job.attempts);
+
+        // the local file stays where it is either way
+        if (max_attempts <= 0 || job.attempts < max_attempts)
+        {
+            queued.append(job);
+
+            // the share is likely down for everything queued: back off
+            retry_timer->start(qMin(RetryMaxMs, RetryBaseMs << qMin(job.attempts - 1, 6)));
+        }
+    }
+
+    save();
+
+    emit queueChanged(pending());
+
+    startNext();
+}
+
+///
+/// \brief FileShipper::load
+///
+void FileShipper::load()
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("FileShipper"));
+
+    int count = settings.beginReadArray(QLatin1String("jobs"));
+
+    for (int i = 0; i < count; ++i)
+    {
+        settings.setArrayIndex(i);
+
+        ShipJob job;
+        job.id = next_id++;
+        job.source = settings.value(QLatin1String("source")).toString();
+        job.destination = settings.value(QLatin1String("destination")).toString();
+        job.attempts = settings.value(QLatin1String("attempts")).toInt();
+
+        // already delivered (or removed by hand): nothing to redo
+        if (QFile::exists(job.source))
+        {
+            queued.append(job);
+        }
+    }
+
+    settings.endArray();
+    settings.endGroup();
+}
+
+///
+/// \brief FileShipper::save
+///
+/// Persist the active and queued deliveries, active first
+///
+void FileShipper::save()
+{
+    QList<ShipJob> jobs = queued;
+
+    if (active.id)
+    {
+        jobs.prepend(active);
+    }
+
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("FileShipper"));
+
+    settings.remove(QLatin1String("jobs"));
+    settings.beginWriteArray(QLatin1String("jobs"), jobs.count());
+
+    for (int i = 0; i < jobs.count(); ++i)
+    {
+        settings.setArrayIndex(i);
+
+        settings.setValue(QLatin1String("source"), jobs.at(i).source);
+        settings.setValue(QLatin1String("destination"), jobs.at(i).destination);
+        settings.setValue(QLatin1String("attempts"), jobs.at(i).attempts);
+    }
+
+    settings.endArray();
+    settings.endGroup();
+    settings.sync();
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef FILESHIPPER_H
+#define FILESHIPPER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+
+class QThread;
+class QTimer;
+
+///
+/// \brief The ShipJob struct
+///
+/// One finished file, to be moved from local disk to the output directory
+///
+struct ShipJob
+{
+    int id = 0;
+
+    QString source;
+    QString destination;
+
+    int attempts = 0;
+};
+
+///
+/// \brief The ShipWorker class
+///
+/// Copies one file at a time on its own thread: in chunks, into
+/// <destination>.part so an interrupted copy resumes where it stopped,
+/// throttled to a byte rate, and read back and checksummed before the
+/// .part file is renamed into place. Same-volume moves are just renamed.
+///
+class ShipWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ShipWorker(QObject *parent = 0);
+
+    void abort() { aborting.storeRelease(1); }
+
+signals:
+    void progress(int id, int percent);
+    void finished(int id, bool ok, qint64 size, const QString &checksum, const QString &error);
+
+public slots:
+    void ship(int id, const QString &source, const QString &destination, qint64 bytesPerSecond);
+
+private:
+    bool copy(const QString &source, const QString &destination, qint64 bytesPerSecond,
+              int id, QString &checksum, QString &error);
+
+    static QString hashFile(const QString &path, const QAtomicInt &aborting);
+
+    QAtomicInt aborting;
+};
+
+///
+/// \brief The FileShipper class
+///
+/// Persistent delivery queue in front of the (often network) output
+/// directory. Recording only ever writes to local disk; files are shipped
+/// afterwards, one at a time, and retried with backoff until they arrive.
+/// The local copy is removed once the delivered one has been verified.
+///
+class FileShipper : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileShipper(QObject *parent = 0);
+    ~FileShipper();
+
+    int enqueue(const QString &source, const QString &destination);
+
+    int pending() const { return queued.count() + (active.id ? 1 : 0); }
+
+signals:
+    void jobProgress(int id, int percent);
+    void delivered(const QString &destination, qint64 size, const QString &checksum);
+    void deliveryFailed(const QString &destination, const QString &error, int attempts);
+    void queueChanged(int pending);
+
+private slots:
+    void startNext();
+    void workerFinished(int id, bool ok, qint64 size, const QString &checksum, const QString &error);
+
+private:
+    void load();
+    void save();
+
+    QList<ShipJob> queued;
+    ShipJob active;
+
+    int next_id = 1;
+
+    // 0 = unlimited
+    qint64 bytes_per_second = 0;
+    int max_attempts = 0;
+
+    QThread *worker_thread;
+    ShipWorker *worker;
+    QTimer *retry_timer;
+};
+
+#endif // FILESHIPPER_H
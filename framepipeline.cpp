@@ -0,0 +1,1168 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <string>
+
+#include "framepipeline.h"
+
+using namespace cv;
+
+namespace
+{
+    // PCM waiting for the encode thread; about 20 s of 48 kHz stereo float
+    const int AudioQueueBytes = 8 << 20;
+}
+
+///
+/// \brief PreviewMailbox::post
+///
+/// Replace whatever the GUI has not picked up yet
+///
+/// \param img
+///
+void PreviewMailbox::post(const QImage &img)
+{
+    QMutexLocker locker(&mutex);
+
+    image = img;
+    sequence++;
+}
+
+///
+/// \brief PreviewMailbox::take
+///
+/// \param img
+/// \param lastSeen
+///
+/// Sequence of the last image the caller took; updated on success
+///
+/// \return
+///
+/// true if there is an image newer than lastSeen
+///
+bool PreviewMailbox::take(QImage &img, quint64 &lastSeen)
+{
+    QMutexLocker locker(&mutex);
+
+    if (sequence == lastSeen)
+    {
+        return false;
+    }
+
+    img = image;
+    lastSeen = sequence;
+
+    // hand over our reference so the preview stage can reuse the buffer sooner
+    image = QImage();
+
+    return true;
+}
+
+///
+/// \brief FrameStage::FrameStage
+///
+/// \param capacity
+///
+/// Number of pre-allocated slots in the input ring
+///
+/// \param policy
+///
+/// What to do when the ring is full
+///
+FrameStage::FrameStage(int capacity, DropPolicy policy) : input(capacity, policy)
+{
+
+}
+
+///
+/// \brief FrameStage::configure
+///
+/// Resize the input ring; only valid while the stage is stopped
+///
+/// \param capacity
+/// \param policy
+///
+void FrameStage::configure(int capacity, DropPolicy policy)
+{
+    if (isRunning())
+    {
+        return;
+    }
+
+    input.reset(capacity, policy);
+}
+
+///
+/// \brief FrameStage::submit
+///
+/// Producer side, called from the upstream stage
+///
+/// \param item
+/// \return
+///
+bool FrameStage::submit(const FrameItem &item)
+{
+    return input.push(item);
+}
+
+///
+/// \brief FrameStage::stopStage
+///
+/// Close the input, let the stage drain what is queued, then join
+///
+void FrameStage::stopStage()
+{
+    input.close();
+
+    if (isRunning())
+    {
+        wait();
+    }
+}
+
+///
+/// \brief FrameStage::run
+///
+/// Stage loop
+///
+void FrameStage::run()
+{
+    FrameItem item;
+    QElapsedTimer timer;
+
+    for (;;)
+    {
+        bool got = (input.policy() == LatestWins) ? input.popLatest(item, 50) :
+                                                    input.pop(item, 50);
+
+        if (got)
+        {
+            timer.start();
+
+            if (processFrame(item))
+            {
+                processing.record(timer.nsecsElapsed() / 1000);
+            }
+
+            // drop our reference so the buffer can be reused upstream
+            item.frame.release();
+            item.buffer.release();
+        }
+        else if (input.isClosed())
+        {
+            break;
+        }
+        else
+        {
+            idle();
+        }
+    }
+
+    drained();
+}
+
+///
+/// \brief EncodeStage::EncodeStage
+///
+EncodeStage::EncodeStage() : FrameStage(16, NeverDrop), active_muxer(0), accepting(0)
+{
+    qRegisterMetaType<VideoTiming>("VideoTiming");
+
+    connect(&segment_finalizer, SIGNAL(finalized(QString)), this, SIGNAL(muxedFileClosed(QString)));
+}
+
+///
+/// \brief EncodeStage::setFragmentSeconds
+/// \param seconds
+///
+void EncodeStage::setFragmentSeconds(int seconds)
+{
+    muxers[0].setFragmentSeconds(seconds);
+    muxers[1].setFragmentSeconds(seconds);
+}
+
+///
+/// \brief EncodeStage::configureDiskWriter
+/// \param queueMB
+/// \param batchKB
+/// \param preallocateMB
+/// \param policy
+/// \param fsyncIntervalMs
+///
+void EncodeStage::configureDiskWriter(int queueMB, int batchKB, int preallocateMB, FsyncPolicy policy, int fsyncIntervalMs)
+{
+    muxers[0].diskWriter().configure(queueMB, batchKB, preallocateMB, policy, fsyncIntervalMs);
+    muxers[1].diskWriter().configure(queueMB, batchKB, preallocateMB, policy, fsyncIntervalMs);
+}
+
+///
+/// \brief EncodeStage::bytesWritten
+/// \return
+///
+qint64 EncodeStage::bytesWritten() const
+{
+    return muxers[0].diskWriter().totalBytes() + muxers[1].diskWriter().totalBytes() - bytes_base;
+}
+
+///
+/// \brief EncodeStage::open
+///
+/// Open the writer; frames are accepted from here on. The previous file
+/// must have been closed (writerClosed) first.
+///
+/// \param path
+/// \param fourcc
+/// \param fps
+/// \param size
+/// \return
+///
+bool EncodeStage::open(const QString &path, int fourcc, double fps, Size size)
+{
+    QMutexLocker locker(&writer_mutex);
+
+    if (video.isOpened() || muxer().isOpen())
+    {
+        return false;
+    }
+
+    video.open(path.toStdString(), fourcc, fps, size, true);
+    video_path = path;
+    video_timing = VideoTiming();
+    video_timing.fps = fps;
+
+    // the temporary AVI is muxed against audio.wav, which has no pre-roll
+    preroll_buffer.clear();
+
+    accepting.storeRelease(video.isOpened() ? 1 : 0);
+
+    return video.isOpened();
+}
+
+///
+/// \brief EncodeStage::openMuxed
+///
+/// Encode and mux straight into the final file instead of a temporary AVI.
+/// The previous file must have been closed (writerClosed) first.
+///
+/// \param path
+/// \param fps
+/// \param size
+/// \param compress
+/// \return
+///
+bool EncodeStage::openMuxed(const QString &path, int fps, Size size, bool compress)
+{
+    QMutexLocker locker(&writer_mutex);
+
+    if (video.isOpened() || muxer().isOpen())
+    {
+        return false;
+    }
+
+    bytes_base = muxers[0].diskWriter().totalBytes() + muxers[1].diskWriter().totalBytes();
+
+    // anything left over belongs to no file
+    audio_mutex.lock();
+    audio_queue.clear();
+    audio_queued_bytes = 0;
+    audio_dropped = 0;
+    audio_mutex.unlock();
+
+    bool ok = muxer().open(path, size, fps, compress);
+    muxed_path = path;
+    muxed_size = size;
+    muxed_fps = fps;
+    muxed_compress = compress;
+    rollover_path.clear();
+
+    // before accepting is raised, so no live frame can overtake the backlog
+    if (ok)
+    {
+        preroll_buffer.startDraining();
+    }
+    else
+    {
+        preroll_buffer.clear();
+    }
+
+    accepting.storeRelease(ok ? 1 : 0);
+
+    return ok;
+}
+
+///
+/// \brief EncodeStage::rollOver
+///
+/// Carry on the in-process recording in path from the next frame; the
+/// current file is finalized off the stage thread, so no frame waits on it.
+/// Answered with segmentOpened, and muxedFileClosed once the old file is
+/// complete.
+///
+/// \param path
+///
+void EncodeStage::rollOver(const QString &path)
+{
+    QMutexLocker locker(&writer_mutex);
+
+    rollover_path = path;
+}
+
+///
+/// \brief EncodeStage::writeAudio
+///
+/// Called from the GUI thread with each captured audio buffer. The samples
+/// are copied onto a queue the stage thread encodes from, so a busy encoder
+/// or a full disk queue never holds up the caller.
+///
+/// \param arrivalUs
+///
+/// SessionClock time the buffer had all arrived by
+///
+/// \return
+///
+/// false if not recording, or the queue is full
+///
+bool EncodeStage::writeAudio(const void *data, int frames, int sampleRate, int channels, int bytesPerSample, bool isFloat, qint64 arrivalUs)
+{
+    if (!isAccepting() || frames <= 0)
+    {
+        return false;
+    }
+
+    AudioChunk chunk;
+    chunk.data = QByteArray(static_cast<const char*>(data), frames * channels * bytesPerSample);
+    chunk.frames = frames;
+    chunk.sample_rate = sampleRate;
+    chunk.channels = channels;
+    chunk.bytes_per_sample = bytesPerSample;
+    chunk.is_float = isFloat;
+    chunk.arrival_us = arrivalUs;
+
+    QMutexLocker locker(&audio_mutex);
+
+    if (audio_queued_bytes + chunk.data.size() > AudioQueueBytes)
+    {
+        audio_dropped++;
+
+        return false;
+    }
+
+    audio_queued_bytes += chunk.data.size();
+    audio_queue.append(chunk);
+
+    return true;
+}
+
+///
+/// \brief EncodeStage::writeQueuedAudio
+///
+/// Encode whatever audio has been queued; stage thread, writer_mutex held
+///
+void EncodeStage::writeQueuedAudio()
+{
+    QList<AudioChunk> chunks;
+
+    audio_mutex.lock();
+    chunks.swap(audio_queue);
+    audio_queued_bytes = 0;
+    audio_mutex.unlock();
+
+    for (int i = 0; i < chunks.count(); ++i)
+    {
+        const AudioChunk &chunk = chunks.at(i);
+
+        muxer().writeAudio(chunk.data.constData(),
+                         chunk.frames,
+                         chunk.sample_rate,
+                         chunk.channels,
+                         chunk.bytes_per_sample,
+                         chunk.is_float,
+                         chunk.arrival_us);
+    }
+}
+
+///
+/// \brief EncodeStage::finish
+///
+/// Stop accepting frames; the writer is released on the stage thread once
+/// everything already queued has been written, then writerClosed is emitted
+///
+void EncodeStage::finish()
+{
+    accepting.storeRelease(0);
+}
+
+///
+/// \brief EncodeStage::isOpen
+/// \return
+///
+bool EncodeStage::isOpen()
+{
+    QMutexLocker locker(&writer_mutex);
+
+    return video.isOpened() || muxer().isOpen();
+}
+
+///
+/// \brief EncodeStage::processFrame
+/// \param item
+///
+bool EncodeStage::processFrame(FrameItem &item)
+{
+    QMutexLocker locker(&writer_mutex);
+
+    if (muxer().isOpen())
+    {
+        // not while the pre-roll is still going into the current file
+        bool rolling = !rollover_path.isEmpty() && !preroll_buffer.isDraining();
+
+        if (rolling)
+        {
+            nextSegment();
+        }
+
+        bool ok = muxer().writeVideo(item.frame, item.capture_us);
+
+        writeQueuedAudio();
+
+        if (rolling)
+        {
+            QString opened = muxed_path;
+
+            locker.unlock();
+
+            emit segmentOpened(opened);
+        }
+
+        return ok;
+    }
+
+    if (!video.isOpened())
+    {
+        return false;
+    }
+
+    video << item.frame;
+
+    if (video_timing.frames++ == 0)
+    {
+        video_timing.firstUs = item.capture_us;
+    }
+
+    video_timing.lastUs = item.capture_us;
+
+    return true;
+}
+
+///
+/// \brief EncodeStage::nextSegment
+///
+/// Open rollover_path in the spare muxer and switch to it; the old file is
+/// finalized by segment_finalizer, which reports it with muxedFileClosed.
+/// If rollover_path cannot be opened, recording continues under the same
+/// name next to the old file, and failing that in the old file itself.
+/// Called with writer_mutex held.
+///
+void EncodeStage::nextSegment()
+{
+    QString path = rollover_path;
+
+    rollover_path.clear();
+
+    // still finishing the segment before last; segments are minutes apart
+    segment_finalizer.wait();
+
+    int next = 1 - active_muxer.loadAcquire();
+
+    if (!muxers[next].open(path, muxed_size, muxed_fps, muxed_compress))
+    {
+        path = QFileInfo(muxed_path).dir().filePath(QFileInfo(path).fileName());
+
+        if (!muxers[next].open(path, muxed_size, muxed_fps, muxed_compress))
+        {
+#ifdef QT_DEBUG
+            qDebug() << "EncodeStage: no new segment, continuing in" << muxed_path;
+#endif
+
+            return;
+        }
+    }
+
+    QString closed = muxed_path;
+    MediaMuxer *previous = &muxer();
+
+    active_muxer.storeRelease(next);
+    muxed_path = path;
+
+    segment_finalizer.finalize(previous, closed);
+
+#ifdef QT_DEBUG
+    qDebug() << "EncodeStage: segment" << closed << "->" << path;
+#endif
+}
+
+///
+/// \brief EncodeStage::videoTiming
+///
+/// Of the last (or current) VideoWriter recording
+///
+/// \return
+///
+VideoTiming EncodeStage::videoTiming()
+{
+    QMutexLocker locker(&writer_mutex);
+
+    return video_timing;
+}
+
+///
+/// \brief EncodeStage::idle
+///
+/// Queue is empty: if recording has stopped, finalize the file
+///
+void EncodeStage::idle()
+{
+    // live frames are held in the pre-roll ring until it has been written
+    if (preroll_buffer.isDraining())
+    {
+        writePreroll();
+    }
+
+    QMutexLocker locker(&writer_mutex);
+
+    // still recording, or a new recording opened while we waited for the lock
+    if (isAccepting())
+    {
+        writeQueuedAudio();
+        return;
+    }
+
+    bool releasing = video.isOpened();
+    VideoTiming timing = video_timing;
+
+    if (releasing)
+    {
+#ifdef QT_DEBUG
+        qDebug() << "EncodeStage: releasing writer";
+#endif
+
+        video.release();
+    }
+
+    bool closing = muxer().isOpen();
+    QString path = muxed_path;
+
+    // queued before finish(), so it still belongs in this file
+    if (closing)
+    {
+        writeQueuedAudio();
+
+#ifdef QT_DEBUG
+        qDebug() << "EncodeStage: audio buffers dropped on a full queue:" << audio_dropped;
+#endif
+    }
+
+    // flush and write the trailer; the file is complete after this
+    muxer().close();
+
+    // and so is any segment rolled over from
+    segment_finalizer.wait();
+
+    if (!releasing && !closing)
+    {
+        return;
+    }
+
+    QString releasedPath = video_path;
+
+    locker.unlock();
+
+    if (releasing)
+    {
+        emit videoFileClosed(releasedPath, timing);
+    }
+
+    if (closing)
+    {
+        emit muxedFileClosed(path);
+    }
+
+    emit writerClosed();
+}
+
+///
+/// \brief EncodeStage::writePreroll
+///
+/// Decode and encode the pre-roll backlog, a few frames per lock so a new
+/// open() is never kept waiting long
+///
+void EncodeStage::writePreroll()
+{
+    std::vector<PrerollFrame> chunk;
+
+    for (;;)
+    {
+        QMutexLocker locker(&writer_mutex);
+
+        if (!preroll_buffer.takeChunk(chunk, 8))
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < chunk.size(); i++)
+        {
+            Mat frame = imdecode(chunk[i].data, cv::IMREAD_COLOR);
+
+            if (frame.empty())
+            {
+                continue;
+            }
+
+            muxer().writeVideo(frame, chunk[i].capture_us);
+        }
+
+        writeQueuedAudio();
+    }
+
+#ifdef QT_DEBUG
+    qDebug() << "EncodeStage: pre-roll written;" << preroll_buffer.droppedFrames() << "frames could not be compressed";
+#endif
+}
+
+///
+/// \brief EncodeStage::drained
+///
+void EncodeStage::drained()
+{
+    accepting.storeRelease(0);
+
+    idle();
+}
+
+///
+/// \brief SegmentFinalizer::finalize
+///
+/// Close muxer on this thread and report path once done. Only one file is
+/// finalized at a time; the caller waits for the previous one first.
+///
+/// \param muxer
+/// \param path
+///
+void SegmentFinalizer::finalize(MediaMuxer *muxer, const QString &path)
+{
+    wait();
+
+    closing_muxer = muxer;
+    closing_path = path;
+
+    start();
+}
+
+///
+/// \brief SegmentFinalizer::run
+///
+void SegmentFinalizer::run()
+{
+    closing_muxer->close();
+
+    emit finalized(closing_path);
+}
+
+///
+/// \brief PreviewStage::PreviewStage
+///
+PreviewStage::PreviewStage() :
+    FrameStage(2, LatestWins),
+    target_width(0),
+    target_height(0),
+    preview_enabled(1),
+    preview_interval(100),
+    image_misses(0)
+{
+
+}
+
+///
+/// \brief PreviewStage::setPreviewRate
+///
+/// Preview rate is independent of the recording rate
+///
+/// \param fps
+///
+void PreviewStage::setPreviewRate(int fps)
+{
+    preview_interval.storeRelease(fps > 0 ? 1000 / fps : 0);
+}
+
+///
+/// \brief PreviewStage::setTargetSize
+///
+/// Viewfinder geometry; frames are scaled to fit inside it
+///
+/// \param width
+/// \param height
+///
+void PreviewStage::setTargetSize(int width, int height)
+{
+    target_width.storeRelease(width);
+    target_height.storeRelease(height);
+}
+
+///
+/// \brief PreviewStage::processFrame
+///
+/// Scale to the viewfinder and convert for display
+///
+/// \param item
+///
+bool PreviewStage::processFrame(FrameItem &item)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    // decimate to the preview rate, on capture time
+    if (item.timestamp - last_preview < preview_interval.loadAcquire())
+    {
+        return false;
+    }
+
+    last_preview = item.timestamp;
+
+    Size bounds(target_width.loadAcquire(), target_height.loadAcquire());
+
+    if (bounds.area() <= 0)
+    {
+        bounds = window_size;
+    }
+
+    Size fitted = PreviewScaler::fitInside(item.frame.size(), bounds);
+
+    if (fitted.area() <= 0)
+    {
+        return false;
+    }
+
+    // tables are only rebuilt when the camera or viewfinder size changes
+    scaler.configure(item.frame.size(), fitted);
+
+    QImage &qimg = nextImage(fitted.width, fitted.height);
+
+    scaler.scale(item.frame, qimg.bits(), qimg.bytesPerLine());
+
+    preview_mailbox.post(qimg);
+
+    return true;
+}
+
+///
+/// \brief PreviewStage::nextImage
+///
+/// Pick an image the GUI is no longer holding, so writing into it cannot
+/// trigger a detach. Only allocates on resize or when every image is busy.
+///
+/// \param width
+/// \param height
+/// \return
+///
+QImage& PreviewStage::nextImage(int width, int height)
+{
+    const int count = sizeof(images) / sizeof(images[0]);
+
+    for (int i = 0; i < count; ++i)
+    {
+        QImage &candidate = images[(next_image + i) % count];
+
+        if (candidate.width() == width && candidate.height() == height && candidate.isDetached())
+        {
+            next_image = (next_image + i + 1) % count;
+
+            return candidate;
+        }
+    }
+
+    QImage &slot = images[next_image];
+    next_image = (next_image + 1) % count;
+
+    if (!slot.isNull())
+    {
+        image_misses.fetchAndAddRelaxed(1);
+    }
+
+    slot = QImage(width, height, QImage::Format_RGB32);
+
+    return slot;
+}
+
+///
+/// \brief PreviewStage::Mat2QImage
+///
+/// Convert mat to QIMage for display
+///
+/// \param src
+/// \return
+///
+QImage PreviewStage::Mat2QImage(cv::Mat const& src)
+{
+     cv::Mat temp;
+
+     cvtColor(src, temp,CV_BGR2RGB);
+
+     QImage dest((const uchar *) temp.data,
+                 temp.cols,
+                 temp.rows,
+                 static_cast<int>(temp.step),
+                 QImage::Format_RGB888);
+
+     dest.bits(); // enforce deep copy, see documentation
+     return dest;
+}
+
+///
+/// \brief OverlayStage::OverlayStage
+/// \param encoder
+/// \param preview
+///
+OverlayStage::OverlayStage(EncodeStage *encoder, PreviewStage *preview) :
+    FrameStage(4, NeverDrop),
+    encode_stage(encoder),
+    preview_stage(preview),
+    sprite_dirty(1),
+    format_dirty(0)
+{
+
+}
+
+///
+/// \brief OverlayStage::setSessionConditions
+/// \param id
+/// \param session
+/// \param treatment
+/// \param condition
+///
+void OverlayStage::setSessionConditions(QString id, QString session, QString treatment, QString condition)
+{
+    QMutexLocker locker(&text_mutex);
+
+    if (winId == id && winSession == session && winTreatment == treatment && winCondition == condition)
+    {
+        return;
+    }
+
+    winId = id;
+    winSession = session;
+    winTreatment = treatment;
+    winCondition = condition;
+
+    sprite_dirty.storeRelease(1);
+}
+
+///
+/// \brief OverlayStage::setSessionCondition
+///
+/// \param index
+/// \param value
+///
+void OverlayStage::setSessionCondition(int index, QString value)
+{
+    QMutexLocker locker(&text_mutex);
+
+    QString *target = nullptr;
+
+    switch (index) {
+    case 0:
+        target = &winId;
+
+        break;
+    case 1:
+        target = &winSession;
+
+        break;
+    case 2:
+        target = &winTreatment;
+
+        break;
+    case 3:
+        target = &winCondition;
+
+        break;
+
+    default:
+        break;
+    }
+
+    if (target && *target != value)
+    {
+        *target = value;
+
+        sprite_dirty.storeRelease(1);
+    }
+}
+
+///
+/// \brief OverlayStage::setTimestampFormat
+///
+/// QDateTime format for the clock; a 'z' field gives millisecond stamps
+///
+/// \param format
+///
+void OverlayStage::setTimestampFormat(QString format)
+{
+    QMutexLocker locker(&text_mutex);
+
+    timestamp_format = format;
+
+    format_dirty.storeRelease(1);
+}
+
+///
+/// \brief OverlayStage::rebuildSprite
+///
+/// Render the session block (black box + four lines) into a BGR sprite and
+/// a mask covering the box and any text that runs past it
+///
+void OverlayStage::rebuildSprite()
+{
+    text_mutex.lock();
+
+    std::string lines[4] = {
+        QString("ID: %1").arg(winId).toStdString(),
+        QString("Session: %1").arg(winSession).toStdString(),
+        QString("Treatment: %1").arg(winTreatment).toStdString(),
+        QString("Condition: %1").arg(winCondition).toStdString()
+    };
+
+    text_mutex.unlock();
+
+    Point origins[4] = { topText1, topText2, topText3, topText4 };
+
+    int width = topRect2.x + 1;
+    int height = topRect2.y + 1;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        int baseline = 0;
+        Size extent = getTextSize(lines[i], fontStyle, fontScale, 1, &baseline);
+
+        width = std::max(width, origins[i].x + extent.width + 1);
+        height = std::max(height, origins[i].y + baseline + 1);
+    }
+
+    sprite.create(height, width, CV_8UC3);
+    sprite.setTo(Scalar::all(0));
+
+    sprite_mask.create(height, width, CV_8UC1);
+    sprite_mask.setTo(Scalar::all(0));
+
+    rectangle(sprite, topRect1, topRect2, blackColor, CV_FILLED);
+    rectangle(sprite_mask, topRect1, topRect2, Scalar::all(255), CV_FILLED);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        putText(sprite, lines[i], origins[i], fontStyle, fontScale, yellowColor);
+        putText(sprite_mask, lines[i], origins[i], fontStyle, fontScale, Scalar::all(255));
+    }
+}
+
+///
+/// \brief OverlayStage::setStaticSceneMode
+///
+/// Configure before the stage is started
+///
+/// \param skip
+///
+/// Drop near-static frames (only while the output is variable frame rate)
+///
+/// \param threshold
+///
+/// Mean absolute luma difference of the busiest block, 0..255
+///
+/// \param keepaliveMs
+///
+/// Longest gap between kept frames
+///
+void OverlayStage::setStaticSceneMode(bool skip, double threshold, int keepaliveMs)
+{
+    skip_static = skip;
+    keepalive_us = qint64(qMax(0, keepaliveMs)) * 1000;
+
+    static_detector.setThreshold(threshold);
+}
+
+///
+/// \brief OverlayStage::sceneStats
+/// \return
+///
+SceneStats OverlayStage::sceneStats() const
+{
+    SceneStats stats;
+    stats.frames = quint64(stats_frames.loadAcquire());
+    stats.staticFrames = quint64(stats_static.loadAcquire());
+    stats.skippedFrames = quint64(stats_skipped.loadAcquire());
+    stats.threshold = static_detector.getThreshold();
+
+    return stats;
+}
+
+///
+/// \brief OverlayStage::resetSceneStats
+///
+void OverlayStage::resetSceneStats()
+{
+    stats_frames.storeRelease(0);
+    stats_static.storeRelease(0);
+    stats_skipped.storeRelease(0);
+}
+
+///
+/// \brief OverlayStage::skipStaticFrame
+///
+/// Only frames for the file are skipped, and only while recording: the
+/// pre-roll ring and the preview get every frame. A constant frame rate
+/// writer (the VideoWriter fallback) needs every frame too, so it is
+/// measured but never skipped.
+///
+/// \param item
+/// \return
+///
+bool OverlayStage::skipStaticFrame(const FrameItem &item)
+{
+    if (!skip_static || !encode_stage->isAccepting())
+    {
+        return false;
+    }
+
+    bool isStatic = static_detector.isStatic(item.frame);
+
+    stats_frames.fetchAndAddRelaxed(1);
+
+    if (isStatic)
+    {
+        stats_static.fetchAndAddRelaxed(1);
+    }
+
+    if (isStatic &&
+            item.capture_us - last_kept_us < keepalive_us &&
+            encode_stage->isVariableFrameRate())
+    {
+        stats_skipped.fetchAndAddRelaxed(1);
+
+        return true;
+    }
+
+    last_kept_us = item.capture_us;
+
+    return false;
+}
+
+///
+/// \brief OverlayStage::drawOverlay
+///
+/// Session block and clock, drawn in place
+///
+/// \param frame
+/// \param msecsSinceEpoch
+///
+void OverlayStage::drawOverlay(Mat &frame, qint64 msecsSinceEpoch)
+{
+    if (sprite_dirty.fetchAndStoreOrdered(0))
+    {
+        rebuildSprite();
+    }
+
+    // masked copy of the cached session block, clipped to the frame
+    Rect area = Rect(0, 0, sprite.cols, sprite.rows) & Rect(0, 0, frame.cols, frame.rows);
+
+    if (area.area() > 0)
+    {
+        Mat target = frame(area);
+
+        sprite(area).copyTo(target, sprite_mask(area));
+    }
+
+    if (format_dirty.fetchAndStoreOrdered(0))
+    {
+        QMutexLocker locker(&text_mutex);
+
+        timestamp.setFormat(timestamp_format);
+    }
+
+    timestamp.render(frame, msecsSinceEpoch);
+}
+
+///
+/// \brief OverlayStage::processFrame
+///
+/// Draw annotations, then hand off to encode (when recording) and preview
+///
+/// \param item
+///
+bool OverlayStage::processFrame(FrameItem &item)
+{
+    Mat &frame = item.frame;
+
+    // left out of the file only; the preview still shows it
+    bool skipped = skipStaticFrame(item);
+
+    // stamped with capture time, not draw time
+    drawOverlay(frame, item.timestamp);
+
+    // Save frame to video (a full encode queue shows up in this stage's timing)
+    if (!skipped)
+    {
+        if (encode_stage->isAccepting())
+        {
+            // queue behind the pre-roll backlog until the encoder has caught up
+            if (!encode_stage->preroll().pushIfDraining(frame, item.capture_us, item.timestamp))
+            {
+                encode_stage->submit(item);
+            }
+        }
+        else
+        {
+            encode_stage->preroll().push(frame, item.capture_us, item.timestamp);
+        }
+    }
+
+    if (preview_stage->isEnabled())
+    {
+        preview_stage->submit(item);
+    }
+
+    return true;
+}
@@ -0,0 +1,448 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <QThread>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "framepool.h"
+#include "mediamuxer.h"
+#include "prerollbuffer.h"
+#include "latencyhistogram.h"
+#include "previewscaler.h"
+#include "spscring.h"
+#include "staticscenedetector.h"
+#include "timestamprenderer.h"
+#include "enums.h"
+
+///
+/// \brief The FrameItem struct
+///
+/// Unit of work passed between stages. frame is a header over the pooled
+/// buffer held by buffer, so fanning out to several stages copies neither
+/// pixels nor allocations; the buffer is recycled once every stage is done.
+///
+struct FrameItem
+{
+    FrameRef buffer;
+    cv::Mat frame;
+
+    // capture time, ms since epoch
+    qint64 timestamp = 0;
+
+    // capture time on the shared SessionClock, microseconds;
+    // comparable across cameras
+    qint64 capture_us = 0;
+
+    quint64 index = 0;
+};
+
+///
+/// \brief The SceneStats struct
+///
+/// Static-scene detection results for the current session
+///
+struct SceneStats
+{
+    quint64 frames = 0;
+    quint64 staticFrames = 0;
+    quint64 skippedFrames = 0;
+
+    double threshold = 0.0;
+};
+
+///
+/// \brief The VideoTiming struct
+///
+/// Capture times (SessionClock) of the frames written to the temporary
+/// file, which itself is constant frame rate
+///
+struct VideoTiming
+{
+    qint64 firstUs = -1;
+    qint64 lastUs = -1;
+    qint64 frames = 0;
+
+    double fps = 0.0;
+};
+
+Q_DECLARE_METATYPE(VideoTiming)
+
+///
+/// \brief The PreviewMailbox class
+///
+/// Single-slot, latest-wins handoff of preview images to the GUI. The GUI
+/// pulls on its own timer, so a stalled event loop never queues images.
+///
+class PreviewMailbox
+{
+public:
+    PreviewMailbox() : sequence(0) {}
+
+    void post(const QImage &img);
+    bool take(QImage &img, quint64 &lastSeen);
+
+private:
+    QMutex mutex;
+    QImage image;
+    quint64 sequence;
+};
+
+///
+/// \brief The FrameStage class
+///
+/// One pipeline stage: a thread draining its own bounded input ring
+///
+class FrameStage : public QThread
+{
+    Q_OBJECT
+
+public:
+    FrameStage(int capacity, DropPolicy policy);
+
+    void configure(int capacity, DropPolicy policy);
+
+    bool submit(const FrameItem &item);
+    void stopStage();
+
+    int queued() const { return input.count(); }
+    int capacity() const { return input.capacity(); }
+    quint64 droppedFrames() const { return input.droppedCount(); }
+
+    const LatencyHistogram& latency() const { return processing; }
+
+protected:
+    void run();
+
+    // false if the frame was skipped (not timed)
+    virtual bool processFrame(FrameItem &item) = 0;
+    virtual void idle() {}
+    virtual void drained() {}
+
+private:
+    SpscRing<FrameItem> input;
+
+    LatencyHistogram processing;
+};
+
+///
+/// \brief The SegmentFinalizer class
+///
+/// Finishes a rolled-over in-process file (encoder flush, trailer, disk
+/// close and sync) on its own thread, so the encode stage goes straight on
+/// into the next segment however slow the old volume is
+///
+class SegmentFinalizer : public QThread
+{
+    Q_OBJECT
+
+public:
+    void finalize(MediaMuxer *muxer, const QString &path);
+
+signals:
+    void finalized(const QString &path);
+
+protected:
+    void run();
+
+private:
+    MediaMuxer *closing_muxer = nullptr;
+    QString closing_path;
+};
+
+///
+/// \brief The EncodeStage class
+///
+/// Owns the VideoWriter, so a slow write no longer delays the next grab.
+/// Never drops: the ring absorbs writer hiccups and backpressure reaches
+/// the capture loop only when it is full.
+///
+class EncodeStage : public FrameStage
+{
+    Q_OBJECT
+
+public:
+    EncodeStage();
+
+    bool open(const QString &path, int fourcc, double fps, cv::Size size);
+    bool openMuxed(const QString &path, int fps, cv::Size size, bool compress);
+    void setFragmentSeconds(int seconds);
+    void configureDiskWriter(int queueMB, int batchKB, int preallocateMB, FsyncPolicy policy, int fsyncIntervalMs);
+
+    // in-process output only; VideoWriter does its own I/O
+    const DiskWriter& diskWriter() const { return muxer().diskWriter(); }
+
+    // in-process bytes since openMuxed, over every segment
+    qint64 bytesWritten() const;
+
+    // continue the in-process recording in a new file from the next frame
+    void rollOver(const QString &path);
+
+    // frames kept from before recording; written ahead of live frames
+    PrerollBuffer& preroll() { return preroll_buffer; }
+    void finish();
+
+    // queued for the encode thread; never waits for the encoder or the disk
+    bool writeAudio(const void *data, int frames, int sampleRate, int channels, int bytesPerSample, bool isFloat, qint64 arrivalUs);
+
+    bool isAccepting() const { return accepting.loadAcquire() != 0; }
+    bool isOpen();
+
+    // timestamps come from capture time, so dropped frames are just held
+    bool isVariableFrameRate() { return muxer().isOpen(); }
+
+    VideoTiming videoTiming();
+
+signals:
+    // an in-process file has been finalized
+    void muxedFileClosed(const QString &path);
+
+    // rollOver() done; path is where recording continues
+    void segmentOpened(const QString &path);
+
+    // a VideoWriter file is released and can be muxed; timing is final
+    void videoFileClosed(const QString &path, const VideoTiming &timing);
+
+    // the file of the last recording is finalized; the next may be opened
+    void writerClosed();
+
+protected:
+    bool processFrame(FrameItem &item);
+    void idle();
+    void drained();
+
+private:
+    struct AudioChunk
+    {
+        QByteArray data;
+        int frames;
+        int sample_rate;
+        int channels;
+        int bytes_per_sample;
+        bool is_float;
+
+        // SessionClock time the buffer had all arrived by
+        qint64 arrival_us;
+    };
+
+    void writePreroll();
+    void writeQueuedAudio();
+    void nextSegment();
+
+    MediaMuxer& muxer() { return muxers[active_muxer.loadAcquire()]; }
+    const MediaMuxer& muxer() const { return muxers[active_muxer.loadAcquire()]; }
+
+    QMutex writer_mutex;
+    cv::VideoWriter video;
+    QString video_path;
+    VideoTiming video_timing;
+
+    // in-process H.264/AAC output; video is unused while this is open.
+    // Segments alternate between the two, the other one finalizing
+    MediaMuxer muxers[2];
+    QAtomicInt active_muxer;
+    QString muxed_path;
+
+    // waited for in idle(), so nothing is left finalizing once the stage
+    // has drained
+    SegmentFinalizer segment_finalizer;
+
+    // for reopening at a segment boundary
+    cv::Size muxed_size;
+    int muxed_fps = 15;
+    bool muxed_compress = false;
+
+    // next segment, taken at the next frame; empty for none
+    QString rollover_path;
+
+    // DiskWriter::totalBytes() of both muxers at openMuxed
+    qint64 bytes_base = 0;
+
+    PrerollBuffer preroll_buffer;
+
+    // PCM from the GUI thread, encoded and muxed on the stage thread
+    QMutex audio_mutex;
+    QList<AudioChunk> audio_queue;
+    int audio_queued_bytes = 0;
+    quint64 audio_dropped = 0;
+
+    QAtomicInt accepting;
+};
+
+///
+/// \brief The PreviewStage class
+///
+/// Scales frames for the viewfinder and posts them to a mailbox the GUI
+/// pulls from. Latest wins: a stalled GUI only ever costs the preview, never
+/// the recording. Frames are decimated to the preview rate, scaled to fit
+/// the viewfinder and swizzled to RGB32 in one pass, directly into one of
+/// a few reusable images, so the GUI only has to paint.
+///
+class PreviewStage : public FrameStage
+{
+    Q_OBJECT
+
+public:
+    PreviewStage();
+
+    void setWindowSize(cv::Size size) { window_size = size; }
+    void setTargetSize(int width, int height);
+    void setPreviewRate(int fps);
+
+    void setEnabled(bool enabled) { preview_enabled.storeRelease(enabled ? 1 : 0); }
+    bool isEnabled() const { return preview_enabled.loadAcquire() != 0; }
+
+    PreviewMailbox* mailbox() { return &preview_mailbox; }
+
+    quint64 imageMisses() const { return static_cast<quint64>(image_misses.loadAcquire()); }
+
+    static QImage Mat2QImage(cv::Mat const& src);
+
+protected:
+    bool processFrame(FrameItem &item);
+
+private:
+    QImage& nextImage(int width, int height);
+
+    // fallback bounds until the viewfinder reports its geometry
+    cv::Size window_size;
+
+    // viewfinder geometry, written by the GUI thread
+    QAtomicInt target_width;
+    QAtomicInt target_height;
+
+    QAtomicInt preview_enabled;
+
+    // minimum spacing between converted frames (ms of capture time)
+    QAtomicInt preview_interval;
+    qint64 last_preview = 0;
+
+    PreviewScaler scaler;
+
+    PreviewMailbox preview_mailbox;
+
+    // one image being painted, one waiting in the mailbox, one being filled
+    QImage images[3];
+    int next_image = 0;
+
+    QAtomicInt image_misses;
+};
+
+///
+/// \brief The OverlayStage class
+///
+/// Burns the session annotations and timestamp into each frame, then fans
+/// the frame out to the encode and preview stages. The session block is
+/// rendered once into a sprite + mask and only re-rendered when one of its
+/// values changes; each frame just gets a masked copy.
+///
+class OverlayStage : public FrameStage
+{
+    Q_OBJECT
+
+public:
+    OverlayStage(EncodeStage *encoder, PreviewStage *preview);
+
+    void setSessionConditions(QString id, QString session, QString treatment, QString condition);
+    void setSessionCondition(int index, QString value);
+    void setTimestampFormat(QString format);
+
+    void setStaticSceneMode(bool skip, double threshold, int keepaliveMs);
+
+    SceneStats sceneStats() const;
+    void resetSceneStats();
+
+    void drawOverlay(cv::Mat &frame, qint64 msecsSinceEpoch);
+
+protected:
+    bool processFrame(FrameItem &item);
+
+private:
+    void rebuildSprite();
+    bool skipStaticFrame(const FrameItem &item);
+
+    EncodeStage *encode_stage;
+    PreviewStage *preview_stage;
+
+    QMutex text_mutex;
+
+    // set from the GUI thread, consumed on the overlay thread
+    QAtomicInt sprite_dirty;
+
+    cv::Mat sprite;
+    cv::Mat sprite_mask;
+
+    QString timestamp_format;
+    QAtomicInt format_dirty;
+
+    QString winId = "";
+    QString winSession = "";
+    QString winTreatment = "";
+    QString winCondition = "";
+
+    double fontScale = 0.50;
+    int fontStyle = cv::FONT_ITALIC;
+
+    cv::Point topRect1 = cv::Point(2, 4);
+    cv::Point topRect2 = cv::Point(180, 4 + (4 * 14));
+
+    cv::Point topText1 = cv::Point(8, 4 + 14 - 2);
+    cv::Point topText2 = cv::Point(8, 4 + 28 - 2);
+    cv::Point topText3 = cv::Point(8, 4 + 42 - 2);
+    cv::Point topText4 = cv::Point(8, 4 + 56 - 2);
+
+    // Default annotation values
+    cv::Scalar yellowColor = cv::Scalar(255, 255, 255);
+    cv::Scalar blackColor = cv::Scalar(0, 0, 0);
+
+    TimestampRenderer timestamp{fontStyle, fontScale, yellowColor, blackColor};
+
+    // near-static frames are left out of an in-process recording, except
+    // one per keepalive so the burned-in clock keeps ticking
+    StaticSceneDetector static_detector;
+    bool skip_static = false;
+    qint64 keepalive_us = 1000000;
+    qint64 last_kept_us = 0;
+
+    QAtomicInt stats_frames;
+    QAtomicInt stats_static;
+    QAtomicInt stats_skipped;
+};
+
+#endif // FRAMEPIPELINE_H
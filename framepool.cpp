@@ -0,0 +1,282 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QMutexLocker>
+
+#include "framepool.h"
+
+///
+/// \brief FrameRef::FrameRef
+/// \param s
+///
+FrameRef::FrameRef(FrameSlot *s) : slot(s)
+{
+    if (slot)
+    {
+        slot->refs.ref();
+    }
+}
+
+///
+/// \brief FrameRef::FrameRef
+/// \param other
+///
+FrameRef::FrameRef(const FrameRef &other) : slot(other.slot)
+{
+    if (slot)
+    {
+        slot->refs.ref();
+    }
+}
+
+///
+/// \brief FrameRef::~FrameRef
+///
+FrameRef::~FrameRef()
+{
+    release();
+}
+
+///
+/// \brief FrameRef::operator =
+/// \param other
+/// \return
+///
+FrameRef& FrameRef::operator=(const FrameRef &other)
+{
+    if (slot != other.slot)
+    {
+        if (other.slot)
+        {
+            other.slot->refs.ref();
+        }
+
+        release();
+
+        slot = other.slot;
+    }
+
+    return *this;
+}
+
+///
+/// \brief FrameRef::release
+///
+/// Drop this handle; the last one returns the buffer to its pool
+///
+void FrameRef::release()
+{
+    if (!slot)
+    {
+        return;
+    }
+
+    FrameSlot *s = slot;
+    slot = nullptr;
+
+    if (!s->refs.deref())
+    {
+        FramePool::recycle(s);
+    }
+}
+
+///
+/// \brief FramePool::FramePool
+///
+FramePool::FramePool() : core(new FramePoolCore), slot_count(0), slot_type(-1), miss_count(0)
+{
+    core->refs.ref();
+}
+
+///
+/// \brief FramePool::~FramePool
+///
+FramePool::~FramePool()
+{
+    orphanSlots();
+    releaseCore(core);
+}
+
+///
+/// \brief FramePool::reserve
+///
+/// (Re)create the pool. A no-op unless the geometry, type or count changed,
+/// so it is cheap to call whenever the capture resolution is (re)negotiated.
+///
+/// \param size
+/// \param type
+/// \param count
+///
+void FramePool::reserve(cv::Size size, int type, int count)
+{
+    if (size == slot_size && type == slot_type && count == slot_count)
+    {
+        return;
+    }
+
+    // buffers still in flight keep the old core and free themselves
+    orphanSlots();
+    releaseCore(core);
+
+    core = new FramePoolCore;
+    core->refs.ref();
+
+    slot_size = size;
+    slot_type = type;
+    slot_count = count;
+
+    QMutexLocker locker(&core->mutex);
+
+    // capacity reserved up front, so recycling never reallocates
+    core->free_list.reserve(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        FrameSlot *slot = new FrameSlot;
+        slot->mat.create(size, type);
+        slot->core = core;
+
+        core->refs.ref();
+        core->free_list.append(slot);
+    }
+
+    miss_count.storeRelease(0);
+}
+
+///
+/// \brief FramePool::acquire
+/// \return
+///
+FrameRef FramePool::acquire()
+{
+    FrameSlot *slot = nullptr;
+
+    core->mutex.lock();
+
+    if (!core->free_list.isEmpty())
+    {
+        slot = core->free_list.takeLast();
+    }
+
+    core->mutex.unlock();
+
+    if (!slot)
+    {
+        miss_count.fetchAndAddRelaxed(1);
+
+        slot = new FrameSlot;
+
+        if (slot_size.area() > 0)
+        {
+            slot->mat.create(slot_size, slot_type);
+        }
+    }
+
+    return FrameRef(slot);
+}
+
+///
+/// \brief FramePool::available
+/// \return
+///
+int FramePool::available()
+{
+    QMutexLocker locker(&core->mutex);
+
+    return core->free_list.size();
+}
+
+///
+/// \brief FramePool::recycle
+///
+/// Return a released buffer to its pool, under that pool's own lock. If the
+/// pool has been re-created or destroyed since, the buffer is freed instead.
+///
+/// \param slot
+///
+void FramePool::recycle(FrameSlot *slot)
+{
+    FramePoolCore *owner = slot->core;
+
+    // miss allocation
+    if (!owner)
+    {
+        delete slot;
+        return;
+    }
+
+    {
+        QMutexLocker locker(&owner->mutex);
+
+        if (owner->live)
+        {
+            owner->free_list.append(slot);
+            return;
+        }
+    }
+
+    delete slot;
+    releaseCore(owner);
+}
+
+///
+/// \brief FramePool::releaseCore
+///
+/// Drop one reference; the last frees the core
+///
+/// \param core
+///
+void FramePool::releaseCore(FramePoolCore *core)
+{
+    if (!core->refs.deref())
+    {
+        delete core;
+    }
+}
+
+///
+/// \brief FramePool::orphanSlots
+///
+/// Free idle buffers; buffers still in flight free themselves on release
+///
+void FramePool::orphanSlots()
+{
+    QVector<FrameSlot*> idle;
+
+    {
+        QMutexLocker locker(&core->mutex);
+
+        core->live = false;
+        idle.swap(core->free_list);
+    }
+
+    for (int i = 0; i < idle.size(); ++i)
+    {
+        delete idle.at(i);
+        releaseCore(core);
+    }
+}
@@ -0,0 +1,143 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+
+#include "opencv2/core/core.hpp"
+
+struct FrameSlot;
+
+///
+/// \brief The FramePoolCore struct
+///
+/// State a pool shares with the buffers it hands out, so a buffer released
+/// after its pool was re-created or destroyed still has a live mutex to
+/// check against. Freed with the last of them.
+///
+struct FramePoolCore
+{
+    QMutex mutex;
+    QVector<FrameSlot*> free_list;
+
+    // cleared when the pool re-creates its buffers or is destroyed
+    bool live = true;
+
+    // the pool, plus one per pooled buffer
+    QAtomicInt refs;
+};
+
+///
+/// \brief The FrameSlot struct
+///
+/// Pre-allocated buffer owned by a FramePool
+///
+struct FrameSlot
+{
+    cv::Mat mat;
+    QAtomicInt refs;
+
+    // null for a one-off buffer allocated on a pool miss
+    FramePoolCore *core = nullptr;
+};
+
+///
+/// \brief The FrameRef class
+///
+/// Reference-counted handle to a pooled buffer. When the last handle goes
+/// away the buffer returns to its pool instead of being freed.
+///
+class FrameRef
+{
+public:
+    FrameRef() : slot(nullptr) {}
+    FrameRef(const FrameRef &other);
+    ~FrameRef();
+
+    FrameRef& operator=(const FrameRef &other);
+
+    bool isNull() const { return slot == nullptr; }
+
+    cv::Mat& mat() { return slot->mat; }
+    const cv::Mat& mat() const { return slot->mat; }
+
+    void release();
+
+private:
+    friend class FramePool;
+
+    explicit FrameRef(FrameSlot *s);
+
+    FrameSlot *slot;
+};
+
+///
+/// \brief The FramePool class
+///
+/// Fixed set of equally sized frame buffers. Steady-state recording takes
+/// every buffer from here; a miss (pool exhausted) falls back to a one-off
+/// heap buffer and is counted so it can be checked in the field.
+///
+/// reserve(), acquire() and available() are called from the thread that
+/// owns the pool; buffers may be released from any thread, and only ever
+/// lock their own pool.
+///
+class FramePool
+{
+public:
+    FramePool();
+    ~FramePool();
+
+    void reserve(cv::Size size, int type, int count);
+
+    FrameRef acquire();
+
+    quint64 misses() const { return static_cast<quint64>(miss_count.loadAcquire()); }
+    int available();
+    int capacity() const { return slot_count; }
+
+private:
+    friend class FrameRef;
+
+    static void recycle(FrameSlot *slot);
+    static void releaseCore(FramePoolCore *core);
+    void orphanSlots();
+
+    FramePoolCore *core;
+    int slot_count;
+
+    cv::Size slot_size;
+    int slot_type;
+
+    QAtomicInt miss_count;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,196 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <thread>
+
+#include "framescheduler.h"
+
+///
+/// \brief FrameScheduler::FrameScheduler
+///
+/// \param fps
+///
+/// Target frames per second
+///
+/// \param spinWindowMicroseconds
+///
+/// Busy-wait window before each deadline (0 = sleep only)
+///
+FrameScheduler::FrameScheduler(int fps, int spinWindowMicroseconds) :
+    frames_per_second(0),
+    spin_window(std::chrono::microseconds(qMax(0, spinWindowMicroseconds))),
+    started(false),
+    has_origin(false),
+    last_lateness_us(0),
+    late_frames(0),
+    skipped_frames(0)
+{
+    setFramerate(fps);
+}
+
+///
+/// \brief FrameScheduler::setFramerate
+///
+/// Changes the frame period; the deadline grid restarts on the next wait
+///
+/// \param fps
+///
+void FrameScheduler::setFramerate(int fps)
+{
+    if (fps <= 0)
+    {
+        fps = 15;
+    }
+
+    if (fps == frames_per_second)
+    {
+        return;
+    }
+
+    frames_per_second = fps;
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(1000000 / fps));
+
+    reset();
+}
+
+///
+/// \brief FrameScheduler::setSpinWindow
+///
+/// \param microseconds
+///
+void FrameScheduler::setSpinWindow(int microseconds)
+{
+    spin_window = std::chrono::microseconds(qMax(0, microseconds));
+}
+
+///
+/// \brief FrameScheduler::setOrigin
+///
+/// Anchor the deadline grid to a shared instant so that several schedulers
+/// (one per camera) tick in phase instead of wherever each thread started
+///
+/// \param origin
+///
+void FrameScheduler::setOrigin(Clock::time_point origin)
+{
+    grid_origin = origin;
+    has_origin = true;
+
+    reset();
+}
+
+///
+/// \brief FrameScheduler::reset
+///
+/// Re-anchor the deadline grid at the next call to waitForNextFrame
+///
+void FrameScheduler::reset()
+{
+    started = false;
+    last_lateness_us = 0;
+}
+
+///
+/// \brief FrameScheduler::periodMicroseconds
+/// \return
+///
+qint64 FrameScheduler::periodMicroseconds() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(period).count();
+}
+
+///
+/// \brief FrameScheduler::waitForNextFrame
+///
+/// Block until the next frame deadline. If the caller overran by one or more
+/// whole periods, the missed slots are skipped rather than replayed in a burst.
+///
+/// \return
+///
+/// Lateness of this frame in microseconds (0 if the deadline was met)
+///
+qint64 FrameScheduler::waitForNextFrame()
+{
+    Clock::time_point now = Clock::now();
+
+    if (!started)
+    {
+        started = true;
+        last_lateness_us = 0;
+
+        if (has_origin && now >= grid_origin)
+        {
+            // first grid point after now
+            next_deadline = grid_origin + period * ((now - grid_origin) / period + 1);
+        }
+        else
+        {
+            next_deadline = now + period;
+        }
+
+        return 0;
+    }
+
+    if (now < next_deadline)
+    {
+        if (next_deadline - now > spin_window)
+        {
+            std::this_thread::sleep_until(next_deadline - spin_window);
+        }
+
+        while (Clock::now() < next_deadline)
+        {
+            // final spin window, only reached when spin_window > 0
+            // or the sleep returned early
+        }
+
+        now = Clock::now();
+    }
+
+    Clock::duration late = now - next_deadline;
+
+    last_lateness_us = std::chrono::duration_cast<std::chrono::microseconds>(late).count();
+
+    if (late >= period)
+    {
+        // Overran by whole frame(s): drop the missed slots, stay on the grid
+        Clock::duration::rep missed = late / period;
+
+        skipped_frames += static_cast<quint64>(missed);
+        next_deadline += period * missed;
+    }
+
+    // Sleep wake-up jitter is expected; only count frames late by >10% of a period
+    if (late > period / 10)
+    {
+        late_frames++;
+    }
+
+    next_deadline += period;
+
+    return last_lateness_us;
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QtGlobal>
+
+#include <chrono>
+
+///
+/// \brief The FrameScheduler class
+///
+/// Paces a capture loop against the monotonic (steady) clock. Deadlines are
+/// kept on an absolute grid (start + n * period), so sleep jitter never
+/// accumulates into drift. The thread sleeps until shortly before each
+/// deadline and optionally spins for the final few microseconds.
+///
+class FrameScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit FrameScheduler(int fps = 15, int spinWindowMicroseconds = 0);
+
+    void setFramerate(int fps);
+    void setSpinWindow(int microseconds);
+    void setOrigin(Clock::time_point origin);
+
+    void reset();
+
+    qint64 waitForNextFrame();
+
+    int framerate() const { return frames_per_second; }
+    qint64 periodMicroseconds() const;
+
+    qint64 lastLateness() const { return last_lateness_us; }
+    quint64 lateFrames() const { return late_frames; }
+    quint64 skippedFrames() const { return skipped_frames; }
+
+private:
+    int frames_per_second;
+
+    Clock::duration period;
+    Clock::duration spin_window;
+
+    Clock::time_point next_deadline;
+    Clock::time_point grid_origin;
+
+    bool started;
+    bool has_origin;
+
+    qint64 last_lateness_us;
+    quint64 late_frames;
+    quint64 skipped_frames;
+};
+
+#endif // FRAMESCHEDULER_H
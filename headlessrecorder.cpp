@@ -0,0 +1,1115 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "headlessrecorder.h"
+
+#include <QAudioRecorder>
+#include <QAudioProbe>
+#include <QAudioEncoderSettings>
+#include <QCameraInfo>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <QSocketNotifier>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "camerathread.h"
+#include "fileshipper.h"
+#include "mediamuxer.h"
+#include "muxjobqueue.h"
+#include "sessionclock.h"
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+namespace
+{
+#ifdef Q_OS_WIN
+    HeadlessRecorder *signalTarget = nullptr;
+
+    BOOL WINAPI consoleHandler(DWORD type)
+    {
+        Q_UNUSED(type);
+
+        // runs on a system thread; hand over to the event loop
+        if (signalTarget)
+        {
+            QMetaObject::invokeMethod(signalTarget, "shutdown", Qt::QueuedConnection);
+        }
+
+        return TRUE;
+    }
+#else
+    // self-pipe: the handler only writes the signal number, the event loop
+    // does the rest
+    int signalPipe[2] = { -1, -1 };
+
+    void unixSignalHandler(int sig)
+    {
+        char c = static_cast<char>(sig);
+        ssize_t written = ::write(signalPipe[0], &c, 1);
+        Q_UNUSED(written);
+    }
+#endif
+}
+
+///
+/// \brief HeadlessRecorder::HeadlessRecorder
+/// \param parent
+///
+HeadlessRecorder::HeadlessRecorder(QObject *parent) : QObject(parent)
+{
+    tempWriteLocation = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
+
+    muxQueue = new MuxJobQueue(this);
+    connect(muxQueue, SIGNAL(jobFinished(int,QString,bool)), this, SLOT(muxJobFinished(int,QString,bool)));
+    connect(muxQueue, SIGNAL(queueChanged(int)), this, SLOT(muxQueueChanged(int)));
+
+    catalog = new RecordingCatalog(this);
+
+    // as in the window: record to local disk, ship finished files afterwards
+    outboxDirectory = tempWriteLocation + "/.sessionrecorder/outbox";
+
+    shipper = new FileShipper(this);
+    connect(shipper, SIGNAL(delivered(QString,qint64,QString)), this, SLOT(fileDelivered(QString,qint64,QString)));
+    connect(shipper, SIGNAL(deliveryFailed(QString,QString,int)), this, SLOT(fileDeliveryFailed(QString,QString,int)));
+    connect(shipper, SIGNAL(queueChanged(int)), this, SLOT(shipQueueChanged(int)));
+
+    durationTimer = new QTimer(this);
+    durationTimer->setSingleShot(true);
+    connect(durationTimer, SIGNAL(timeout()), this, SLOT(shutdown()));
+}
+
+///
+/// \brief HeadlessRecorder::~HeadlessRecorder
+///
+HeadlessRecorder::~HeadlessRecorder()
+{
+    stopCameras();
+
+    qDeleteAll(cameras);
+    cameras.clear();
+
+    delete probe;
+}
+
+///
+/// \brief HeadlessRecorder::isRequested
+///
+/// Checked before any application object exists, so the widgets are never loaded
+///
+/// \param argc
+/// \param argv
+/// \return
+///
+bool HeadlessRecorder::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (qstrcmp(argv[i], "--headless") == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+///
+/// \brief HeadlessRecorder::configure
+///
+/// Settings the dialogs last saved, overridden by --config, overridden by
+/// the remaining options
+///
+/// \param arguments
+/// \param error
+/// \return
+///
+bool HeadlessRecorder::configure(const QStringList &arguments, QString &error)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Session Recorder, headless mode"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    parser.addOptions({
+        { "headless", "Record without preview or widgets." },
+        { "config", "INI file with the settings below, in a [Headless] group.", "file" },
+        { "output", "Output directory.", "dir" },
+        { "ffmpeg", "Directory containing ffmpeg.", "dir" },
+        { "video-devices", "Comma-separated camera indices or names.", "list" },
+        { "source", "Capture source (camera, synthetic:..., file:...).", "source" },
+        { "fps", "Recording frame rate.", "fps" },
+        { "resolution", "Output resolution, WxH or Original.", "wxh" },
+        { "audio-device", "Audio input device.", "device" },
+        { "audio-codec", "Audio codec.", "codec" },
+        { "audio-sampling", "Audio sample rate.", "hz" },
+        { "id", "Participant id.", "id" },
+        { "session", "Session number.", "n" },
+        { "treatment", "Treatment label.", "tx" },
+        { "condition", "Condition label.", "cond" },
+        { "duration", "Stop and exit after this many seconds.", "s" },
+        { "compress", "Compress when combining audio and video." },
+        { "wait-for-signal", "Wait for SIGUSR1 before recording; SIGUSR1 toggles recording." },
+    });
+
+    if (!parser.parse(arguments))
+    {
+        error = parser.errorText();
+        return false;
+    }
+
+    if (parser.isSet("help"))
+    {
+        parser.showHelp();
+    }
+
+    if (parser.isSet("version"))
+    {
+        parser.showVersion();
+    }
+
+    loadSavedSettings();
+
+    if (parser.isSet("config"))
+    {
+        QString path = parser.value("config");
+
+        if (!QFileInfo(path).isReadable())
+        {
+            error = tr("Cannot read config file %1").arg(path);
+            return false;
+        }
+
+        loadConfigFile(path);
+    }
+
+    if (parser.isSet("output"))         recordSettings.fileSaveLocation = parser.value("output");
+    if (parser.isSet("ffmpeg"))         recordSettings.ffmpegLocation = parser.value("ffmpeg");
+    if (parser.isSet("fps"))            recordSettings.mVideoFPS = parser.value("fps");
+    if (parser.isSet("resolution"))     recordSettings.mResolution = parser.value("resolution");
+    if (parser.isSet("audio-device"))   recordSettings.mAudioDevice = parser.value("audio-device");
+    if (parser.isSet("audio-codec"))    recordSettings.mAudioEncoding = parser.value("audio-codec");
+    if (parser.isSet("audio-sampling")) recordSettings.mAudioSampling = parser.value("audio-sampling");
+
+    if (parser.isSet("video-devices"))  videoSources = resolveVideoDevices(parser.value("video-devices").split(','));
+    if (parser.isSet("source"))         captureSource = parser.value("source");
+
+    if (parser.isSet("id"))             sessionId = parser.value("id");
+    if (parser.isSet("session"))        sessionNumber = parser.value("session");
+    if (parser.isSet("treatment"))      sessionTreatment = parser.value("treatment");
+    if (parser.isSet("condition"))      sessionCondition = parser.value("condition");
+
+    if (parser.isSet("duration"))       durationSeconds = parser.value("duration").toInt();
+    if (parser.isSet("compress"))       compress = true;
+    if (parser.isSet("wait-for-signal")) waitForSignal = true;
+
+    sessionId = sessionId.toUpper();
+    sessionTreatment = sessionTreatment.toUpper();
+    sessionCondition = sessionCondition.toUpper();
+
+    bool ok = false;
+    sessionNumber.toInt(&ok);
+
+    if (!ok)
+    {
+        error = tr("A session number is required (--session)");
+        return false;
+    }
+
+    if (recordSettings.fileSaveLocation.isEmpty())
+    {
+        error = tr("An output directory is required (--output)");
+        return false;
+    }
+
+    if (videoSources.isEmpty())
+    {
+        videoSources << 0;
+    }
+
+#ifdef QT_DEBUG
+    qDebug() << "HeadlessRecorder::configure" << videoSources << recordSettings.mResolution
+             << recordSettings.mVideoFPS << recordSettings.mAudioDevice << recordSettings.fileSaveLocation;
+#endif
+
+    return true;
+}
+
+///
+/// \brief HeadlessRecorder::loadSavedSettings
+///
+/// Same keys the InitializationDialog and AvRecorder save
+///
+void HeadlessRecorder::loadSavedSettings()
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+
+    settings.beginGroup(QLatin1String("InitializationDialog"));
+
+    QStringList videoDevices = settings.value(QLatin1String("listWidgetVideoDevices")).toStringList();
+
+    if (videoDevices.isEmpty())
+    {
+        videoDevices << settings.value(QLatin1String("comboBoxVideoDevice")).toString();
+    }
+
+    videoSources = resolveVideoDevices(videoDevices);
+
+    recordSettings.mVideoFPS       = settings.value(QLatin1String("lineEditVideoFPS")).toString();
+    recordSettings.mResolution     = settings.value(QLatin1String("comboBoxResolution")).toString();
+    recordSettings.mAudioDevice    = settings.value(QLatin1String("comboBoxAudioDevice")).toString();
+    recordSettings.mAudioEncoding  = settings.value(QLatin1String("comboBoxAudioCodec")).toString();
+    recordSettings.mAudioSampling  = settings.value(QLatin1String("comboBoxAudioSampling")).toString();
+    recordSettings.fileSaveLocation = settings.value(QLatin1String("lineEditOutputDirectory")).toString();
+    recordSettings.ffmpegLocation  = settings.value(QLatin1String("lineEditFFmpegDirectory")).toString();
+
+    settings.endGroup();
+
+    settings.beginGroup(QLatin1String("AvRecorder"));
+
+    sessionId        = settings.value(QLatin1String("lineEditId")).toString();
+    sessionNumber    = settings.value(QLatin1String("lineEditSession")).toString();
+    sessionTreatment = settings.value(QLatin1String("lineEditTx")).toString();
+    sessionCondition = settings.value(QLatin1String("lineEditCond")).toString();
+
+    compress     = settings.value(QLatin1String("checkBoxCompression")).toBool();
+    inProcessMux = settings.value(QLatin1String("inProcessMux"), true).toBool();
+
+    captureSource = settings.value(QLatin1String("captureSource")).toString();
+
+    settings.endGroup();
+}
+
+///
+/// \brief HeadlessRecorder::loadConfigFile
+///
+/// Keys in the [Headless] group share the command-line option names
+///
+/// \param path
+///
+void HeadlessRecorder::loadConfigFile(const QString &path)
+{
+    QSettings config(path, QSettings::IniFormat);
+    config.beginGroup(QLatin1String("Headless"));
+
+    if (config.contains("output"))          recordSettings.fileSaveLocation = config.value("output").toString();
+    if (config.contains("ffmpeg"))          recordSettings.ffmpegLocation = config.value("ffmpeg").toString();
+    if (config.contains("fps"))             recordSettings.mVideoFPS = config.value("fps").toString();
+    if (config.contains("resolution"))      recordSettings.mResolution = config.value("resolution").toString();
+    if (config.contains("audio-device"))    recordSettings.mAudioDevice = config.value("audio-device").toString();
+    if (config.contains("audio-codec"))     recordSettings.mAudioEncoding = config.value("audio-codec").toString();
+    if (config.contains("audio-sampling"))  recordSettings.mAudioSampling = config.value("audio-sampling").toString();
+
+    // a comma in an INI value already reads back as a list
+    if (config.contains("video-devices"))   videoSources = resolveVideoDevices(config.value("video-devices").toStringList());
+    if (config.contains("source"))          captureSource = config.value("source").toString();
+
+    if (config.contains("id"))              sessionId = config.value("id").toString();
+    if (config.contains("session"))         sessionNumber = config.value("session").toString();
+    if (config.contains("treatment"))       sessionTreatment = config.value("treatment").toString();
+    if (config.contains("condition"))       sessionCondition = config.value("condition").toString();
+
+    if (config.contains("duration"))        durationSeconds = config.value("duration").toInt();
+    if (config.contains("compress"))        compress = config.value("compress").toBool();
+    if (config.contains("in-process-mux"))  inProcessMux = config.value("in-process-mux").toBool();
+    if (config.contains("wait-for-signal")) waitForSignal = config.value("wait-for-signal").toBool();
+
+    config.endGroup();
+}
+
+///
+/// \brief HeadlessRecorder::resolveVideoDevices
+///
+/// Camera indices, given either as numbers or as the device descriptions
+/// the dialog saves
+///
+/// \param names
+/// \return
+///
+QList<int> HeadlessRecorder::resolveVideoDevices(const QStringList &names) const
+{
+    QList<QCameraInfo> cams = QCameraInfo::availableCameras();
+    QList<int> sources;
+
+    foreach (const QString &name, names)
+    {
+        QString device = name.trimmed();
+
+        if (device.isEmpty())
+        {
+            continue;
+        }
+
+        bool isIndex = false;
+        int index = device.toInt(&isIndex);
+
+        if (!isIndex)
+        {
+            index = -1;
+
+            for (int i = 0; i < cams.count(); ++i)
+            {
+                if (cams.at(i).description() == device)
+                {
+                    index = i;
+                    break;
+                }
+            }
+        }
+
+        if (index >= 0 && !sources.contains(index))
+        {
+            sources << index;
+        }
+        else if (index < 0)
+        {
+            log(tr("Camera not found: %1").arg(device));
+        }
+    }
+
+    return sources;
+}
+
+///
+/// \brief HeadlessRecorder::start
+///
+/// Opens the cameras and the audio input; recording follows once every
+/// camera has reported in
+///
+void HeadlessRecorder::start()
+{
+    installSignalHandlers();
+
+    // fix the shared clock before any camera starts pacing against it
+    SessionClock::origin();
+
+    catalog->importDirectory(recordSettings.fileSaveLocation, QStringList() << VIDEOEXT << MUXEXT);
+
+    audioRecorder = new QAudioRecorder(this);
+    probe = new QAudioProbe;
+    connect(probe, SIGNAL(audioBufferProbed(QAudioBuffer)), this, SLOT(processBuffer(QAudioBuffer)));
+    probe->setSource(audioRecorder);
+
+    connect(audioRecorder, SIGNAL(statusChanged(QMediaRecorder::Status)), this, SLOT(updateStatus(QMediaRecorder::Status)));
+    connect(audioRecorder, SIGNAL(stateChanged(QMediaRecorder::State)), this, SLOT(onStateChanged(QMediaRecorder::State)));
+
+    for (int n = 0; n < videoSources.count(); ++n)
+    {
+        CameraThread *cam = new CameraThread(videoSources.at(n), recordSettings.mResolution);
+
+        cam->setVideoFile(CameraThread::videoFileName(n));
+        cam->setPreviewEnabled(false);
+
+        if (!recordSettings.mVideoFPS.isEmpty())
+        {
+            cam->setCameraFramerate(recordSettings.mVideoFPS);
+        }
+
+        if (!captureSource.isEmpty())
+        {
+            cam->setCaptureSource(captureSource);
+        }
+
+        connect(cam, SIGNAL(errorMessage(const QString&)), this, SLOT(cameraError(const QString&)));
+        connect(cam, SIGNAL(cameraConnected(bool)), this, SLOT(cameraConnected(bool)));
+        connect(cam, SIGNAL(videoFileClosed(QString,VideoTiming)), this, SLOT(videoFileClosed(QString,VideoTiming)));
+        connect(cam, SIGNAL(fileFinished(QString)), this, SLOT(deliverFile(QString)));
+
+        cam->start();
+
+        cameras.append(cam);
+    }
+
+    log(tr("Opening %1 camera(s)...").arg(cameras.count()));
+}
+
+///
+/// \brief HeadlessRecorder::cameraConnected
+/// \param ok
+///
+void HeadlessRecorder::cameraConnected(bool ok)
+{
+    camerasReported++;
+
+    if (ok)
+    {
+        camerasConnected++;
+    }
+
+    if (camerasReported < cameras.count())
+    {
+        return;
+    }
+
+    if (camerasConnected == 0)
+    {
+        log(tr("No camera could be opened."));
+        emit finished(1);
+        return;
+    }
+
+    if (waitForSignal)
+    {
+        log(tr("Ready; send SIGUSR1 to start recording."));
+    }
+    else
+    {
+        record();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::cameraError
+/// \param message
+///
+void HeadlessRecorder::cameraError(const QString &message)
+{
+    log(message);
+}
+
+///
+/// \brief HeadlessRecorder::toggleRecord
+///
+void HeadlessRecorder::toggleRecord()
+{
+    if (quitting || !audioRecorder)
+    {
+        return;
+    }
+
+    if (audioRecorder->state() == QMediaRecorder::StoppedState)
+    {
+        record();
+    }
+    else
+    {
+        log(tr("Stopping..."));
+
+        durationTimer->stop();
+        audioRecorder->stop();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::record
+///
+/// Same session layout as AvRecorder::toggleRecord
+///
+void HeadlessRecorder::record()
+{
+    if (recording)
+    {
+        return;
+    }
+
+    audioRecorder->setAudioInput(recordSettings.mAudioDevice);
+
+    sessionWorkspace = QString("%1/.sessionrecorder/%2").arg(tempWriteLocation)
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz"));
+    QDir().mkpath(sessionWorkspace);
+
+    // left over only when a close raced the last stop status
+    closedVideoFiles.clear();
+
+    QDir().mkpath(QFileInfo(stagedFilePath(0, MUXEXT)).absolutePath());
+
+    audioRecorder->setOutputLocation(QUrl::fromLocalFile(sessionWorkspace+"/audio.wav"));
+    audioClock.reset();
+
+    bool muxInProcess = inProcessMux && MediaMuxer::isAvailable();
+
+    // never record over an earlier take, from this run or a previous one
+    while (isSessionRecorded())
+    {
+        log(tr("Session %1 is already recorded").arg(sessionNumber));
+
+        sessionNumber = QString::number(sessionNumber.toInt() + 1);
+    }
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        cameras.at(i)->setWorkspace(sessionWorkspace);
+        cameras.at(i)->setOutputDirectory(recordSettings.fileSaveLocation);
+        cameras.at(i)->setMuxTarget(muxInProcess ? stagedFilePath(i, MUXEXT) : QString(),
+                                    compress);
+        cameras.at(i)->updateSessionConditions(sessionId, sessionNumber, sessionTreatment, sessionCondition);
+    }
+
+    QAudioEncoderSettings settings;
+    settings.setCodec(recordSettings.mAudioEncoding);
+    settings.setSampleRate(recordSettings.mAudioSampling.toInt());
+    settings.setChannelCount(1);
+    settings.setQuality(QMultimedia::VeryHighQuality);
+
+    audioRecorder->setEncodingSettings(settings,
+                                       QVideoEncoderSettings(),
+                                       QString("audio/x-wav"));
+
+    audioRecorder->record();
+
+    recStarted = QDateTime::currentDateTime();
+    recording = true;
+
+    if (durationSeconds > 0)
+    {
+        durationTimer->start(durationSeconds * 1000);
+    }
+
+    log(tr("Recording session %1 to %2").arg(sessionNumber).arg(sessionFilePath(0, muxInProcess ? MUXEXT : VIDEOEXT)));
+}
+
+///
+/// \brief HeadlessRecorder::processBuffer
+/// \param buffer
+///
+void HeadlessRecorder::processBuffer(const QAudioBuffer &buffer)
+{
+    audioClock.addBuffer(SessionClock::elapsedMicroseconds(), buffer.frameCount(), buffer.format().sampleRate());
+
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        cameras.at(i)->writeAudio(buffer);
+    }
+}
+
+///
+/// \brief HeadlessRecorder::onStateChanged
+///
+/// Cameras follow the audio recorder, as they do with the AvRecorder window
+///
+/// \param state
+///
+void HeadlessRecorder::onStateChanged(QMediaRecorder::State state)
+{
+    for (int i = 0; i < cameras.count(); ++i)
+    {
+        cameras.at(i)->onStateChanged(state);
+    }
+}
+
+///
+/// \brief HeadlessRecorder::updateStatus
+/// \param status
+///
+void HeadlessRecorder::updateStatus(QMediaRecorder::Status status)
+{
+    if (status != QMediaRecorder::UnloadedStatus || !recording)
+    {
+        return;
+    }
+
+    recording = false;
+
+    catalogSession();
+
+    enqueueMuxJobs();
+
+    // the next take (SIGUSR1) gets its own files
+    sessionNumber = QString::number(sessionNumber.toInt() + 1);
+
+    if (quitting)
+    {
+        finishWhenIdle();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::catalogSession
+///
+/// Same entries as AvRecorder::catalogSession; sizes and checksums follow
+/// once each file is delivered
+///
+void HeadlessRecorder::catalogSession()
+{
+    for (int i = 0; i < qMax(1, cameras.count()); ++i)
+    {
+        bool inProcess = i < cameras.count() && cameras.at(i)->isMuxedInProcess();
+
+        CatalogEntry entry = catalogEntry(i, sessionFilePath(i, inProcess ? MUXEXT : VIDEOEXT));
+        entry.durationMs = recStarted.msecsTo(QDateTime::currentDateTime());
+
+        catalog->addRecording(entry);
+    }
+}
+
+///
+/// \brief HeadlessRecorder::catalogEntry
+/// \param camera
+/// \param path
+/// \return
+///
+CatalogEntry HeadlessRecorder::catalogEntry(int camera, const QString &path) const
+{
+    CatalogEntry entry;
+    entry.path = path;
+    entry.id = sessionId;
+    entry.treatment = sessionTreatment;
+    entry.session = sessionNumber.toInt();
+    entry.condition = sessionCondition;
+    entry.camera = camera;
+    entry.recorded = recStarted;
+
+    return entry;
+}
+
+///
+/// \brief HeadlessRecorder::enqueueMuxJobs
+///
+/// Cameras not written in-process are combined with audio.wav by ffmpeg
+///
+void HeadlessRecorder::enqueueMuxJobs()
+{
+    int queuedJobs = 0;
+
+    for (int i = 0; i < qMax(1, cameras.count()); ++i)
+    {
+        if (i < cameras.count() && cameras.at(i)->isMuxedInProcess())
+        {
+            continue;
+        }
+
+        PendingMuxJob pending;
+        pending.job.workspace = sessionWorkspace;
+        pending.job.program = QString(recordSettings.ffmpegLocation + "/ffmpeg");
+        pending.job.output = stagedFilePath(i, VIDEOEXT);
+        pending.job.durationMs = recStarted.msecsTo(QDateTime::currentDateTime());
+        pending.videoFile = CameraThread::videoFileName(i);
+        pending.audio = audioClock;
+        pending.compress = compress;
+
+        // queued once the camera has released the temporary file
+        QString path = i < cameras.count() ? cameras.at(i)->videoFilePath() : QString();
+
+        if (closedVideoFiles.contains(path))
+        {
+            enqueueMuxJob(pending, closedVideoFiles.take(path));
+        }
+        else if (i < cameras.count() && cameras.at(i)->isWriting())
+        {
+            pendingMuxJobs.insert(path, pending);
+        }
+        else
+        {
+            enqueueMuxJob(pending, i < cameras.count() ? cameras.at(i)->videoTiming() : VideoTiming());
+        }
+
+        queuedJobs++;
+    }
+
+    if (queuedJobs == 0)
+    {
+        MuxJobQueue::removeWorkspace(sessionWorkspace);
+
+        log(tr("Recording saved."));
+    }
+    else
+    {
+        log(tr("Recording saved; %1 file(s) queued for %2.")
+            .arg(queuedJobs)
+            .arg(compress ? tr("conversion") : tr("combining")));
+    }
+}
+
+///
+/// \brief HeadlessRecorder::enqueueMuxJob
+/// \param pending
+/// \param timing
+///
+void HeadlessRecorder::enqueueMuxJob(PendingMuxJob pending, const VideoTiming &timing)
+{
+    pending.job.arguments = CameraThread::muxArguments(pending.videoFile,
+                                                       timing,
+                                                       pending.audio,
+                                                       pending.compress);
+    pending.job.arguments << pending.job.output;
+
+    muxQueue->enqueue(pending.job);
+}
+
+///
+/// \brief HeadlessRecorder::videoFileClosed
+///
+/// A camera released its temporary file; its mux job can run now
+///
+/// \param path
+/// \param timing
+///
+void HeadlessRecorder::videoFileClosed(const QString &path, const VideoTiming &timing)
+{
+    if (pendingMuxJobs.contains(path))
+    {
+        enqueueMuxJob(pendingMuxJobs.take(path), timing);
+    }
+    else
+    {
+        // closed ahead of the recorder's stop status
+        closedVideoFiles.insert(path, timing);
+    }
+}
+
+///
+/// \brief HeadlessRecorder::sessionFilePath
+/// \param camera
+/// \param ext
+/// \return
+///
+QString HeadlessRecorder::sessionFilePath(int camera, const QString &ext) const
+{
+    QString name = QString("%1-%2").arg(QString::number(sessionNumber.toInt()))
+                                   .arg(sessionCondition);
+
+    if (camera > 0)
+    {
+        name += QString("-cam%1").arg(camera);
+    }
+
+    return QString("%1/%2/%3/%4.%5").arg(recordSettings.fileSaveLocation)
+            .arg(sessionId)
+            .arg(sessionTreatment)
+            .arg(name)
+            .arg(ext);
+}
+
+///
+/// \brief HeadlessRecorder::stagedFilePath
+///
+/// Local counterpart of sessionFilePath: where the file is produced before
+/// it is shipped to the output directory
+///
+/// \param camera
+/// \param ext
+/// \return
+///
+QString HeadlessRecorder::stagedFilePath(int camera, const QString &ext) const
+{
+    return outboxDirectory + "/" +
+            QDir(recordSettings.fileSaveLocation).relativeFilePath(sessionFilePath(camera, ext));
+}
+
+///
+/// \brief HeadlessRecorder::destinationPath
+///
+/// Where a staged file is delivered to
+///
+/// \param staged
+/// \return
+///
+/// Empty if the file is not staged
+///
+QString HeadlessRecorder::destinationPath(const QString &staged) const
+{
+    if (!staged.startsWith(outboxDirectory + "/"))
+    {
+        return QString();
+    }
+
+    return QDir(recordSettings.fileSaveLocation).filePath(QDir(outboxDirectory).relativeFilePath(staged));
+}
+
+///
+/// \brief HeadlessRecorder::isSessionRecorded
+///
+/// Whether the current session is in the catalog, from this run, an earlier
+/// one or the window
+///
+/// \return
+///
+bool HeadlessRecorder::isSessionRecorded() const
+{
+    return catalog->contains(sessionId, sessionTreatment, sessionNumber.toInt(), sessionCondition);
+}
+
+///
+/// \brief HeadlessRecorder::muxJobFinished
+/// \param id
+/// \param output
+/// \param ok
+///
+void HeadlessRecorder::muxJobFinished(int id, const QString &output, bool ok)
+{
+    Q_UNUSED(id);
+
+    if (!ok)
+    {
+        log(tr("Failed to process %1; the recording was kept in the temporary folder.").arg(output));
+
+        catalog->removeRecording(destinationPath(output));
+        return;
+    }
+
+    deliverFile(output);
+}
+
+///
+/// \brief HeadlessRecorder::deliverFile
+///
+/// Hand a finished local file to the shipper
+///
+/// \param staged
+///
+void HeadlessRecorder::deliverFile(const QString &staged)
+{
+    QString destination = destinationPath(staged);
+
+    // written straight to the output directory (jobs from older versions)
+    if (destination.isEmpty())
+    {
+        catalog->verify(staged);
+
+        log(tr("Saved %1").arg(staged));
+        return;
+    }
+
+    shipper->enqueue(staged, destination);
+}
+
+///
+/// \brief HeadlessRecorder::fileDelivered
+/// \param destination
+/// \param size
+/// \param checksum
+///
+void HeadlessRecorder::fileDelivered(const QString &destination, qint64 size, const QString &checksum)
+{
+    catalog->setVerified(destination, size, checksum);
+
+    log(tr("Saved %1").arg(destination));
+}
+
+///
+/// \brief HeadlessRecorder::fileDeliveryFailed
+///
+/// When exiting, a failed delivery is left queued for the next run
+/// (headless or not) instead of holding up the exit through its retries
+///
+/// \param destination
+/// \param error
+/// \param attempts
+///
+void HeadlessRecorder::fileDeliveryFailed(const QString &destination, const QString &error, int attempts)
+{
+    log(tr("Could not deliver %1 (attempt %2): %3. The local copy is kept and will be retried.")
+        .arg(destination)
+        .arg(attempts)
+        .arg(error));
+
+    if (quitting && camerasStopped && !finishedEmitted)
+    {
+        finishedEmitted = true;
+        emit finished(1);
+    }
+}
+
+///
+/// \brief HeadlessRecorder::shipQueueChanged
+/// \param pending
+///
+void HeadlessRecorder::shipQueueChanged(int pending)
+{
+    if (quitting && camerasStopped && pending == 0)
+    {
+        finishWhenIdle();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::muxQueueChanged
+/// \param pending
+///
+void HeadlessRecorder::muxQueueChanged(int pending)
+{
+    if (quitting && !recording && pending == 0)
+    {
+        finishWhenIdle();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::shutdown
+///
+/// Stops any recording, then exits once its files are written
+///
+void HeadlessRecorder::shutdown()
+{
+    if (quitting)
+    {
+        return;
+    }
+
+    if (audioRecorder && audioRecorder->state() != QMediaRecorder::StoppedState)
+    {
+        log(tr("Stopping..."));
+
+        durationTimer->stop();
+        audioRecorder->stop();
+    }
+
+    quitting = true;
+
+    if (!recording)
+    {
+        finishWhenIdle();
+    }
+}
+
+///
+/// \brief HeadlessRecorder::finishWhenIdle
+///
+void HeadlessRecorder::finishWhenIdle()
+{
+    if (finishedEmitted)
+    {
+        return;
+    }
+
+    // deferred jobs are still waiting on their cameras to close the file
+    int pending = muxQueue->pending() + pendingMuxJobs.count();
+
+    if (pending > 0)
+    {
+        log(tr("Waiting for %1 file(s) to finish...").arg(pending));
+        return;
+    }
+
+    // in-process files are closed when the camera loops exit; their
+    // fileFinished signals are queued ahead of the next call
+    if (!camerasStopped)
+    {
+        stopCameras();
+        camerasStopped = true;
+
+        QTimer::singleShot(0, this, SLOT(finishWhenIdle()));
+        return;
+    }
+
+    if (shipper->pending() > 0)
+    {
+        log(tr("Waiting for %1 file(s) to be delivered...").arg(shipper->pending()));
+        return;
+    }
+
+    finishedEmitted = true;
+    emit finished(0);
+}
+
+///
+/// \brief HeadlessRecorder::stopCameras
+///
+void HeadlessRecorder::stopCameras()
+{
+    foreach (CameraThread *cam, cameras)
+    {
+        if (cam->isRunning())
+        {
+            cam->breakLoop();
+            cam->quit();
+
+            // as in main(): never cut short while its file is finalized
+            cam->wait();
+        }
+    }
+}
+
+///
+/// \brief HeadlessRecorder::installSignalHandlers
+///
+/// SIGINT/SIGTERM (or Ctrl+C on Windows) stop and exit; SIGUSR1 toggles recording
+///
+void HeadlessRecorder::installSignalHandlers()
+{
+#ifdef Q_OS_WIN
+    signalTarget = this;
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+#else
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalPipe) != 0)
+    {
+        log(tr("Signal handling unavailable; use --duration to stop."));
+        return;
+    }
+
+    QSocketNotifier *notifier = new QSocketNotifier(signalPipe[1], QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(handleSignal()));
+
+    struct sigaction action;
+    action.sa_handler = unixSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+    sigaction(SIGUSR1, &action, 0);
+#endif
+}
+
+///
+/// \brief HeadlessRecorder::handleSignal
+///
+void HeadlessRecorder::handleSignal()
+{
+#ifndef Q_OS_WIN
+    char sig = 0;
+
+    if (::read(signalPipe[1], &sig, 1) != 1)
+    {
+        return;
+    }
+
+    if (sig == SIGUSR1)
+    {
+        toggleRecord();
+    }
+    else
+    {
+        shutdown();
+    }
+#endif
+}
+
+///
+/// \brief HeadlessRecorder::log
+/// \param message
+///
+void HeadlessRecorder::log(const QString &message) const
+{
+    QTextStream err(stderr);
+    err << QDateTime::currentDateTime().toString("hh:mm:ss") << " " << message << endl;
+}
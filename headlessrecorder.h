@@ -0,0 +1,162 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef HEADLESSRECORDER_H
+#define HEADLESSRECORDER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QList>
+#include <QMediaRecorder>
+#include <QStringList>
+#include <QHash>
+
+#include "recordsettings.h"
+#include "audioclock.h"
+#include "muxjobqueue.h"
+#include "framepipeline.h"
+#include "recordingcatalog.h"
+
+class QAudioRecorder;
+class QAudioProbe;
+class QAudioBuffer;
+class QTimer;
+class CameraThread;
+class FileShipper;
+
+///
+/// \brief The HeadlessRecorder class
+///
+/// Records without any widgets: no preview, no meters. Settings start from
+/// what the dialogs last saved, then a config file (--config, INI), then
+/// the command line. Recording starts once the cameras are up (or on
+/// SIGUSR1 with --wait-for-signal), stops after --duration seconds, on
+/// SIGUSR1 again, or on SIGINT/SIGTERM, which also quit once muxing is done.
+///
+class HeadlessRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HeadlessRecorder(QObject *parent = 0);
+    ~HeadlessRecorder();
+
+    static bool isRequested(int argc, char *argv[]);
+
+    bool configure(const QStringList &arguments, QString &error);
+
+signals:
+    void finished(int code);
+
+public slots:
+    void start();
+    void toggleRecord();
+    void shutdown();
+
+private slots:
+    void cameraConnected(bool ok);
+    void cameraError(const QString &message);
+    void processBuffer(const QAudioBuffer &buffer);
+    void onStateChanged(QMediaRecorder::State state);
+    void updateStatus(QMediaRecorder::Status status);
+    void muxJobFinished(int id, const QString &output, bool ok);
+    void muxQueueChanged(int pending);
+    void videoFileClosed(const QString &path, const VideoTiming &timing);
+    void deliverFile(const QString &staged);
+    void fileDelivered(const QString &destination, qint64 size, const QString &checksum);
+    void fileDeliveryFailed(const QString &destination, const QString &error, int attempts);
+    void shipQueueChanged(int pending);
+    void finishWhenIdle();
+    void handleSignal();
+
+private:
+    void loadSavedSettings();
+    void loadConfigFile(const QString &path);
+    QList<int> resolveVideoDevices(const QStringList &names) const;
+
+    void record();
+    void catalogSession();
+    CatalogEntry catalogEntry(int camera, const QString &path) const;
+    void enqueueMuxJobs();
+    void enqueueMuxJob(PendingMuxJob pending, const VideoTiming &timing);
+    void stopCameras();
+
+    QString sessionFilePath(int camera, const QString &ext) const;
+    QString stagedFilePath(int camera, const QString &ext) const;
+    QString destinationPath(const QString &staged) const;
+    bool isSessionRecorded() const;
+
+    void installSignalHandlers();
+    void log(const QString &message) const;
+
+    RecordSettingsData recordSettings;
+
+    QList<int> videoSources;
+    QString captureSource;
+
+    QString sessionId;
+    QString sessionNumber;
+    QString sessionTreatment;
+    QString sessionCondition;
+
+    int durationSeconds = 0;
+    bool compress = false;
+    bool inProcessMux = true;
+    bool waitForSignal = false;
+
+    QAudioRecorder *audioRecorder = nullptr;
+    QAudioProbe *probe = nullptr;
+    MuxJobQueue *muxQueue = nullptr;
+
+    // by temporary video path: jobs whose file is still being written, and
+    // files closed before their job was built
+    QHash<QString, PendingMuxJob> pendingMuxJobs;
+    QHash<QString, VideoTiming> closedVideoFiles;
+    QTimer *durationTimer = nullptr;
+
+    // shared with the window, so each sees the other's sessions
+    RecordingCatalog *catalog = nullptr;
+
+    // files are produced in outboxDirectory and shipped to fileSaveLocation
+    FileShipper *shipper = nullptr;
+    QString outboxDirectory;
+
+    QList<CameraThread*> cameras;
+    int camerasReported = 0;
+    int camerasConnected = 0;
+
+    QString tempWriteLocation;
+    QString sessionWorkspace;
+    AudioClock audioClock;
+    QDateTime recStarted;
+
+    bool quitting = false;
+    bool recording = false;
+    bool finishedEmitted = false;
+    bool camerasStopped = false;
+};
+
+#endif // HEADLESSRECORDER_H
@@ -28,6 +28,7 @@
 #include "initializationdialog.h"
 #include "ui_initializationdialog.h"
 
+#include <QEventLoop>
 #include <QMessageBox>
 
 InitializationDialog::InitializationDialog(QWidget *parent) :
@@ -40,51 +41,18 @@ InitializationDialog::InitializationDialog(QWidget *parent) :
     qDebug() << "InitializationDialog::InitializationDialog()";
 #endif
 
-    QList<QCameraInfo> cams = QCameraInfo::availableCameras();
+    // last known devices straight away; a fresh scan replaces them when done
+    DeviceList cached = DeviceScanner::loadCached();
+    cachedDevices = !cached.isEmpty();
+    populateDevices(cached);
 
-    ui->comboBoxVideoDevice->addItem(tr("Default"), QVariant(QString()));
-
-    QStringList videoModel;
-
-    foreach (const QCameraInfo &device, cams) {
-        ui->comboBoxVideoDevice->addItem(device.description(), QVariant(device.description()));
-        videoModel << device.description();
-    }
-
-#ifdef QT_DEBUG
-    qDebug() << "Cameras:";
-    qDebug() << videoModel;
-#endif
-
-    QAudioRecorder* audioRecorder = new QAudioRecorder(this);
-
-    QStringList audioModel;
-
-    //audio devices
-    ui->comboBoxAudioDevice->addItem(tr("Default"), QVariant(QString()));
-    foreach (const QString &device, audioRecorder->audioInputs()) {
-        ui->comboBoxAudioDevice->addItem(device, QVariant(device));
-        audioModel << device;
-    }
-
-#ifdef QT_DEBUG
-    qDebug() << "Microphones:";
-    qDebug() << audioModel;
-#endif
-
-    //audio codecs, amr by default
-    ui->comboBoxAudioCodec->addItem(tr("Default"), QVariant(QString()));
-    foreach (const QString &codecName, audioRecorder->supportedAudioCodecs()) {
-        ui->comboBoxAudioCodec->addItem(codecName, QVariant(codecName));
-    }
-    ui->comboBoxAudioCodec->addItem(tr("audio/amr"), QVariant(QString()));
-    ui->comboBoxAudioCodec->setCurrentIndex(ui->comboBoxAudioCodec->count() - 1);
-
-    //sample rate
-    ui->comboBoxAudioSampling->addItem(tr("Default"), QVariant(0));
-    foreach (int sampleRate, audioRecorder->supportedAudioSampleRates()) {
-        ui->comboBoxAudioSampling->addItem(QString::number(sampleRate), QVariant(sampleRate));
-    }
+    scanThread = new QThread(this);
+    scanner = new DeviceScanner;
+    scanner->moveToThread(scanThread);
+    connect(scanThread, SIGNAL(finished()), scanner, SLOT(deleteLater()));
+    connect(scanThread, SIGNAL(started()), scanner, SLOT(scan()));
+    connect(scanner, SIGNAL(scanned(DeviceList)), this, SLOT(devicesScanned(DeviceList)));
+    scanThread->start();
 
     ui->comboBoxAspectRatio->addItem(tr("Standard"), QVariant(0));
     ui->comboBoxAspectRatio->addItem(tr("Wide Screen"), QVariant(1));
@@ -119,6 +87,15 @@ void InitializationDialog::SaveAndValidate(QAbstractButton* clicked)
 {
     Q_UNUSED(clicked);
 
+    // list rows are capture indices; only trust them once the scan is in
+    if (!scanComplete)
+    {
+        // the thread only finishes after devicesScanned has run
+        QEventLoop loop;
+        connect(scanThread, SIGNAL(finished()), &loop, SLOT(quit()));
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+    }
+
     if (!QFileInfo (ui->lineEditOutputDirectory->text()).exists() ||
             !QFileInfo (ui->lineEditOutputDirectory->text()).isWritable()) {
         QMessageBox errorBox;
@@ -140,6 +117,95 @@ void InitializationDialog::SaveAndValidate(QAbstractButton* clicked)
     QDialog::accept();
 }
 
+///
+/// \brief InitializationDialog::populateDevices
+///
+/// Fill the device lists, keeping the current selections where the
+/// devices still exist
+///
+/// \param devices
+///
+void InitializationDialog::populateDevices(const DeviceList &devices)
+{
+    QStringList checked = getSelectedVideoNames();
+    QString audioDevice = ui->comboBoxAudioDevice->currentText();
+    QString audioCodec = ui->comboBoxAudioCodec->currentText();
+    QString audioSampling = ui->comboBoxAudioSampling->currentText();
+
+    // row n is OpenCV capture index n; each checked row gets its own camera
+    ui->listWidgetVideoDevices->clear();
+    foreach (const QString &device, devices.cameras) {
+        QListWidgetItem *item = new QListWidgetItem(device, ui->listWidgetVideoDevices);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(checked.contains(device) ? Qt::Checked : Qt::Unchecked);
+    }
+
+    //audio devices
+    ui->comboBoxAudioDevice->clear();
+    ui->comboBoxAudioDevice->addItem(tr("Default"), QVariant(QString()));
+    foreach (const QString &device, devices.audioInputs) {
+        ui->comboBoxAudioDevice->addItem(device, QVariant(device));
+    }
+
+    //audio codecs, amr by default
+    ui->comboBoxAudioCodec->clear();
+    ui->comboBoxAudioCodec->addItem(tr("Default"), QVariant(QString()));
+    foreach (const QString &codecName, devices.audioCodecs) {
+        ui->comboBoxAudioCodec->addItem(codecName, QVariant(codecName));
+    }
+    ui->comboBoxAudioCodec->addItem(tr("audio/amr"), QVariant(QString()));
+    ui->comboBoxAudioCodec->setCurrentIndex(ui->comboBoxAudioCodec->count() - 1);
+
+    //sample rate
+    ui->comboBoxAudioSampling->clear();
+    ui->comboBoxAudioSampling->addItem(tr("Default"), QVariant(0));
+    foreach (int sampleRate, devices.sampleRates) {
+        ui->comboBoxAudioSampling->addItem(QString::number(sampleRate), QVariant(sampleRate));
+    }
+
+    if (!audioDevice.isEmpty())
+    {
+        ui->comboBoxAudioDevice->setCurrentText(audioDevice);
+    }
+
+    if (!audioCodec.isEmpty())
+    {
+        ui->comboBoxAudioCodec->setCurrentText(audioCodec);
+    }
+
+    if (!audioSampling.isEmpty())
+    {
+        ui->comboBoxAudioSampling->setCurrentText(audioSampling);
+    }
+}
+
+///
+/// \brief InitializationDialog::devicesScanned
+///
+/// Reconcile the cached lists with what is actually attached now
+///
+/// \param devices
+///
+void InitializationDialog::devicesScanned(const DeviceList &devices)
+{
+    scanComplete = true;
+
+    populateDevices(devices);
+
+    if (!cachedDevices)
+    {
+        // nothing was cached, so the saved selections had nothing to apply to
+        QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+        settings.beginGroup(QLatin1String("InitializationDialog"));
+
+        LoadPreviousDevices(settings);
+
+        settings.endGroup();
+    }
+
+    scanThread->quit();
+}
+
 ///
 /// \brief InitializationDialog::AspectRatioChanged
 ///
@@ -173,8 +239,55 @@ void InitializationDialog::AspectRatioChanged(int index)
 ///
 int InitializationDialog::getSelectedVideoSource()
 {
-    return (ui->comboBoxVideoDevice->currentIndex() != 0) ? ui->comboBoxVideoDevice->currentIndex() - 1 :
-                                                            0;
+    return getSelectedVideoSources().first();
+}
+
+///
+/// \brief InitializationDialog::getSelectedVideoSources
+///
+/// Capture indices of every checked device, in list order
+///
+/// \return
+///
+/// Never empty; falls back to the default device (0)
+///
+QList<int> InitializationDialog::getSelectedVideoSources()
+{
+    QList<int> sources;
+
+    for (int i = 0; i < ui->listWidgetVideoDevices->count(); i++)
+    {
+        if (ui->listWidgetVideoDevices->item(i)->checkState() == Qt::Checked)
+        {
+            sources << i;
+        }
+    }
+
+    if (sources.isEmpty())
+    {
+        sources << 0;
+    }
+
+    return sources;
+}
+
+///
+/// \brief InitializationDialog::getSelectedVideoNames
+/// \return
+///
+QStringList InitializationDialog::getSelectedVideoNames()
+{
+    QStringList names;
+
+    for (int i = 0; i < ui->listWidgetVideoDevices->count(); i++)
+    {
+        if (ui->listWidgetVideoDevices->item(i)->checkState() == Qt::Checked)
+        {
+            names << ui->listWidgetVideoDevices->item(i)->text();
+        }
+    }
+
+    return names;
 }
 
 ///
@@ -195,7 +308,7 @@ RecordSettingsData* InitializationDialog::getRecordingSettings() {
             ui->lineEditFFmpegDirectory->text(),
             ui->lineEditOutputDirectory->text(),
 
-            ui->comboBoxVideoDevice->currentText(),
+            getSelectedVideoNames().join(", "),
             ui->lineEditVideoFPS->text(),
             ui->comboBoxResolution->currentText(),
 
@@ -214,12 +327,9 @@ void InitializationDialog::LoadPreviousOptions()
     QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
     settings.beginGroup(QLatin1String("InitializationDialog"));
 
-    ui->comboBoxVideoDevice->setCurrentText(settings.value(QLatin1String("comboBoxVideoDevice")).toString());
-    ui->lineEditVideoFPS->setText(settings.value(QLatin1String("lineEditVideoFPS")).toString());
+    LoadPreviousDevices(settings);
 
-    ui->comboBoxAudioDevice->setCurrentText(settings.value(QLatin1String("comboBoxAudioDevice")).toString());
-    ui->comboBoxAudioCodec->setCurrentText(settings.value(QLatin1String("comboBoxAudioCodec")).toString());
-    ui->comboBoxAudioSampling->setCurrentText(settings.value(QLatin1String("comboBoxAudioSampling")).toString());
+    ui->lineEditVideoFPS->setText(settings.value(QLatin1String("lineEditVideoFPS")).toString());
 
     ui->lineEditOutputDirectory->setText(settings.value(QLatin1String("lineEditOutputDirectory")).toString());
     ui->lineEditFFmpegDirectory->setText(settings.value(QLatin1String("lineEditFFmpegDirectory")).toString());
@@ -234,6 +344,37 @@ void InitializationDialog::LoadPreviousOptions()
     settings.sync();
 }
 
+///
+/// \brief InitializationDialog::LoadPreviousDevices
+///
+/// Saved device selections only; applied again after a scan that had no
+/// cached list to start from
+///
+/// \param settings
+///
+/// Positioned in the InitializationDialog group
+///
+void InitializationDialog::LoadPreviousDevices(QSettings &settings)
+{
+    QStringList videoDevices = settings.value(QLatin1String("listWidgetVideoDevices")).toStringList();
+
+    if (videoDevices.isEmpty())
+    {
+        // single-camera setting from older versions
+        videoDevices << settings.value(QLatin1String("comboBoxVideoDevice")).toString();
+    }
+
+    for (int i = 0; i < ui->listWidgetVideoDevices->count(); i++)
+    {
+        QListWidgetItem *item = ui->listWidgetVideoDevices->item(i);
+        item->setCheckState(videoDevices.contains(item->text()) ? Qt::Checked : Qt::Unchecked);
+    }
+
+    ui->comboBoxAudioDevice->setCurrentText(settings.value(QLatin1String("comboBoxAudioDevice")).toString());
+    ui->comboBoxAudioCodec->setCurrentText(settings.value(QLatin1String("comboBoxAudioCodec")).toString());
+    ui->comboBoxAudioSampling->setCurrentText(settings.value(QLatin1String("comboBoxAudioSampling")).toString());
+}
+
 ///
 /// \brief InitializationDialog::SaveCurrentOptions
 ///
@@ -242,7 +383,7 @@ void InitializationDialog::SaveCurrentOptions()
     QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
     settings.beginGroup(QLatin1String("InitializationDialog"));
 
-    settings.setValue(QLatin1String("comboBoxVideoDevice"), ui->comboBoxVideoDevice->currentText());
+    settings.setValue(QLatin1String("listWidgetVideoDevices"), getSelectedVideoNames());
     settings.setValue(QLatin1String("lineEditVideoFPS"), ui->lineEditVideoFPS->text());
 
     settings.setValue(QLatin1String("comboBoxAspectRatio"), ui->comboBoxAspectRatio->currentText());
@@ -306,5 +447,8 @@ void InitializationDialog::SelectFFmpegDirectory(bool)
 ///
 InitializationDialog::~InitializationDialog()
 {
+    scanThread->quit();
+    scanThread->wait();
+
     delete ui;
 }
@@ -36,7 +36,10 @@
 #include <QSettings>
 #include <QStandardItemModel>
 #include <QFileDialog>
+#include <QListWidget>
+#include <QThread>
 
+#include "devicescanner.h"
 #include "recordsettings.h"
 #include "enums.h"
 
@@ -51,6 +54,7 @@ class InitializationDialog : public QDialog
 public:
     explicit InitializationDialog(QWidget *parent = 0);
     int getSelectedVideoSource();
+    QList<int> getSelectedVideoSources();
     QString getSelectedResolution();
     RecordSettingsData *getRecordingSettings();
 
@@ -64,12 +68,25 @@ public slots:
 
     void AspectRatioChanged(int index);
 
+private slots:
+    void devicesScanned(const DeviceList &devices);
+
 private:
     Ui::InitializationDialog *ui;
 
     RecordSettings mSettingsHolder;
 
+    QStringList getSelectedVideoNames();
+
+    void populateDevices(const DeviceList &devices);
+
+    QThread *scanThread;
+    DeviceScanner *scanner;
+    bool scanComplete = false;
+    bool cachedDevices = false;
+
     void LoadPreviousOptions();
+    void LoadPreviousDevices(QSettings &settings);
     void SaveCurrentOptions();
 
 };
@@ -0,0 +1,175 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QtAlgorithms>
+
+#include "latencyhistogram.h"
+
+///
+/// \brief LatencyHistogram::LatencyHistogram
+///
+LatencyHistogram::LatencyHistogram() : total(0), maximum(0)
+{
+    reset();
+}
+
+///
+/// \brief LatencyHistogram::bucketFor
+///
+/// Values below 32 map 1:1; above that, the top five significant bits
+/// select the sub-bucket within the value's power of two
+///
+/// \param value
+/// \return
+///
+int LatencyHistogram::bucketFor(quint64 value)
+{
+    if (value < quint64(SubBuckets))
+    {
+        return static_cast<int>(value);
+    }
+
+    const int msb = 63 - static_cast<int>(qCountLeadingZeroBits(value));
+    int shift = msb - SubBucketBits;
+
+    if (shift >= Magnitudes)
+    {
+        return BucketCount - 1;
+    }
+
+    return (shift + 1) * SubBuckets + static_cast<int>((value >> shift) - SubBuckets);
+}
+
+///
+/// \brief LatencyHistogram::bucketValue
+///
+/// Highest value that falls into a bucket
+///
+/// \param index
+/// \return
+///
+qint64 LatencyHistogram::bucketValue(int index)
+{
+    if (index < SubBuckets)
+    {
+        return index;
+    }
+
+    const int shift = index / SubBuckets - 1;
+    const qint64 sub = index % SubBuckets + SubBuckets;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+///
+/// \brief LatencyHistogram::record
+/// \param microseconds
+///
+void LatencyHistogram::record(qint64 microseconds)
+{
+    if (microseconds < 0)
+    {
+        microseconds = 0;
+    }
+
+    counts[bucketFor(static_cast<quint64>(microseconds))].fetchAndAddRelaxed(1);
+    total.fetchAndAddRelaxed(1);
+
+    const int clamped = static_cast<int>(qMin<qint64>(microseconds, 0x7fffffff));
+    int current = maximum.loadAcquire();
+
+    while (clamped > current && !maximum.testAndSetOrdered(current, clamped))
+    {
+        current = maximum.loadAcquire();
+    }
+}
+
+///
+/// \brief LatencyHistogram::reset
+///
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        counts[i].storeRelease(0);
+    }
+
+    total.storeRelease(0);
+    maximum.storeRelease(0);
+}
+
+///
+/// \brief LatencyHistogram::percentile
+/// \param p
+///
+/// 0.0 - 100.0
+///
+/// \return
+///
+qint64 LatencyHistogram::percentile(double p) const
+{
+    const quint64 n = static_cast<quint64>(total.loadAcquire());
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    quint64 rank = static_cast<quint64>(p / 100.0 * n + 0.5);
+    rank = qMax<quint64>(1, qMin(rank, n));
+
+    quint64 seen = 0;
+
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        seen += static_cast<quint64>(counts[i].loadAcquire());
+
+        if (seen >= rank)
+        {
+            return qMin<qint64>(bucketValue(i), maximum.loadAcquire());
+        }
+    }
+
+    return maximum.loadAcquire();
+}
+
+///
+/// \brief LatencyHistogram::summary
+/// \return
+///
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary result;
+
+    result.count = static_cast<quint64>(total.loadAcquire());
+    result.p50 = percentile(50.0);
+    result.p95 = percentile(95.0);
+    result.p99 = percentile(99.0);
+    result.max = maximum.loadAcquire();
+
+    return result;
+}
@@ -0,0 +1,85 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+///
+/// \brief The LatencySummary struct
+///
+/// Percentiles in microseconds
+///
+struct LatencySummary
+{
+    quint64 count = 0;
+
+    qint64 p50 = 0;
+    qint64 p95 = 0;
+    qint64 p99 = 0;
+    qint64 max = 0;
+};
+
+///
+/// \brief The LatencyHistogram class
+///
+/// Fixed-memory, log-linear (HDR-style) histogram of microsecond latencies.
+/// Each power of two is split into 32 linear sub-buckets, giving ~3%
+/// resolution from 1 us up to ~35 minutes. record() is constant time and
+/// lock free, so stage threads can record while the GUI queries.
+///
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 microseconds);
+    void reset();
+
+    qint64 percentile(double p) const;
+    LatencySummary summary() const;
+
+private:
+    enum
+    {
+        SubBucketBits = 5,
+        SubBuckets = 1 << SubBucketBits,
+        Magnitudes = 26,
+        BucketCount = (Magnitudes + 1) * SubBuckets
+    };
+
+    static int bucketFor(quint64 value);
+    static qint64 bucketValue(int index);
+
+    QAtomicInt counts[BucketCount];
+    QAtomicInt total;
+    QAtomicInt maximum;
+};
+
+#endif // LATENCYHISTOGRAM_H
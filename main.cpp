@@ -93,8 +93,10 @@
 #include "initializationdialog.h"
 #include "avrecorder.h"
 #include "camerathread.h"
+#include "headlessrecorder.h"
 #include "enums.h"
 #include "recordsettings.h"
+#include "sessionclock.h"
 
 //#include <QDebug>
 
@@ -103,6 +105,28 @@ int main(int argc, char *argv[])
     QCoreApplication::setOrganizationName("Shawn Gilroy");
     QCoreApplication::setOrganizationDomain("smallnstats.com");
     QCoreApplication::setApplicationName("Session Recorder");
+    QCoreApplication::setApplicationVersion(QString("%1.%2.%3").arg(VERSION_MAJOR).arg(VERSION_MINOR).arg(VERSION_BUILD));
+
+    if (HeadlessRecorder::isRequested(argc, argv))
+    {
+        // no widgets, no preview, no meters: only capture and encode
+        QCoreApplication core(argc, argv);
+
+        HeadlessRecorder headless;
+
+        QString error;
+        if (!headless.configure(core.arguments(), error))
+        {
+            QTextStream(stderr) << error << endl;
+            return 2;
+        }
+
+        QObject::connect(&headless, &HeadlessRecorder::finished, &core, &QCoreApplication::exit);
+
+        QTimer::singleShot(0, &headless, SLOT(start()));
+
+        return core.exec();
+    }
 
     QApplication a(argc, argv);
 
@@ -114,33 +138,48 @@ int main(int argc, char *argv[])
 
     QList<CameraThread *> cameras;
 
-    CameraThread* cam;
-    cam = new CameraThread(initDlg.getSelectedVideoSource(),
-                           initDlg.getSelectedResolution());
+    // fix the shared clock before any camera starts pacing against it
+    SessionClock::origin();
+
+    QList<int> sources = initDlg.getSelectedVideoSources();
+
+    for (int n = 0; n < sources.count(); ++n)
+    {
+        CameraThread* cam;
+        cam = new CameraThread(sources.at(n),
+                               initDlg.getSelectedResolution());
+
+        // each camera records into its own temporary file
+        cam->setVideoFile(CameraThread::videoFileName(n));
 
-    QObject::connect(&recorder, SIGNAL(outputDirectory(const QString&)), cam, SLOT(setOutputDirectory(const QString&)));
+        QObject::connect(&recorder, SIGNAL(outputDirectory(const QString&)), cam, SLOT(setOutputDirectory(const QString&)));
 
-    QObject::connect(&recorder, SIGNAL(stateChanged(QMediaRecorder::State)), cam, SLOT(onStateChanged(QMediaRecorder::State)));
-    QObject::connect(&recorder, SIGNAL(cameraOutput(QString)), cam, SLOT(setCameraOutput(QString)));
-    QObject::connect(&recorder, SIGNAL(cameraFramerate(QString)), cam, SLOT(setCameraFramerate(QString)));
-    QObject::connect(&recorder, SIGNAL(cameraPowerChanged(int, int)), cam, SLOT(setCameraPower(int, int)));
-    QObject::connect(&recorder, SIGNAL(sendSessionDetails(QString,QString,QString,QString)), cam, SLOT(updateSessionConditions(QString,QString,QString,QString)));
+        QObject::connect(&recorder, SIGNAL(stateChanged(QMediaRecorder::State)), cam, SLOT(onStateChanged(QMediaRecorder::State)));
+        QObject::connect(&recorder, SIGNAL(cameraOutput(QString)), cam, SLOT(setCameraOutput(QString)));
+        QObject::connect(&recorder, SIGNAL(cameraFramerate(QString)), cam, SLOT(setCameraFramerate(QString)));
+        QObject::connect(&recorder, SIGNAL(cameraPowerChanged(int, int)), cam, SLOT(setCameraPower(int, int)));
+        QObject::connect(&recorder, SIGNAL(sendSessionDetails(QString,QString,QString,QString)), cam, SLOT(updateSessionConditions(QString,QString,QString,QString)));
 
-    QObject::connect(&recorder, SIGNAL(changeSessionConditionSignal(int,QString)), cam, SLOT(updateSessionConditions(int,QString)));
+        QObject::connect(&recorder, SIGNAL(changeSessionConditionSignal(int,QString)), cam, SLOT(updateSessionConditions(int,QString)));
 
-    QObject::connect(cam, SIGNAL(qimgReady(const QImage)), &recorder, SLOT(processQImage(const QImage)));
-    QObject::connect(cam, SIGNAL(errorMessage(const QString&)), &recorder, SLOT(displayErrorMessage(const QString&)));
-    QObject::connect(cam, SIGNAL(cameraConnected(bool)), &recorder, SLOT(setCameraStatus(bool)));
+        QObject::connect(cam, SIGNAL(errorMessage(const QString&)), &recorder, SLOT(displayErrorMessage(const QString&)));
+        QObject::connect(cam, SIGNAL(cameraConnected(bool)), &recorder, SLOT(setCameraStatus(bool)));
 
-    // Start thread, once signals for status are connected
-    cam->start();
+        // Gives the camera its own viewfinder; preview frames are pulled by
+        // the recorder, not pushed through the event queue
+        recorder.addCamera(cam);
 
-    // Append to list, for easy shutdown (if more than one)
-    cameras.append(cam);
+        // Start thread, once signals for status are connected
+        cam->start();
+
+        // Append to list, for easy shutdown
+        cameras.append(cam);
+    }
 
     const int retval = a.exec();
 
-    // Kill off cameras on shutdown
+    // Stop cameras on shutdown; each finalizes its file (trailer, sync)
+    // before returning, so it is never cut short, however slow the disk
     QList<CameraThread *>::iterator i;
     for (i = cameras.begin(); i != cameras.end(); ++i)
     {
@@ -148,16 +187,7 @@ int main(int argc, char *argv[])
         {
             (*i)->breakLoop();
             (*i)->quit();
-
-            if (!(*i)->wait(2000))
-            {
-                (*i)->terminate();
-
-                if (!(*i)->wait(2000))
-                {
-                    //qDebug() << "CameraThread failed to terminate!";
-                }
-            }
+            (*i)->wait();
         }
     }
 
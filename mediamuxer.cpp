@@ -0,0 +1,976 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QMutexLocker>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+#include <cmath>
+
+#include "mediamuxer.h"
+#include "sessionclock.h"
+
+#ifdef USE_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
+}
+
+// FFmpeg 5.1 replaced the channel count and mask with AVChannelLayout;
+// FFmpeg 7 removed the old fields
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+#define HAVE_CH_LAYOUT
+#endif
+#endif
+
+///
+/// \brief MediaMuxer::MediaMuxer
+///
+MediaMuxer::MediaMuxer()
+{
+
+}
+
+///
+/// \brief MediaMuxer::~MediaMuxer
+///
+MediaMuxer::~MediaMuxer()
+{
+    close();
+}
+
+///
+/// \brief MediaMuxer::isAvailable
+///
+/// Whether this build can encode in-process
+///
+/// \return
+///
+bool MediaMuxer::isAvailable()
+{
+#ifdef USE_LIBAV
+    return true;
+#else
+    return false;
+#endif
+}
+
+///
+/// \brief MediaMuxer::isOpen
+/// \return
+///
+bool MediaMuxer::isOpen()
+{
+    QMutexLocker locker(&mutex);
+
+    return opened;
+}
+
+///
+/// \brief MediaMuxer::setFragmentSeconds
+///
+/// Takes effect at the next open()
+///
+/// \param seconds
+///
+void MediaMuxer::setFragmentSeconds(int seconds)
+{
+    QMutexLocker locker(&mutex);
+
+    fragment_seconds = qMax(0, seconds);
+}
+
+#ifndef USE_LIBAV
+
+bool MediaMuxer::open(const QString &, cv::Size, int, bool)
+{
+    return false;
+}
+
+void MediaMuxer::close()
+{
+
+}
+
+bool MediaMuxer::writeVideo(const cv::Mat &, qint64)
+{
+    return false;
+}
+
+bool MediaMuxer::writeAudio(const void *, int, int, int, int, bool, qint64)
+{
+    return false;
+}
+
+#else
+
+namespace
+{
+    // container output is gathered into this much before each DiskWriter call
+    const int IoBufferBytes = 256 * 1024;
+
+    int channelCount(const AVCodecContext *codec)
+    {
+#ifdef HAVE_CH_LAYOUT
+        return codec->ch_layout.nb_channels;
+#else
+        return codec->channels;
+#endif
+    }
+}
+
+///
+/// \brief The MediaMuxerIo struct
+///
+/// AVIOContext callbacks onto the muxer's DiskWriter. The writer only takes
+/// positioned ranges, so the stream position is tracked here.
+///
+struct MediaMuxerIo
+{
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int write(void *opaque, const uint8_t *data, int size)
+#else
+    static int write(void *opaque, uint8_t *data, int size)
+#endif
+    {
+        MediaMuxer *muxer = static_cast<MediaMuxer*>(opaque);
+
+        if (!muxer->disk_writer.write(muxer->io_position, reinterpret_cast<const char*>(data), size))
+        {
+            return AVERROR(EIO);
+        }
+
+        muxer->io_position += size;
+
+        return size;
+    }
+
+    static int64_t seek(void *opaque, int64_t offset, int whence)
+    {
+        MediaMuxer *muxer = static_cast<MediaMuxer*>(opaque);
+
+        switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return muxer->disk_writer.size();
+
+        case SEEK_SET:
+            muxer->io_position = offset;
+            break;
+
+        case SEEK_CUR:
+            muxer->io_position += offset;
+            break;
+
+        case SEEK_END:
+            muxer->io_position = muxer->disk_writer.size() + offset;
+            break;
+
+        default:
+            return -1;
+        }
+
+        return muxer->io_position;
+    }
+};
+
+///
+/// \brief MediaMuxer::open
+///
+/// Create the container and the video encoder; the header is written once
+/// the audio format is known (or audio is given up on)
+///
+/// \param path
+///
+/// Final output file; the container is chosen from the extension
+///
+/// \param size
+/// \param fps
+/// \param compress
+///
+/// Smaller files (crf 24) rather than near-lossless (crf 18)
+///
+/// \return
+///
+bool MediaMuxer::open(const QString &path, cv::Size size, int fps, bool compress)
+{
+    QMutexLocker locker(&mutex);
+
+    if (opened)
+    {
+        return false;
+    }
+
+    frames_per_second = qMax(1, fps);
+    first_video_us = -1;
+    last_video_pts = -1;
+    video_frames = 0;
+    audio_samples = 0;
+    audio_input_format = -1;
+    header_written = false;
+
+    audio_clock.reset();
+    audio_anchor_us = -1;
+    audio_skip = 0;
+    compensated_samples = 0;
+    compensation_until = 0;
+
+    QByteArray file = path.toLocal8Bit();
+
+    if (avformat_alloc_output_context2(&format_context, nullptr, nullptr, file.constData()) < 0 || !format_context)
+    {
+        cleanup();
+
+        return false;
+    }
+
+    const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+
+    if (!codec)
+    {
+        codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+
+    if (!codec)
+    {
+        codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
+
+    video_stream = codec ? avformat_new_stream(format_context, nullptr) : nullptr;
+    video_codec = codec ? avcodec_alloc_context3(codec) : nullptr;
+
+    if (!video_stream || !video_codec)
+    {
+        cleanup();
+
+        return false;
+    }
+
+    // 4:2:0 needs even dimensions
+    video_codec->width = size.width & ~1;
+    video_codec->height = size.height & ~1;
+    video_codec->pix_fmt = AV_PIX_FMT_YUV420P;
+    video_codec->time_base = AVRational{1, frames_per_second};
+    video_codec->framerate = AVRational{frames_per_second, 1};
+    // every keyframe starts a fragment
+    video_codec->gop_size = frames_per_second * (fragment_seconds > 0 ? fragment_seconds : 2);
+
+    if (format_context->oformat->flags & AVFMT_GLOBALHEADER)
+    {
+        video_codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *options = nullptr;
+
+    if (codec->id == AV_CODEC_ID_H264)
+    {
+        // keep up with capture on modest clinic machines
+        av_dict_set(&options, "preset", "veryfast", 0);
+        av_dict_set(&options, "crf", compress ? "24" : "18", 0);
+    }
+    else
+    {
+        video_codec->bit_rate = compress ? 1000000 : 4000000;
+    }
+
+    int err = avcodec_open2(video_codec, codec, &options);
+
+    av_dict_free(&options);
+
+    if (err < 0 || avcodec_parameters_from_context(video_stream->codecpar, video_codec) < 0)
+    {
+        cleanup();
+
+        return false;
+    }
+
+    video_stream->time_base = video_codec->time_base;
+
+    video_frame = av_frame_alloc();
+    video_frame->format = video_codec->pix_fmt;
+    video_frame->width = video_codec->width;
+    video_frame->height = video_codec->height;
+
+    sws_context = sws_getContext(video_codec->width, video_codec->height, AV_PIX_FMT_BGR24,
+                                 video_codec->width, video_codec->height, AV_PIX_FMT_YUV420P,
+                                 SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+    if (av_frame_get_buffer(video_frame, 32) < 0 || !sws_context)
+    {
+        cleanup();
+
+        return false;
+    }
+
+    if (!(format_context->oformat->flags & AVFMT_NOFILE))
+    {
+        if (!disk_writer.open(path))
+        {
+            cleanup();
+
+            return false;
+        }
+
+        io_position = 0;
+
+        unsigned char *buffer = static_cast<unsigned char*>(av_malloc(IoBufferBytes));
+        io_context = buffer ? avio_alloc_context(buffer, IoBufferBytes, 1, this, nullptr,
+                                                 MediaMuxerIo::write, MediaMuxerIo::seek) : nullptr;
+
+        if (!io_context)
+        {
+            av_free(buffer);
+            cleanup();
+
+            return false;
+        }
+
+        format_context->pb = io_context;
+        format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+#ifdef QT_DEBUG
+    qDebug() << "MediaMuxer: writing" << path << "with" << codec->name;
+#endif
+
+    opened = true;
+
+    return true;
+}
+
+///
+/// \brief MediaMuxer::openAudio
+///
+/// Add the AAC stream; only possible before the header is written
+///
+/// \param sampleRate
+/// \param channels
+/// \param inputFormat
+///
+/// AVSampleFormat of the interleaved input
+///
+/// \return
+///
+bool MediaMuxer::openAudio(int sampleRate, int channels, int inputFormat)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+
+    audio_stream = codec ? avformat_new_stream(format_context, nullptr) : nullptr;
+    audio_codec = codec ? avcodec_alloc_context3(codec) : nullptr;
+
+    if (!audio_stream || !audio_codec)
+    {
+        return false;
+    }
+
+    audio_codec->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    audio_codec->sample_rate = sampleRate;
+#ifdef HAVE_CH_LAYOUT
+    av_channel_layout_default(&audio_codec->ch_layout, channels);
+#else
+    audio_codec->channels = channels;
+    audio_codec->channel_layout = av_get_default_channel_layout(channels);
+#endif
+    audio_codec->bit_rate = 64000 * channels;
+    audio_codec->time_base = AVRational{1, sampleRate};
+
+    if (format_context->oformat->flags & AVFMT_GLOBALHEADER)
+    {
+        audio_codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    if (avcodec_open2(audio_codec, codec, nullptr) < 0 ||
+            avcodec_parameters_from_context(audio_stream->codecpar, audio_codec) < 0)
+    {
+        return false;
+    }
+
+    audio_stream->time_base = audio_codec->time_base;
+
+#ifdef HAVE_CH_LAYOUT
+    // frees and clears swr_context on failure
+    swr_alloc_set_opts2(&swr_context,
+                        &audio_codec->ch_layout, audio_codec->sample_fmt, sampleRate,
+                        &audio_codec->ch_layout, static_cast<AVSampleFormat>(inputFormat), sampleRate,
+                        0, nullptr);
+#else
+    swr_context = swr_alloc_set_opts(nullptr,
+                                     audio_codec->channel_layout, audio_codec->sample_fmt, sampleRate,
+                                     audio_codec->channel_layout, static_cast<AVSampleFormat>(inputFormat), sampleRate,
+                                     0, nullptr);
+#endif
+
+    if (!swr_context || swr_init(swr_context) < 0)
+    {
+        return false;
+    }
+
+    int frameSize = audio_codec->frame_size > 0 ? audio_codec->frame_size : 1024;
+
+    audio_fifo = av_audio_fifo_alloc(audio_codec->sample_fmt, channels, frameSize * 4);
+
+    audio_frame = av_frame_alloc();
+    audio_frame->nb_samples = frameSize;
+    audio_frame->format = audio_codec->sample_fmt;
+#ifdef HAVE_CH_LAYOUT
+    av_channel_layout_copy(&audio_frame->ch_layout, &audio_codec->ch_layout);
+#else
+    audio_frame->channel_layout = audio_codec->channel_layout;
+#endif
+    audio_frame->sample_rate = sampleRate;
+
+    if (!audio_fifo || av_frame_get_buffer(audio_frame, 0) < 0)
+    {
+        return false;
+    }
+
+    audio_input_format = inputFormat;
+
+    return true;
+}
+
+///
+/// \brief MediaMuxer::writeVideo
+///
+/// Encode one BGR frame, placed on the timeline by its capture time
+///
+/// \param bgr
+/// \param captureUs
+///
+/// SessionClock capture time; the first frame is time zero
+///
+/// \return
+///
+bool MediaMuxer::writeVideo(const cv::Mat &bgr, qint64 captureUs)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!opened || bgr.empty() || bgr.type() != CV_8UC3 ||
+            bgr.cols < video_codec->width || bgr.rows < video_codec->height)
+    {
+        return false;
+    }
+
+    if (first_video_us < 0)
+    {
+        first_video_us = captureUs;
+    }
+
+    qint64 pts = llround((captureUs - first_video_us) * frames_per_second / 1000000.0);
+
+    if (pts <= last_video_pts)
+    {
+        // two captures landed in one frame slot
+        pts = last_video_pts + 1;
+    }
+
+    if (av_frame_make_writable(video_frame) < 0)
+    {
+        return false;
+    }
+
+    const quint8 *srcData[1] = { bgr.data };
+    const int srcStride[1] = { static_cast<int>(bgr.step) };
+
+    sws_scale(sws_context, srcData, srcStride, 0, video_codec->height,
+              video_frame->data, video_frame->linesize);
+
+    video_frame->pts = pts;
+    last_video_pts = pts;
+
+    bool ok = encode(video_codec, video_stream, video_frame);
+
+    video_frames++;
+
+    // give up waiting for audio after a second of video
+    if (!header_written && !audio_codec && video_frames >= frames_per_second)
+    {
+        writeHeader();
+    }
+
+    return ok;
+}
+
+///
+/// \brief MediaMuxer::writeAudio
+///
+/// Append interleaved PCM; the first call fixes the audio format
+///
+/// \param data
+/// \param frames
+///
+/// Sample frames (samples per channel)
+///
+/// \param sampleRate
+/// \param channels
+/// \param bytesPerSample
+/// \param isFloat
+/// \param arrivalUs
+///
+/// When the buffer was captured (SessionClock), not when it is written
+///
+/// \return
+///
+bool MediaMuxer::writeAudio(const void *data, int frames, int sampleRate, int channels, int bytesPerSample, bool isFloat, qint64 arrivalUs)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!opened || frames <= 0 || sampleRate <= 0 || channels <= 0)
+    {
+        return false;
+    }
+
+    AVSampleFormat inputFormat = AV_SAMPLE_FMT_NONE;
+
+    if (isFloat && bytesPerSample == 4)
+    {
+        inputFormat = AV_SAMPLE_FMT_FLT;
+    }
+    else if (!isFloat)
+    {
+        inputFormat = bytesPerSample == 1 ? AV_SAMPLE_FMT_U8 :
+                      bytesPerSample == 2 ? AV_SAMPLE_FMT_S16 :
+                      bytesPerSample == 4 ? AV_SAMPLE_FMT_S32 :
+                                            AV_SAMPLE_FMT_NONE;
+    }
+
+    if (inputFormat == AV_SAMPLE_FMT_NONE)
+    {
+        return false;
+    }
+
+    if (!audio_codec)
+    {
+        if (header_written)
+        {
+            // already committed to a video-only file
+            return false;
+        }
+
+        if (!openAudio(sampleRate, channels, inputFormat))
+        {
+#ifdef QT_DEBUG
+            qDebug() << "MediaMuxer: no AAC encoder, writing video only";
+#endif
+
+            writeHeader();
+
+            return false;
+        }
+
+        writeHeader();
+    }
+
+    if (!swr_context || inputFormat != audio_input_format ||
+            sampleRate != audio_codec->sample_rate || channels != channelCount(audio_codec))
+    {
+        return false;
+    }
+
+    audio_clock.addBuffer(arrivalUs, frames, sampleRate);
+
+    compensateDrift();
+
+    // compensation may add a few samples
+    int capacity = qMax(frames, swr_get_out_samples(swr_context, frames));
+
+    if (capacity > converted_capacity)
+    {
+        if (converted)
+        {
+            av_freep(&converted[0]);
+            av_freep(&converted);
+        }
+
+        if (av_samples_alloc_array_and_samples(&converted, nullptr, channels, capacity, audio_codec->sample_fmt, 0) < 0)
+        {
+            converted = nullptr;
+            converted_capacity = 0;
+
+            return false;
+        }
+
+        converted_capacity = capacity;
+    }
+
+    const quint8 *input[1] = { static_cast<const quint8*>(data) };
+
+    int out = swr_convert(swr_context, converted, converted_capacity, input, frames);
+
+    if (out <= 0 || av_audio_fifo_write(audio_fifo, reinterpret_cast<void**>(converted), out) < out)
+    {
+        return false;
+    }
+
+    encodeQueuedAudio(false);
+
+    return true;
+}
+
+///
+/// \brief MediaMuxer::encodeQueuedAudio
+///
+/// Feed whole encoder frames from the FIFO
+///
+/// \param flush
+///
+/// Also send the final partial frame
+///
+void MediaMuxer::encodeQueuedAudio(bool flush)
+{
+    // audio is placed relative to the first video frame, so it waits for one
+    if (audio_anchor_us < 0)
+    {
+        if (first_video_us < 0 && !flush)
+        {
+            return;
+        }
+
+        placeAudio();
+    }
+
+    if (audio_skip > 0)
+    {
+        int n = static_cast<int>(qMin(audio_skip, qint64(av_audio_fifo_size(audio_fifo))));
+
+        av_audio_fifo_drain(audio_fifo, n);
+        audio_skip -= n;
+    }
+
+    int frameSize = audio_frame->nb_samples;
+
+    while (av_audio_fifo_size(audio_fifo) >= frameSize ||
+           (flush && av_audio_fifo_size(audio_fifo) > 0))
+    {
+        if (av_frame_make_writable(audio_frame) < 0)
+        {
+            return;
+        }
+
+        int n = av_audio_fifo_read(audio_fifo, reinterpret_cast<void**>(audio_frame->data), frameSize);
+
+        if (n <= 0)
+        {
+            return;
+        }
+
+        audio_frame->nb_samples = n;
+        audio_frame->pts = audio_samples;
+        audio_samples += n;
+
+        encode(audio_codec, audio_stream, audio_frame);
+
+        audio_frame->nb_samples = frameSize;
+    }
+}
+
+///
+/// \brief MediaMuxer::placeAudio
+///
+/// Start offset between the streams: audio captured before the first video
+/// frame is dropped, audio starting later begins at a later pts
+///
+void MediaMuxer::placeAudio()
+{
+    audio_anchor_us = audio_clock.isValid() ? audio_clock.startUs() : first_video_us;
+
+    qint64 offsetUs = first_video_us < 0 ? 0 : audio_anchor_us - first_video_us;
+    qint64 offset = llround(offsetUs * audio_codec->sample_rate / 1000000.0);
+
+    audio_samples = qMax(offset, qint64(0));
+    audio_skip = qMax(-offset, qint64(0));
+    compensation_until = audio_samples;
+
+#ifdef QT_DEBUG
+    qDebug() << "MediaMuxer: audio starts" << offsetUs / 1000 << "ms from the first video frame";
+#endif
+}
+
+///
+/// \brief MediaMuxer::compensateDrift
+///
+/// Keep the audio within a few milliseconds of the session clock by
+/// stretching or squeezing it slightly (at most 1%) in the resampler
+///
+void MediaMuxer::compensateDrift()
+{
+    if (audio_anchor_us < 0 || !audio_clock.isValid() || audio_samples < compensation_until)
+    {
+        return;
+    }
+
+    const int rate = audio_codec->sample_rate;
+
+    // a better start estimate than the one placed against also counts
+    qint64 targetUs = audio_clock.driftUs() + audio_clock.startUs() - audio_anchor_us;
+    qint64 delta = llround(targetUs * rate / 1000000.0) - compensated_samples;
+
+    // clocks don't disagree by 1%; that is a gap (pause, stall), not drift
+    if (qAbs(targetUs) * 100 > audio_clock.frames() * 1000000 / rate)
+    {
+        return;
+    }
+
+    if (qAbs(delta) < rate / 200)
+    {
+        return;
+    }
+
+    delta = qBound(qint64(-rate / 50), delta, qint64(rate / 50));
+
+    if (swr_set_compensation(swr_context, static_cast<int>(delta), rate * 2) < 0)
+    {
+        return;
+    }
+
+    compensated_samples += delta;
+    compensation_until = audio_samples + rate * 2;
+
+#ifdef QT_DEBUG
+    qDebug() << "MediaMuxer: audio drift" << targetUs / 1000 << "ms, compensating" << delta << "samples";
+#endif
+}
+
+///
+/// \brief MediaMuxer::encode
+///
+/// Send one frame (or nullptr to flush) and write whatever comes out
+///
+/// \param codec
+/// \param stream
+/// \param frame
+/// \return
+///
+bool MediaMuxer::encode(AVCodecContext *codec, AVStream *stream, AVFrame *frame)
+{
+    if (avcodec_send_frame(codec, frame) < 0)
+    {
+        return false;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+
+    while (avcodec_receive_packet(codec, packet) == 0)
+    {
+        packet->stream_index = stream->index;
+
+        writePacket(packet);
+    }
+
+    av_packet_free(&packet);
+
+    return true;
+}
+
+///
+/// \brief MediaMuxer::writePacket
+///
+/// Packets arrive in codec time base; they are held back until the header
+/// fixes each stream's time base
+///
+/// \param packet
+///
+void MediaMuxer::writePacket(AVPacket *packet)
+{
+    if (!header_written)
+    {
+        pending.append(av_packet_clone(packet));
+        av_packet_unref(packet);
+
+        return;
+    }
+
+    bool isVideo = packet->stream_index == video_stream->index;
+    bool fragmentBoundary = isVideo && (packet->flags & AV_PKT_FLAG_KEY) && fragment_seconds > 0;
+
+    av_packet_rescale_ts(packet,
+                         isVideo ? video_codec->time_base : audio_codec->time_base,
+                         isVideo ? video_stream->time_base : audio_stream->time_base);
+
+    // takes ownership of the packet's data
+    av_interleaved_write_frame(format_context, packet);
+
+    if (fragmentBoundary && format_context->pb)
+    {
+        // hand the finished fragment to the disk writer, which syncs it
+        // if the fsync policy asks for that
+        avio_flush(format_context->pb);
+        disk_writer.syncPoint();
+    }
+}
+
+///
+/// \brief MediaMuxer::writeHeader
+///
+void MediaMuxer::writeHeader()
+{
+    if (header_written)
+    {
+        return;
+    }
+
+    AVDictionary *options = nullptr;
+
+    if (fragment_seconds > 0)
+    {
+        // moov up front, then one self-contained moof/mdat per keyframe;
+        // ignored by containers other than mp4/mov
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+
+    if (avformat_write_header(format_context, &options) < 0)
+    {
+#ifdef QT_DEBUG
+        qDebug() << "MediaMuxer: failed to write header";
+#endif
+    }
+
+    av_dict_free(&options);
+
+    header_written = true;
+
+    foreach (AVPacket *packet, pending)
+    {
+        writePacket(packet);
+        av_packet_free(&packet);
+    }
+
+    pending.clear();
+}
+
+///
+/// \brief MediaMuxer::close
+///
+/// Flush both encoders and finalize the container
+///
+void MediaMuxer::close()
+{
+    QMutexLocker locker(&mutex);
+
+    if (!opened)
+    {
+        return;
+    }
+
+    writeHeader();
+
+    if (audio_codec && audio_fifo)
+    {
+        // the resampler holds a few samples back once it is compensating
+        if (swr_context && converted)
+        {
+            int out = swr_convert(swr_context, converted, converted_capacity, nullptr, 0);
+
+            if (out > 0)
+            {
+                av_audio_fifo_write(audio_fifo, reinterpret_cast<void**>(converted), out);
+            }
+        }
+
+        encodeQueuedAudio(true);
+        encode(audio_codec, audio_stream, nullptr);
+    }
+
+    encode(video_codec, video_stream, nullptr);
+
+    av_write_trailer(format_context);
+
+#ifdef QT_DEBUG
+    qDebug() << "MediaMuxer: closed after" << video_frames << "frames," << audio_samples << "audio samples";
+#endif
+
+    cleanup();
+}
+
+///
+/// \brief MediaMuxer::cleanup
+///
+void MediaMuxer::cleanup()
+{
+    foreach (AVPacket *packet, pending)
+    {
+        av_packet_free(&packet);
+    }
+
+    pending.clear();
+
+    if (converted)
+    {
+        av_freep(&converted[0]);
+        av_freep(&converted);
+    }
+
+    converted_capacity = 0;
+
+    av_audio_fifo_free(audio_fifo);
+    audio_fifo = nullptr;
+
+    swr_free(&swr_context);
+    sws_freeContext(sws_context);
+    sws_context = nullptr;
+
+    av_frame_free(&audio_frame);
+    av_frame_free(&video_frame);
+
+    avcodec_free_context(&audio_codec);
+    avcodec_free_context(&video_codec);
+
+    if (io_context)
+    {
+        avio_flush(io_context);
+
+        av_freep(&io_context->buffer);
+        avio_context_free(&io_context);
+    }
+
+    if (format_context)
+    {
+        // custom I/O: the context does not own pb
+        format_context->pb = nullptr;
+
+        avformat_free_context(format_context);
+        format_context = nullptr;
+    }
+
+    // drains the queue, syncs and closes; the file is complete after this
+    disk_writer.close();
+
+    video_stream = nullptr;
+    audio_stream = nullptr;
+
+    header_written = false;
+    opened = false;
+}
+
+#endif // USE_LIBAV
@@ -0,0 +1,171 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef MEDIAMUXER_H
+#define MEDIAMUXER_H
+
+#include <QMutex>
+#include <QString>
+#include <QList>
+
+#include "opencv2/core/core.hpp"
+
+#include "audioclock.h"
+#include "diskwriter.h"
+
+struct AVFormatContext;
+struct AVIOContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVFrame;
+struct AVPacket;
+struct AVAudioFifo;
+struct SwsContext;
+struct SwrContext;
+
+///
+/// \brief The MediaMuxer class
+///
+/// Encodes video (H.264) and audio (AAC) in-process and muxes them straight
+/// into the final container, so the file is complete once recording stops.
+///
+/// Video and audio are both written from the encode stage thread (audio
+/// arrives there through EncodeStage's queue, stamped with its capture
+/// time); every call is serialized on one mutex. The audio stream is declared when
+/// the first audio buffer arrives (its format is only known then); if none
+/// arrives within a second of video the file is written video-only.
+///
+/// Both streams sit on the SessionClock: video by capture time, audio by
+/// the start time AudioClock measures, so the offset between them is kept
+/// instead of starting both at zero. Drift between the audio device clock
+/// and the session clock is resampled away in small steps.
+///
+/// MP4/MOV output is fragmented on every keyframe (fragmentSeconds apart),
+/// so closing only has to finish the last fragment and a crash loses at
+/// most that fragment.
+///
+/// Container bytes go through a DiskWriter, so a stalling disk holds up its
+/// own I/O thread instead of the encoder.
+///
+/// Without USE_LIBAV (CONFIG += libav) open() always fails, and callers fall
+/// back to VideoWriter plus an external ffmpeg mux.
+///
+class MediaMuxer
+{
+public:
+    MediaMuxer();
+    ~MediaMuxer();
+
+    static bool isAvailable();
+
+    void setFragmentSeconds(int seconds);
+
+    DiskWriter& diskWriter() { return disk_writer; }
+    const DiskWriter& diskWriter() const { return disk_writer; }
+
+    bool open(const QString &path, cv::Size size, int fps, bool compress);
+    void close();
+
+    bool isOpen();
+
+    bool writeVideo(const cv::Mat &bgr, qint64 captureUs);
+    bool writeAudio(const void *data, int frames, int sampleRate, int channels, int bytesPerSample, bool isFloat, qint64 arrivalUs);
+
+private:
+#ifdef USE_LIBAV
+    bool openAudio(int sampleRate, int channels, int inputFormat);
+    bool encode(AVCodecContext *codec, AVStream *stream, AVFrame *frame);
+    void writePacket(AVPacket *packet);
+    void writeHeader();
+    void encodeQueuedAudio(bool flush);
+    void placeAudio();
+    void compensateDrift();
+    void cleanup();
+
+    // AVIOContext callbacks
+    friend struct MediaMuxerIo;
+
+    AVFormatContext *format_context = nullptr;
+
+    // custom I/O into disk_writer
+    AVIOContext *io_context = nullptr;
+    qint64 io_position = 0;
+
+    AVCodecContext *video_codec = nullptr;
+    AVStream *video_stream = nullptr;
+    AVFrame *video_frame = nullptr;
+    SwsContext *sws_context = nullptr;
+
+    AVCodecContext *audio_codec = nullptr;
+    AVStream *audio_stream = nullptr;
+    AVFrame *audio_frame = nullptr;
+    SwrContext *swr_context = nullptr;
+    AVAudioFifo *audio_fifo = nullptr;
+
+    // resampler output, grown on demand
+    quint8 **converted = nullptr;
+    int converted_capacity = 0;
+
+    int audio_input_format = -1;
+
+    // encoded before the header could be written (codec time base)
+    QList<AVPacket*> pending;
+
+    bool header_written = false;
+#endif
+
+    QMutex mutex;
+
+    DiskWriter disk_writer;
+
+    bool opened = false;
+
+    int frames_per_second = 15;
+
+    // keyframe/fragment interval; 0 writes a classic (moov at end) file
+    int fragment_seconds = 2;
+
+    qint64 first_video_us = -1;
+    qint64 last_video_pts = -1;
+    qint64 video_frames = 0;
+    qint64 audio_samples = 0;
+
+    // audio arrival times on the SessionClock
+    AudioClock audio_clock;
+
+    // AudioClock::startUs() when the audio was placed against the video; -1 = not yet
+    qint64 audio_anchor_us = -1;
+
+    // leading samples captured before the first video frame
+    qint64 audio_skip = 0;
+
+    // samples added (or removed, < 0) by drift compensation so far
+    qint64 compensated_samples = 0;
+    qint64 compensation_until = 0;
+};
+
+#endif // MEDIAMUXER_H
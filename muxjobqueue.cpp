@@ -0,0 +1,356 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QTimer>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "muxjobqueue.h"
+
+///
+/// \brief MuxJobQueue::MuxJobQueue
+///
+/// Picks up jobs left over from a previous run
+///
+/// \param parent
+///
+MuxJobQueue::MuxJobQueue(QObject *parent) : QObject(parent)
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("AvRecorder"));
+
+    concurrency = qMax(1, settings.value(QLatin1String("muxConcurrency"), 1).toInt());
+
+    settings.endGroup();
+
+    load();
+
+    // once the owner has connected to our signals
+    QTimer::singleShot(0, this, SLOT(startJobs()));
+}
+
+///
+/// \brief MuxJobQueue::~MuxJobQueue
+///
+/// Running jobs are killed but stay in the persisted queue for next time
+///
+MuxJobQueue::~MuxJobQueue()
+{
+    QList<QProcess*> processes = running.keys();
+
+    foreach (QProcess *process, processes)
+    {
+        process->disconnect(this);
+        process->kill();
+        process->waitForFinished(1000);
+    }
+}
+
+///
+/// \brief MuxJobQueue::setConcurrency
+/// \param jobs
+///
+void MuxJobQueue::setConcurrency(int jobs)
+{
+    concurrency = qMax(1, jobs);
+
+    startJobs();
+}
+
+///
+/// \brief MuxJobQueue::enqueue
+/// \param job
+/// \return
+///
+/// Job id, as reported by the signals
+///
+int MuxJobQueue::enqueue(MuxJob job)
+{
+    job.id = next_id++;
+
+    queued.append(job);
+
+    save();
+
+    emit queueChanged(pending());
+
+    startJobs();
+
+    return job.id;
+}
+
+///
+/// \brief MuxJobQueue::startJobs
+///
+/// Fill free worker slots from the head of the queue
+///
+void MuxJobQueue::startJobs()
+{
+    while (running.count() < concurrency && !queued.isEmpty())
+    {
+        MuxJob job = queued.takeFirst();
+
+        QDir().mkpath(QFileInfo(job.output).absolutePath());
+
+        QProcess *process = new QProcess(this);
+        process->setWorkingDirectory(job.workspace);
+
+        connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(readProgress()));
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(processFinished(int,QProcess::ExitStatus)));
+        connect(process, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(processFailed(QProcess::ProcessError)));
+
+        // machine-readable progress on stdout, no interactive stats on stderr
+        QStringList arguments;
+        arguments << "-nostats" << "-progress" << "pipe:1" << job.arguments;
+
+        running.insert(process, job);
+
+#ifdef _WIN32
+        process->setCreateProcessArgumentsModifier([](QProcess::CreateProcessArguments *args)
+        {
+            args->flags |= BELOW_NORMAL_PRIORITY_CLASS;
+        });
+
+        process->start(job.program, arguments);
+#else
+        // stay out of the way of the capture threads
+        process->start(QLatin1String("nice"), QStringList() << "-n" << "10" << job.program << arguments);
+#endif
+
+#ifdef QT_DEBUG
+        qDebug() << "MuxJobQueue: started job" << job.id << job.program << arguments;
+#endif
+
+        emit jobStarted(job.id, job.output);
+    }
+}
+
+///
+/// \brief MuxJobQueue::readProgress
+///
+/// Parse ffmpeg's -progress key=value output
+///
+void MuxJobQueue::readProgress()
+{
+    QProcess *process = qobject_cast<QProcess*>(sender());
+
+    if (!process || !running.contains(process))
+    {
+        return;
+    }
+
+    const MuxJob &job = running[process];
+
+    while (process->canReadLine())
+    {
+        QString line = QString::fromLatin1(process->readLine()).trimmed();
+
+        // out_time_ms is in microseconds, despite the name
+        if (line.startsWith(QLatin1String("out_time_ms=")) && job.durationMs > 0)
+        {
+            qint64 doneMs = line.mid(12).toLongLong() / 1000;
+
+            emit jobProgress(job.id, qBound(0, int(doneMs * 100 / job.durationMs), 100));
+        }
+    }
+}
+
+///
+/// \brief MuxJobQueue::processFinished
+/// \param exitCode
+/// \param status
+///
+void MuxJobQueue::processFinished(int exitCode, QProcess::ExitStatus status)
+{
+    QProcess *process = qobject_cast<QProcess*>(sender());
+
+    finishJob(process, status == QProcess::NormalExit && exitCode == 0);
+}
+
+///
+/// \brief MuxJobQueue::processFailed
+///
+/// Only FailedToStart never reaches finished()
+///
+/// \param error
+///
+void MuxJobQueue::processFailed(QProcess::ProcessError error)
+{
+    if (error == QProcess::FailedToStart)
+    {
+        finishJob(qobject_cast<QProcess*>(sender()), false);
+    }
+}
+
+///
+/// \brief MuxJobQueue::finishJob
+///
+/// A failed job's workspace is kept so the recording can be recovered by hand
+///
+/// \param process
+/// \param ok
+///
+void MuxJobQueue::finishJob(QProcess *process, bool ok)
+{
+    if (!process || !running.contains(process))
+    {
+        return;
+    }
+
+    MuxJob job = running.take(process);
+
+    process->deleteLater();
+
+#ifdef QT_DEBUG
+    qDebug() << "MuxJobQueue: job" << job.id << (ok ? "done" : "failed") << job.output;
+#endif
+
+    if (ok && !workspaceInUse(job.workspace))
+    {
+        removeWorkspace(job.workspace);
+    }
+
+    save();
+
+    emit jobFinished(job.id, job.output, ok);
+    emit queueChanged(pending());
+
+    startJobs();
+}
+
+///
+/// \brief MuxJobQueue::workspaceInUse
+/// \param workspace
+/// \return
+///
+bool MuxJobQueue::workspaceInUse(const QString &workspace) const
+{
+    foreach (const MuxJob &job, queued)
+    {
+        if (job.workspace == workspace)
+        {
+            return true;
+        }
+    }
+
+    foreach (const MuxJob &job, running)
+    {
+        if (job.workspace == workspace)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+///
+/// \brief MuxJobQueue::removeWorkspace
+/// \param workspace
+///
+void MuxJobQueue::removeWorkspace(const QString &workspace)
+{
+    if (workspace.isEmpty())
+    {
+        return;
+    }
+
+    QDir(workspace).removeRecursively();
+}
+
+///
+/// \brief MuxJobQueue::load
+///
+void MuxJobQueue::load()
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("MuxJobQueue"));
+
+    int count = settings.beginReadArray(QLatin1String("jobs"));
+
+    for (int i = 0; i < count; ++i)
+    {
+        settings.setArrayIndex(i);
+
+        MuxJob job;
+        job.id = next_id++;
+        job.workspace = settings.value(QLatin1String("workspace")).toString();
+        job.program = settings.value(QLatin1String("program")).toString();
+        job.arguments = settings.value(QLatin1String("arguments")).toStringList();
+        job.output = settings.value(QLatin1String("output")).toString();
+        job.durationMs = settings.value(QLatin1String("durationMs")).toLongLong();
+
+        // sources are gone (e.g. cleaned temp folder): nothing to redo
+        if (QDir(job.workspace).exists())
+        {
+            queued.append(job);
+        }
+    }
+
+    settings.endArray();
+    settings.endGroup();
+}
+
+///
+/// \brief MuxJobQueue::save
+///
+/// Persist running and queued jobs, running ones first
+///
+void MuxJobQueue::save()
+{
+    QList<MuxJob> jobs = running.values() + queued;
+
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("MuxJobQueue"));
+
+    settings.remove(QLatin1String("jobs"));
+    settings.beginWriteArray(QLatin1String("jobs"), jobs.count());
+
+    for (int i = 0; i < jobs.count(); ++i)
+    {
+        settings.setArrayIndex(i);
+
+        settings.setValue(QLatin1String("workspace"), jobs.at(i).workspace);
+        settings.setValue(QLatin1String("program"), jobs.at(i).program);
+        settings.setValue(QLatin1String("arguments"), jobs.at(i).arguments);
+        settings.setValue(QLatin1String("output"), jobs.at(i).output);
+        settings.setValue(QLatin1String("durationMs"), jobs.at(i).durationMs);
+    }
+
+    settings.endArray();
+    settings.endGroup();
+    settings.sync();
+}
@@ -0,0 +1,127 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef MUXJOBQUEUE_H
+#define MUXJOBQUEUE_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+
+#include "audioclock.h"
+
+///
+/// \brief The MuxJob struct
+///
+/// One ffmpeg run over files in a session workspace
+///
+struct MuxJob
+{
+    int id = 0;
+
+    // per-session temporary directory; removed once its last job succeeds
+    QString workspace;
+
+    QString program;
+    QStringList arguments;
+
+    QString output;
+
+    // recorded length, for progress
+    qint64 durationMs = 0;
+};
+
+///
+/// \brief The PendingMuxJob struct
+///
+/// A job waiting for its camera to release the temporary file; the
+/// arguments are built from that file's final timing
+///
+struct PendingMuxJob
+{
+    MuxJob job;
+
+    QString videoFile;
+    AudioClock audio;
+    bool compress = false;
+};
+
+///
+/// \brief The MuxJobQueue class
+///
+/// Persistent queue of post-processing jobs. Up to a configurable number
+/// run at once, at reduced CPU priority, so recording the next session never
+/// waits on (or competes with) muxing the last one. Jobs survive a restart:
+/// anything unfinished is loaded from settings and run again.
+///
+class MuxJobQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MuxJobQueue(QObject *parent = 0);
+    ~MuxJobQueue();
+
+    int enqueue(MuxJob job);
+
+    void setConcurrency(int jobs);
+
+    int pending() const { return queued.count() + running.count(); }
+
+    static void removeWorkspace(const QString &workspace);
+
+signals:
+    void jobStarted(int id, const QString &output);
+    void jobProgress(int id, int percent);
+    void jobFinished(int id, const QString &output, bool ok);
+    void queueChanged(int pending);
+
+private slots:
+    void startJobs();
+    void readProgress();
+    void processFinished(int exitCode, QProcess::ExitStatus status);
+    void processFailed(QProcess::ProcessError error);
+
+private:
+    void finishJob(QProcess *process, bool ok);
+
+    bool workspaceInUse(const QString &workspace) const;
+
+    void load();
+    void save();
+
+    QList<MuxJob> queued;
+    QHash<QProcess*, MuxJob> running;
+
+    int concurrency = 1;
+    int next_id = 1;
+};
+
+#endif // MUXJOBQUEUE_H
@@ -0,0 +1,333 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QMutexLocker>
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include "prerollbuffer.h"
+
+///
+/// \brief PrerollBuffer::PrerollBuffer
+///
+/// Disabled until configured
+///
+PrerollBuffer::PrerollBuffer() :
+    preroll_us(0),
+    max_bytes(0),
+    total_bytes(0),
+    draining(false),
+    evicted(0),
+    dropped(0)
+{
+
+}
+
+///
+/// \brief PrerollBuffer::configure
+///
+/// \param seconds
+///
+/// Length of pre-roll kept while idle; 0 disables
+///
+/// \param maxBytes
+///
+/// Hard cap on compressed size, oldest frames go first
+///
+/// \param jpegQuality
+///
+void PrerollBuffer::configure(int seconds, qint64 maxBytes, int jpegQuality)
+{
+    QMutexLocker locker(&mutex);
+
+    preroll_us = qint64(qMax(0, seconds)) * 1000000;
+    max_bytes = qMax(qint64(0), maxBytes);
+
+    encode_params.clear();
+    encode_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    encode_params.push_back(qBound(10, jpegQuality, 100));
+
+    if (preroll_us == 0)
+    {
+        frames.clear();
+        total_bytes = 0;
+        draining = false;
+    }
+}
+
+///
+/// \brief PrerollBuffer::encode
+///
+/// Compression runs outside the lock
+///
+/// \param frame
+/// \param out
+/// \return
+///
+bool PrerollBuffer::encode(const cv::Mat &frame, PrerollFrame &out)
+{
+    std::vector<int> params;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        params = encode_params;
+    }
+
+    return !frame.empty() && cv::imencode(".jpg", frame, out.data, params);
+}
+
+///
+/// \brief PrerollBuffer::append
+///
+/// Caller holds the lock
+///
+/// \param frame
+///
+void PrerollBuffer::append(PrerollFrame &frame)
+{
+    total_bytes += frame.data.size();
+    frames.push_back(PrerollFrame());
+    frames.back().data.swap(frame.data);
+    frames.back().capture_us = frame.capture_us;
+    frames.back().timestamp = frame.timestamp;
+
+    // neither limit applies while draining: the backlog already belongs to
+    // the recording and must be kept whole
+    if (draining)
+    {
+        return;
+    }
+
+    while (!frames.empty() &&
+           ((max_bytes > 0 && total_bytes > max_bytes) ||
+            frame.capture_us - frames.front().capture_us > preroll_us))
+    {
+        if (max_bytes > 0 && total_bytes > max_bytes)
+        {
+            evicted++;
+        }
+
+        total_bytes -= frames.front().data.size();
+        frames.pop_front();
+    }
+}
+
+///
+/// \brief PrerollBuffer::push
+///
+/// Keep a frame while not recording
+///
+/// \param frame
+/// \param captureUs
+/// \param timestamp
+///
+void PrerollBuffer::push(const cv::Mat &frame, qint64 captureUs, qint64 timestamp)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    PrerollFrame item;
+    item.capture_us = captureUs;
+    item.timestamp = timestamp;
+
+    if (!encode(frame, item))
+    {
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    append(item);
+}
+
+///
+/// \brief PrerollBuffer::pushIfDraining
+///
+/// While the encoder is still catching up, queue behind the backlog
+///
+/// \param frame
+/// \param captureUs
+/// \param timestamp
+/// \return
+///
+/// false if the caller should hand the frame to the encoder itself; true
+/// also when the frame could not be compressed and was dropped
+///
+bool PrerollBuffer::pushIfDraining(const cv::Mat &frame, qint64 captureUs, qint64 timestamp)
+{
+    {
+        QMutexLocker locker(&mutex);
+
+        if (!draining)
+        {
+            return false;
+        }
+    }
+
+    PrerollFrame item;
+    item.capture_us = captureUs;
+    item.timestamp = timestamp;
+
+    bool encoded = encode(frame, item);
+
+    QMutexLocker locker(&mutex);
+
+    // not handed to the encoder either: it would overtake the backlog
+    if (!encoded)
+    {
+        dropped++;
+
+        return true;
+    }
+
+    // only this thread pushes, and draining only ends once the ring is
+    // empty, which cannot happen before this frame is in it
+    append(item);
+
+    return true;
+}
+
+///
+/// \brief PrerollBuffer::startDraining
+///
+void PrerollBuffer::startDraining()
+{
+    QMutexLocker locker(&mutex);
+
+    draining = !frames.empty();
+}
+
+///
+/// \brief PrerollBuffer::isDraining
+/// \return
+///
+bool PrerollBuffer::isDraining()
+{
+    QMutexLocker locker(&mutex);
+
+    return draining;
+}
+
+///
+/// \brief PrerollBuffer::takeChunk
+///
+/// Remove up to maxFrames of the oldest frames. Taking from an empty ring
+/// ends draining, in the same critical section, so no frame can slip in
+/// behind the last chunk.
+///
+/// \param chunk
+/// \param maxFrames
+/// \return
+///
+/// false once there is nothing left
+///
+bool PrerollBuffer::takeChunk(std::vector<PrerollFrame> &chunk, int maxFrames)
+{
+    chunk.clear();
+
+    QMutexLocker locker(&mutex);
+
+    if (frames.empty())
+    {
+        draining = false;
+
+        return false;
+    }
+
+    while (!frames.empty() && int(chunk.size()) < maxFrames)
+    {
+        total_bytes -= frames.front().data.size();
+
+        chunk.push_back(PrerollFrame());
+        chunk.back().data.swap(frames.front().data);
+        chunk.back().capture_us = frames.front().capture_us;
+        chunk.back().timestamp = frames.front().timestamp;
+
+        frames.pop_front();
+    }
+
+    return true;
+}
+
+///
+/// \brief PrerollBuffer::clear
+///
+void PrerollBuffer::clear()
+{
+    QMutexLocker locker(&mutex);
+
+    frames.clear();
+    total_bytes = 0;
+    draining = false;
+}
+
+///
+/// \brief PrerollBuffer::bytes
+/// \return
+///
+qint64 PrerollBuffer::bytes()
+{
+    QMutexLocker locker(&mutex);
+
+    return total_bytes;
+}
+
+///
+/// \brief PrerollBuffer::count
+/// \return
+///
+int PrerollBuffer::count()
+{
+    QMutexLocker locker(&mutex);
+
+    return int(frames.size());
+}
+
+///
+/// \brief PrerollBuffer::evictedFrames
+/// \return
+///
+quint64 PrerollBuffer::evictedFrames()
+{
+    QMutexLocker locker(&mutex);
+
+    return evicted;
+}
+
+///
+/// \brief PrerollBuffer::droppedFrames
+/// \return
+///
+quint64 PrerollBuffer::droppedFrames()
+{
+    QMutexLocker locker(&mutex);
+
+    return dropped;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef PREROLLBUFFER_H
+#define PREROLLBUFFER_H
+
+#include <QMutex>
+#include <QtGlobal>
+
+#include <deque>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+///
+/// \brief The PrerollFrame struct
+///
+struct PrerollFrame
+{
+    // JPEG
+    std::vector<uchar> data;
+
+    qint64 capture_us = 0;
+    qint64 timestamp = 0;
+};
+
+///
+/// \brief The PrerollBuffer class
+///
+/// Bounded ring of the last few seconds of (overlaid) frames, JPEG
+/// compressed so that minutes of pre-roll fit in tens of megabytes.
+///
+/// When recording starts the ring switches to draining: the encoder empties
+/// it in order while newly captured frames keep being appended behind, so
+/// the writer catches up without ever stalling capture. Nothing is evicted
+/// while draining, so memory may exceed the cap until the writer catches up.
+/// Once it runs dry the ring leaves draining mode and frames go to the
+/// encoder directly again.
+///
+class PrerollBuffer
+{
+public:
+    PrerollBuffer();
+
+    void configure(int seconds, qint64 maxBytes, int jpegQuality);
+
+    bool isEnabled() const { return preroll_us > 0; }
+
+    void push(const cv::Mat &frame, qint64 captureUs, qint64 timestamp);
+    bool pushIfDraining(const cv::Mat &frame, qint64 captureUs, qint64 timestamp);
+
+    void startDraining();
+    bool isDraining();
+    bool takeChunk(std::vector<PrerollFrame> &chunk, int maxFrames);
+
+    void clear();
+
+    qint64 bytes();
+    int count();
+    quint64 evictedFrames();
+    quint64 droppedFrames();
+
+private:
+    bool encode(const cv::Mat &frame, PrerollFrame &out);
+    void append(PrerollFrame &frame);
+
+    QMutex mutex;
+
+    std::deque<PrerollFrame> frames;
+
+    qint64 preroll_us;
+    qint64 max_bytes;
+    qint64 total_bytes;
+
+    std::vector<int> encode_params;
+
+    bool draining;
+
+    // dropped by the memory cap (not by age)
+    quint64 evicted;
+
+    // recorded frames that could not be compressed
+    quint64 dropped;
+};
+
+#endif // PREROLLBUFFER_H
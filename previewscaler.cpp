@@ -0,0 +1,192 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <cmath>
+
+#include "previewscaler.h"
+
+///
+/// \brief buildTable
+///
+/// Center-aligned source coordinate for each target index, in 8-bit fixed point
+///
+/// \param source
+/// \param target
+/// \param index
+/// \param weight
+///
+static void buildTable(int source, int target, QVector<int> &index, QVector<quint16> &weight)
+{
+    index.resize(target);
+    weight.resize(target);
+
+    const double ratio = double(source) / double(target);
+
+    for (int i = 0; i < target; ++i)
+    {
+        double pos = (i + 0.5) * ratio - 0.5;
+
+        if (pos < 0.0)
+        {
+            pos = 0.0;
+        }
+
+        int base = static_cast<int>(std::floor(pos));
+
+        if (base >= source - 1)
+        {
+            base = source - 1;
+            pos = base;
+        }
+
+        index[i] = base;
+        weight[i] = static_cast<quint16>(std::lround((pos - base) * 256.0));
+    }
+}
+
+///
+/// \brief PreviewScaler::PreviewScaler
+///
+PreviewScaler::PreviewScaler()
+{
+
+}
+
+///
+/// \brief PreviewScaler::fitInside
+///
+/// Largest size with the source aspect ratio that fits the bounds
+///
+/// \param source
+/// \param bounds
+/// \return
+///
+cv::Size PreviewScaler::fitInside(cv::Size source, cv::Size bounds)
+{
+    if (source.width <= 0 || source.height <= 0 || bounds.width <= 0 || bounds.height <= 0)
+    {
+        return cv::Size(0, 0);
+    }
+
+    // never upscale: the GUI can stretch cheaper than we can
+    bounds.width = qMin(bounds.width, source.width);
+    bounds.height = qMin(bounds.height, source.height);
+
+    if (qint64(bounds.width) * source.height <= qint64(bounds.height) * source.width)
+    {
+        return cv::Size(bounds.width, qMax(1, int(qint64(bounds.width) * source.height / source.width)));
+    }
+
+    return cv::Size(qMax(1, int(qint64(bounds.height) * source.width / source.height)), bounds.height);
+}
+
+///
+/// \brief PreviewScaler::configure
+///
+/// \param source
+/// \param target
+///
+void PreviewScaler::configure(cv::Size source, cv::Size target)
+{
+    if (source == src_size && target == dst_size)
+    {
+        return;
+    }
+
+    src_size = source;
+    dst_size = target;
+
+    buildTable(source.width, target.width, x_offset, x_weight);
+    buildTable(source.height, target.height, y_index, y_weight);
+
+    // byte offsets into the (3 channel) row buffer
+    for (int i = 0; i < x_offset.size(); ++i)
+    {
+        x_offset[i] *= 3;
+    }
+
+    row.resize((source.width + 1) * 3);
+}
+
+///
+/// \brief PreviewScaler::scale
+///
+/// \param bgr
+///
+/// CV_8UC3 source of sourceSize()
+///
+/// \param dst
+///
+/// First scanline of a Format_RGB32 image of targetSize()
+///
+/// \param dstStride
+///
+void PreviewScaler::scale(const cv::Mat &bgr, uchar *dst, int dstStride)
+{
+    const int srcRowBytes = src_size.width * 3;
+    const int lastRow = src_size.height - 1;
+
+    quint16 *blend = row.data();
+
+    for (int y = 0; y < dst_size.height; ++y)
+    {
+        const int y0 = y_index.at(y);
+        const int y1 = qMin(y0 + 1, lastRow);
+        const quint16 wy = y_weight.at(y);
+        const quint16 wy0 = 256 - wy;
+
+        const uchar *top = bgr.ptr<uchar>(y0);
+        const uchar *bottom = bgr.ptr<uchar>(y1);
+
+        // vertical pass: contiguous and branch free, so the compiler vectorizes it
+        for (int i = 0; i < srcRowBytes; ++i)
+        {
+            blend[i] = static_cast<quint16>(top[i] * wy0 + bottom[i] * wy);
+        }
+
+        // pad one pixel so the right-hand sample never reads past the row
+        blend[srcRowBytes + 0] = blend[srcRowBytes - 3];
+        blend[srcRowBytes + 1] = blend[srcRowBytes - 2];
+        blend[srcRowBytes + 2] = blend[srcRowBytes - 1];
+
+        // horizontal pass + swizzle, packed as 0xffRRGGBB
+        quint32 *out = reinterpret_cast<quint32*>(dst + qint64(y) * dstStride);
+
+        for (int x = 0; x < dst_size.width; ++x)
+        {
+            const quint16 *p = blend + x_offset.at(x);
+            const quint32 wx = x_weight.at(x);
+            const quint32 wx0 = 256 - wx;
+
+            const quint32 b = (p[0] * wx0 + p[3] * wx) >> 16;
+            const quint32 g = (p[1] * wx0 + p[4] * wx) >> 16;
+            const quint32 r = (p[2] * wx0 + p[5] * wx) >> 16;
+
+            out[x] = 0xff000000u | (r << 16) | (g << 8) | b;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef PREVIEWSCALER_H
+#define PREVIEWSCALER_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include "opencv2/core/core.hpp"
+
+///
+/// \brief The PreviewScaler class
+///
+/// Fused bilinear downscale + BGR -> RGB32 swizzle for the viewfinder.
+/// Each output row is produced in one pass: the two source rows are blended
+/// vertically into a small fixed-point row buffer (a straight, vectorizable
+/// loop), then sampled horizontally and packed as 0xffRRGGBB straight into
+/// the destination image. Coordinate tables are rebuilt only on resize.
+///
+class PreviewScaler
+{
+public:
+    PreviewScaler();
+
+    void configure(cv::Size source, cv::Size target);
+
+    cv::Size sourceSize() const { return src_size; }
+    cv::Size targetSize() const { return dst_size; }
+
+    void scale(const cv::Mat &bgr, uchar *dst, int dstStride);
+
+    static cv::Size fitInside(cv::Size source, cv::Size bounds);
+
+private:
+    cv::Size src_size;
+    cv::Size dst_size;
+
+    // per output column: byte offset of left sample, weight of right sample (0..256)
+    QVector<int> x_offset;
+    QVector<quint16> x_weight;
+
+    // per output row: top source row, weight of bottom row (0..256)
+    QVector<int> y_index;
+    QVector<quint16> y_weight;
+
+    // vertically blended source row, one pixel of padding on the right
+    QVector<quint16> row;
+};
+
+#endif // PREVIEWSCALER_H
@@ -0,0 +1,100 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QPainter>
+#include <QResizeEvent>
+
+#include "previewwidget.h"
+
+///
+/// \brief PreviewWidget::PreviewWidget
+/// \param parent
+///
+PreviewWidget::PreviewWidget(QWidget *parent) : QLabel(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+///
+/// \brief PreviewWidget::setImage
+/// \param img
+///
+void PreviewWidget::setImage(const QImage &img)
+{
+    image = img;
+
+    update();
+}
+
+///
+/// \brief PreviewWidget::imageArea
+///
+/// Space available for the image, inside the frame
+///
+/// \return
+///
+QSize PreviewWidget::imageArea() const
+{
+    return contentsRect().size();
+}
+
+///
+/// \brief PreviewWidget::paintEvent
+/// \param event
+///
+void PreviewWidget::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+
+    QRect area = contentsRect();
+
+    painter.fillRect(area, Qt::black);
+
+    if (!image.isNull())
+    {
+        QRect target(QPoint(0, 0), image.size().scaled(area.size(), Qt::KeepAspectRatio));
+        target.moveCenter(area.center());
+
+        painter.drawImage(target, image);
+    }
+
+    painter.end();
+
+    // frame (box) on top
+    QFrame::paintEvent(event);
+}
+
+///
+/// \brief PreviewWidget::resizeEvent
+/// \param event
+///
+void PreviewWidget::resizeEvent(QResizeEvent *event)
+{
+    QLabel::resizeEvent(event);
+
+    emit sizeChanged(imageArea());
+}
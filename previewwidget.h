@@ -0,0 +1,63 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef PREVIEWWIDGET_H
+#define PREVIEWWIDGET_H
+
+#include <QLabel>
+#include <QImage>
+
+///
+/// \brief The PreviewWidget class
+///
+/// Viewfinder that paints the camera image as delivered. Frames arrive
+/// already scaled to fit and in the raster engine's native RGB32 format,
+/// so painting is a plain blit.
+///
+class PreviewWidget : public QLabel
+{
+    Q_OBJECT
+
+public:
+    explicit PreviewWidget(QWidget *parent = 0);
+
+    void setImage(const QImage &img);
+
+    QSize imageArea() const;
+
+signals:
+    void sizeChanged(QSize);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+
+private:
+    QImage image;
+};
+
+#endif // PREVIEWWIDGET_H
@@ -90,7 +90,11 @@
 #include "qaudiolevel.h"
 #include <QPainter>
 
-QAudioLevel::QAudioLevel(QWidget *parent) : QWidget(parent), m_level(0.0)
+// full scale per second
+static const qreal FallRate = 1.5;
+static const qint64 HoldMs = 1500;
+
+QAudioLevel::QAudioLevel(QWidget *parent) : QWidget(parent), m_level(0.0), m_rms(0.0), m_hold(0.0)
 {
     setMinimumHeight(15);
     setMaximumHeight(50);
@@ -105,12 +109,61 @@ void QAudioLevel::setLevel(qreal level)
     }
 }
 
+void QAudioLevel::updateLevels(qreal peak, qreal rms, bool fresh)
+{
+    qreal seconds = m_tickTimer.isValid() ? m_tickTimer.restart() / 1000.0 : 0.0;
+    if (!m_tickTimer.isValid())
+        m_tickTimer.start();
+
+    qreal fall = FallRate * seconds;
+
+    // bar jumps up and falls back smoothly
+    qreal level = qMax(m_level - fall, qreal(0.0));
+    qreal rmsLevel = qMax(m_rms - fall, qreal(0.0));
+    if (fresh)
+    {
+        level = qMax(level, qMin(peak, qreal(1.0)));
+        rmsLevel = qMax(rmsLevel, qMin(rms, qreal(1.0)));
+    }
+
+    // hold line stays at the last peak for a while, then falls
+    qreal hold = m_hold;
+    if (level >= hold)
+    {
+        hold = level;
+        m_holdTimer.start();
+    }
+    else if (!m_holdTimer.isValid() || m_holdTimer.elapsed() > HoldMs)
+    {
+        hold = qMax(hold - fall, level);
+    }
+
+    // repaint only when a pixel moves
+    int w = width();
+    bool changed = int(level * w) != int(m_level * w)
+            || int(rmsLevel * w) != int(m_rms * w)
+            || int(hold * w) != int(m_hold * w);
+
+    m_level = level;
+    m_rms = rmsLevel;
+    m_hold = hold;
+
+    if (changed)
+        update();
+}
+
 void QAudioLevel::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
 
     QPainter painter(this);
     qreal widthLevel = m_level * width();
-    painter.fillRect(0, 0, widthLevel, height(), Qt::red);
+    qreal widthRms = qMin(m_rms, m_level) * width();
+    qreal widthHold = m_hold * width();
+    painter.fillRect(0, 0, widthRms, height(), Qt::darkRed);
+    painter.fillRect(widthRms, 0, widthLevel - widthRms, height(), Qt::red);
     painter.fillRect(widthLevel, 0, width(), height(), Qt::black);
+
+    if (widthHold > 0)
+        painter.fillRect(qMax(widthHold - 2, qreal(0)), 0, 2, height(), m_hold >= 0.999 ? Qt::white : Qt::yellow);
 }
@@ -91,6 +91,7 @@
 #define QAUDIOLEVEL_H
 
 #include <QWidget>
+#include <QElapsedTimer>
 
 class QAudioLevel : public QWidget
 {
@@ -99,11 +100,19 @@ public:
     explicit QAudioLevel(QWidget *parent = 0);
     void setLevel(qreal level);
 
+    // one display tick; fresh is false when no audio arrived since the last one
+    void updateLevels(qreal peak, qreal rms, bool fresh);
+
 protected:
     void paintEvent(QPaintEvent *event);
 
 private:
     qreal m_level;
+    qreal m_rms;
+    qreal m_hold;
+
+    QElapsedTimer m_holdTimer;
+    QElapsedTimer m_tickTimer;
 };
 
 #endif // QAUDIOLEVEL_H
@@ -0,0 +1,641 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "recordingcatalog.h"
+
+#include <algorithm>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMetaObject>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThread>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+///
+/// \brief CatalogWorker::CatalogWorker
+/// \param parent
+///
+CatalogWorker::CatalogWorker(QObject *parent) : QObject(parent)
+{
+
+}
+
+///
+/// \brief CatalogWorker::parseFileName
+///
+/// Recover the session fields from <output>/<id>/<treatment>/<session>-<condition>[-camN].<ext>
+///
+/// \param path
+/// \param entry
+/// \return
+///
+bool CatalogWorker::parseFileName(const QString &path, CatalogEntry &entry)
+{
+    static const QRegularExpression pattern(QStringLiteral("^(\\d+)-(.*?)(?:-cam(\\d+))?$"));
+
+    QFileInfo info(path);
+    QRegularExpressionMatch match = pattern.match(info.completeBaseName());
+
+    if (!match.hasMatch())
+    {
+        return false;
+    }
+
+    QDir treatmentDir = info.dir();
+    QDir idDir = treatmentDir;
+
+    if (!idDir.cdUp())
+    {
+        return false;
+    }
+
+    entry.path = QDir::cleanPath(info.absoluteFilePath());
+    entry.id = idDir.dirName();
+    entry.treatment = treatmentDir.dirName();
+    entry.session = match.captured(1).toInt();
+    entry.condition = match.captured(2);
+    entry.camera = match.captured(3).toInt();
+
+    return true;
+}
+
+///
+/// \brief CatalogWorker::verify
+/// \param path
+///
+void CatalogWorker::verify(const QString &path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        emit verified(path, -1, QString());
+        return;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&file);
+
+    emit verified(path, file.size(), QString::fromLatin1(hash.result().toHex()));
+}
+
+///
+/// \brief CatalogWorker::import
+/// \param directory
+/// \param extensions
+///
+/// Without the dot, e.g. "avi"
+///
+void CatalogWorker::import(const QString &directory, const QStringList &extensions)
+{
+    QStringList filters;
+    foreach (const QString &ext, extensions)
+    {
+        filters << QString("*.%1").arg(ext);
+    }
+
+    QDir root(directory);
+
+    foreach (const QString &id, root.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        QDir idDir(root.filePath(id));
+
+        foreach (const QString &treatment, idDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            QDir treatmentDir(idDir.filePath(treatment));
+
+            foreach (const QFileInfo &file, treatmentDir.entryInfoList(filters, QDir::Files))
+            {
+                CatalogEntry entry;
+
+                if (!parseFileName(file.absoluteFilePath(), entry))
+                {
+                    continue;
+                }
+
+                entry.recorded = file.lastModified();
+                entry.size = file.size();
+
+                emit found(entry);
+            }
+        }
+    }
+
+    emit importFinished(directory);
+}
+
+///
+/// \brief RecordingCatalog::RecordingCatalog
+/// \param parent
+///
+RecordingCatalog::RecordingCatalog(QObject *parent) : QObject(parent)
+{
+    qRegisterMetaType<CatalogEntry>("CatalogEntry");
+
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dataDir);
+    journal_path = dataDir + "/catalog.jsonl";
+
+    load();
+
+    worker_thread = new QThread(this);
+    worker = new CatalogWorker;
+    worker->moveToThread(worker_thread);
+    connect(worker_thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    connect(worker, SIGNAL(verified(QString,qint64,QString)), this, SLOT(setVerified(QString,qint64,QString)));
+    connect(worker, SIGNAL(found(CatalogEntry)), this, SLOT(fileFound(CatalogEntry)));
+    connect(worker, SIGNAL(importFinished(QString)), this, SLOT(directoryImported(QString)));
+    worker_thread->start(QThread::LowPriority);
+}
+
+///
+/// \brief RecordingCatalog::~RecordingCatalog
+///
+RecordingCatalog::~RecordingCatalog()
+{
+    worker_thread->quit();
+    worker_thread->wait();
+}
+
+///
+/// \brief RecordingCatalog::addRecording
+///
+/// Replaces any entry for the same file
+///
+/// \param entry
+///
+void RecordingCatalog::addRecording(const CatalogEntry &entry)
+{
+    CatalogEntry added = entry;
+    added.path = QDir::cleanPath(entry.path);
+
+    insert(added);
+    append(added);
+
+    // closed before the session was catalogued
+    if (closed_files.remove(added.path))
+    {
+        verify(added.path);
+    }
+
+    emit changed();
+}
+
+///
+/// \brief RecordingCatalog::removeRecording
+/// \param file
+///
+void RecordingCatalog::removeRecording(const QString &file)
+{
+    QString path = QDir::cleanPath(file);
+
+    if (!entries.contains(path))
+    {
+        return;
+    }
+
+    CatalogEntry entry = entries.value(path);
+
+    erase(path);
+    append(entry, true);
+
+    emit changed();
+}
+
+///
+/// \brief RecordingCatalog::verify
+/// \param file
+///
+void RecordingCatalog::verify(const QString &file)
+{
+    QString path = QDir::cleanPath(file);
+
+    if (entries.contains(path))
+    {
+        QMetaObject::invokeMethod(worker, "verify", Qt::QueuedConnection, Q_ARG(QString, path));
+    }
+    else
+    {
+        closed_files.insert(path);
+    }
+}
+
+///
+/// \brief RecordingCatalog::importDirectory
+///
+/// Once per output directory; afterwards the catalog is kept up to date as
+/// recordings finish
+///
+/// \param directory
+/// \param extensions
+///
+void RecordingCatalog::importDirectory(const QString &directory, const QStringList &extensions)
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("RecordingCatalog"));
+
+    QStringList imported = settings.value(QLatin1String("importedDirectories")).toStringList();
+
+    settings.endGroup();
+
+    if (directory.isEmpty() || imported.contains(directory))
+    {
+        return;
+    }
+
+    QMetaObject::invokeMethod(worker, "import", Qt::QueuedConnection,
+                              Q_ARG(QString, directory), Q_ARG(QStringList, extensions));
+}
+
+///
+/// \brief RecordingCatalog::contains
+/// \param id
+/// \param treatment
+/// \param session
+/// \param condition
+/// \return
+///
+bool RecordingCatalog::contains(const QString &id, const QString &treatment, int session, const QString &condition) const
+{
+    return session_refs.contains(sessionKey(id, treatment, session, condition));
+}
+
+///
+/// \brief RecordingCatalog::nextSession
+/// \param id
+/// \param treatment
+/// \return
+///
+/// One past the highest recorded session, 1 if there is none
+///
+int RecordingCatalog::nextSession(const QString &id, const QString &treatment) const
+{
+    return last_session.value(participantKey(id, treatment), 0) + 1;
+}
+
+///
+/// \brief RecordingCatalog::search
+///
+/// Every whitespace-separated term must match one of the session fields
+///
+/// \param text
+/// \return
+///
+/// Newest first
+///
+QList<CatalogEntry> RecordingCatalog::search(const QString &text) const
+{
+    QStringList terms = text.split(QRegularExpression(QStringLiteral("\\s+")), QString::SkipEmptyParts);
+    QList<CatalogEntry> results;
+
+    foreach (const CatalogEntry &entry, entries)
+    {
+        QString fields = QString("%1 %2 %3 %4 %5").arg(entry.id)
+                .arg(entry.treatment)
+                .arg(entry.session)
+                .arg(entry.condition)
+                .arg(entry.recorded.toString("yyyy-MM-dd"));
+
+        bool match = true;
+
+        foreach (const QString &term, terms)
+        {
+            if (!fields.contains(term, Qt::CaseInsensitive))
+            {
+                match = false;
+                break;
+            }
+        }
+
+        if (match)
+        {
+            results << entry;
+        }
+    }
+
+    std::sort(results.begin(), results.end(), [](const CatalogEntry &a, const CatalogEntry &b) {
+        return a.recorded > b.recorded;
+    });
+
+    return results;
+}
+
+///
+/// \brief RecordingCatalog::setVerified
+/// \param file
+/// \param size
+/// \param checksum
+///
+void RecordingCatalog::setVerified(const QString &file, qint64 size, const QString &checksum)
+{
+    QString path = QDir::cleanPath(file);
+
+    if (!entries.contains(path) || size < 0)
+    {
+        return;
+    }
+
+    CatalogEntry &entry = entries[path];
+    entry.size = size;
+    entry.checksum = checksum;
+
+    append(entry);
+
+    emit changed();
+}
+
+///
+/// \brief RecordingCatalog::fileFound
+/// \param entry
+///
+void RecordingCatalog::fileFound(const CatalogEntry &entry)
+{
+    // anything recorded since is already known, in more detail
+    if (entries.contains(entry.path))
+    {
+        return;
+    }
+
+    insert(entry);
+    append(entry);
+
+    emit changed();
+}
+
+///
+/// \brief RecordingCatalog::directoryImported
+/// \param directory
+///
+void RecordingCatalog::directoryImported(const QString &directory)
+{
+    QSettings settings(QSettings::UserScope, QLatin1String("Session Recorder"));
+    settings.beginGroup(QLatin1String("RecordingCatalog"));
+
+    QStringList imported = settings.value(QLatin1String("importedDirectories")).toStringList();
+    imported << directory;
+    settings.setValue(QLatin1String("importedDirectories"), imported);
+
+    settings.endGroup();
+    settings.sync();
+
+#ifdef QT_DEBUG
+    qDebug() << "RecordingCatalog: imported" << directory << "," << entries.count() << "entries";
+#endif
+}
+
+///
+/// \brief RecordingCatalog::sessionKey
+/// \return
+///
+QString RecordingCatalog::sessionKey(const QString &id, const QString &treatment, int session, const QString &condition)
+{
+    return QString("%1/%2/%3-%4").arg(id).arg(treatment).arg(session).arg(condition).toUpper();
+}
+
+///
+/// \brief RecordingCatalog::participantKey
+/// \return
+///
+QString RecordingCatalog::participantKey(const QString &id, const QString &treatment)
+{
+    return QString("%1/%2").arg(id).arg(treatment).toUpper();
+}
+
+///
+/// \brief RecordingCatalog::insert
+/// \param entry
+///
+void RecordingCatalog::insert(const CatalogEntry &entry)
+{
+    QHash<QString, CatalogEntry>::iterator existing = entries.find(entry.path);
+
+    if (existing != entries.end())
+    {
+        // same file, same session: only the details change
+        if (sessionKey(existing->id, existing->treatment, existing->session, existing->condition) ==
+                sessionKey(entry.id, entry.treatment, entry.session, entry.condition))
+        {
+            *existing = entry;
+            return;
+        }
+
+        erase(entry.path);
+    }
+
+    entries.insert(entry.path, entry);
+    session_refs[sessionKey(entry.id, entry.treatment, entry.session, entry.condition)]++;
+
+    int &last = last_session[participantKey(entry.id, entry.treatment)];
+    last = qMax(last, entry.session);
+}
+
+///
+/// \brief RecordingCatalog::erase
+/// \param path
+///
+void RecordingCatalog::erase(const QString &path)
+{
+    if (!entries.contains(path))
+    {
+        return;
+    }
+
+    CatalogEntry entry = entries.take(path);
+
+    QString key = sessionKey(entry.id, entry.treatment, entry.session, entry.condition);
+
+    if (--session_refs[key] <= 0)
+    {
+        session_refs.remove(key);
+    }
+
+    QString participant = participantKey(entry.id, entry.treatment);
+
+    if (entry.session < last_session.value(participant))
+    {
+        return;
+    }
+
+    // rare: recount the highest session for this participant
+    int last = 0;
+    bool any = false;
+
+    foreach (const CatalogEntry &other, entries)
+    {
+        if (participantKey(other.id, other.treatment) == participant)
+        {
+            last = qMax(last, other.session);
+            any = true;
+        }
+    }
+
+    if (any)
+    {
+        last_session.insert(participant, last);
+    }
+    else
+    {
+        last_session.remove(participant);
+    }
+}
+
+///
+/// \brief RecordingCatalog::load
+///
+/// Replay the journal; later lines for a file replace earlier ones
+///
+void RecordingCatalog::load()
+{
+    QFile journal(journal_path);
+
+    if (!journal.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return;
+    }
+
+    int lines = 0;
+
+    while (!journal.atEnd())
+    {
+        QJsonObject object = QJsonDocument::fromJson(journal.readLine()).object();
+        lines++;
+
+        QString path = object.value(QLatin1String("path")).toString();
+
+        if (path.isEmpty())
+        {
+            continue;
+        }
+
+        if (object.value(QLatin1String("removed")).toBool())
+        {
+            erase(path);
+            continue;
+        }
+
+        CatalogEntry entry;
+        entry.path = path;
+        entry.id = object.value(QLatin1String("id")).toString();
+        entry.treatment = object.value(QLatin1String("treatment")).toString();
+        entry.session = object.value(QLatin1String("session")).toInt();
+        entry.condition = object.value(QLatin1String("condition")).toString();
+        entry.camera = object.value(QLatin1String("camera")).toInt();
+        entry.recorded = QDateTime::fromString(object.value(QLatin1String("recorded")).toString(), Qt::ISODate);
+        entry.durationMs = static_cast<qint64>(object.value(QLatin1String("durationMs")).toDouble());
+        entry.size = static_cast<qint64>(object.value(QLatin1String("size")).toDouble());
+        entry.checksum = object.value(QLatin1String("checksum")).toString();
+
+        insert(entry);
+    }
+
+    journal.close();
+
+    // mostly superseded lines
+    if (lines > 2 * entries.count() + 64)
+    {
+        compact();
+    }
+}
+
+///
+/// \brief RecordingCatalog::journalLine
+/// \param entry
+/// \param removed
+/// \return
+///
+QByteArray RecordingCatalog::journalLine(const CatalogEntry &entry, bool removed)
+{
+    QJsonObject object;
+    object.insert(QLatin1String("path"), entry.path);
+
+    if (removed)
+    {
+        object.insert(QLatin1String("removed"), true);
+    }
+    else
+    {
+        object.insert(QLatin1String("id"), entry.id);
+        object.insert(QLatin1String("treatment"), entry.treatment);
+        object.insert(QLatin1String("session"), entry.session);
+        object.insert(QLatin1String("condition"), entry.condition);
+        object.insert(QLatin1String("camera"), entry.camera);
+        object.insert(QLatin1String("recorded"), entry.recorded.toString(Qt::ISODate));
+        object.insert(QLatin1String("durationMs"), static_cast<double>(entry.durationMs));
+        object.insert(QLatin1String("size"), static_cast<double>(entry.size));
+        object.insert(QLatin1String("checksum"), entry.checksum);
+    }
+
+    return QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n";
+}
+
+///
+/// \brief RecordingCatalog::append
+/// \param entry
+/// \param removed
+///
+void RecordingCatalog::append(const CatalogEntry &entry, bool removed)
+{
+    QFile journal(journal_path);
+
+    if (journal.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        journal.write(journalLine(entry, removed));
+    }
+}
+
+///
+/// \brief RecordingCatalog::compact
+///
+/// Rewrite the journal with one line per file
+///
+void RecordingCatalog::compact()
+{
+    QSaveFile journal(journal_path);
+
+    if (!journal.open(QIODevice::WriteOnly))
+    {
+        return;
+    }
+
+    foreach (const CatalogEntry &entry, entries)
+    {
+        journal.write(journalLine(entry, false));
+    }
+
+    journal.commit();
+}
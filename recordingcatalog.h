@@ -0,0 +1,160 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef RECORDINGCATALOG_H
+#define RECORDINGCATALOG_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QThread;
+
+///
+/// \brief The CatalogEntry struct
+///
+/// One recorded file; cameras after the first are separate entries
+///
+struct CatalogEntry
+{
+    QString path;
+
+    QString id;
+    QString treatment;
+    int session = 0;
+    QString condition;
+    int camera = 0;
+
+    QDateTime recorded;
+    qint64 durationMs = 0;
+
+    // filled in once the file is complete; empty for imported files
+    qint64 size = 0;
+    QString checksum;
+};
+
+Q_DECLARE_METATYPE(CatalogEntry)
+
+///
+/// \brief The CatalogWorker class
+///
+/// File access for the catalog, on its own thread: checksums of finished
+/// recordings and the one-off import of an existing output tree
+///
+class CatalogWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CatalogWorker(QObject *parent = 0);
+
+    static bool parseFileName(const QString &path, CatalogEntry &entry);
+
+signals:
+    void verified(const QString &path, qint64 size, const QString &checksum);
+    void found(const CatalogEntry &entry);
+    void importFinished(const QString &directory);
+
+public slots:
+    void verify(const QString &path);
+    void import(const QString &directory, const QStringList &extensions);
+};
+
+///
+/// \brief The RecordingCatalog class
+///
+/// Local index of recordings, so overwrite checks, session numbering and
+/// the session list never probe the (often network) output directory.
+/// Lookups are hash based and in memory; changes are appended to a journal
+/// in the local application data folder, compacted when it is loaded.
+///
+class RecordingCatalog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RecordingCatalog(QObject *parent = 0);
+    ~RecordingCatalog();
+
+    void addRecording(const CatalogEntry &entry);
+    void removeRecording(const QString &path);
+
+    // one-off scan of recordings made before the catalog existed
+    void importDirectory(const QString &directory, const QStringList &extensions);
+
+    bool contains(const QString &id, const QString &treatment, int session, const QString &condition) const;
+    int nextSession(const QString &id, const QString &treatment) const;
+
+    QList<CatalogEntry> search(const QString &text) const;
+    int count() const { return entries.count(); }
+
+signals:
+    void changed();
+
+public slots:
+    // checksum and size of a finished file, off the GUI thread
+    void verify(const QString &path);
+
+    // checksum and size already known, e.g. from a verified delivery
+    void setVerified(const QString &path, qint64 size, const QString &checksum);
+
+private slots:
+    void fileFound(const CatalogEntry &entry);
+    void directoryImported(const QString &directory);
+
+private:
+    static QString sessionKey(const QString &id, const QString &treatment, int session, const QString &condition);
+    static QString participantKey(const QString &id, const QString &treatment);
+
+    void insert(const CatalogEntry &entry);
+    void erase(const QString &path);
+
+    static QByteArray journalLine(const CatalogEntry &entry, bool removed);
+
+    void load();
+    void append(const CatalogEntry &entry, bool removed = false);
+    void compact();
+
+    QHash<QString, CatalogEntry> entries;
+
+    // entries per id/treatment/session/condition, and highest session per id/treatment
+    QHash<QString, int> session_refs;
+    QHash<QString, int> last_session;
+
+    QSet<QString> closed_files;
+
+    QString journal_path;
+
+    QThread *worker_thread;
+    CatalogWorker *worker;
+};
+
+#endif // RECORDINGCATALOG_H
@@ -0,0 +1,83 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QDateTime>
+
+#include "sessionclock.h"
+
+///
+/// \brief SessionClock::originPair
+///
+/// Fixed on first use; thread safe (function-local static). The steady and
+/// wall clocks are read together so both describe the same instant
+///
+/// \return
+///
+const SessionClock::Origin &SessionClock::originPair()
+{
+    static const Origin start = { Clock::now(), QDateTime::currentMSecsSinceEpoch() };
+
+    return start;
+}
+
+///
+/// \brief SessionClock::origin
+/// \return
+///
+SessionClock::Clock::time_point SessionClock::origin()
+{
+    return originPair().steady;
+}
+
+///
+/// \brief SessionClock::elapsedMicroseconds
+/// \return
+///
+qint64 SessionClock::elapsedMicroseconds()
+{
+    return elapsedMicroseconds(Clock::now());
+}
+
+///
+/// \brief SessionClock::elapsedMicroseconds
+/// \param t
+/// \return
+///
+qint64 SessionClock::elapsedMicroseconds(Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - origin()).count();
+}
+
+///
+/// \brief SessionClock::toEpochMsecs
+/// \param elapsedUs
+/// \return
+///
+qint64 SessionClock::toEpochMsecs(qint64 elapsedUs)
+{
+    return originPair().epochMsecs + elapsedUs / 1000;
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef SESSIONCLOCK_H
+#define SESSIONCLOCK_H
+
+#include <QtGlobal>
+
+#include <chrono>
+
+///
+/// \brief The SessionClock class
+///
+/// One monotonic clock shared by every camera (and audio) in the process.
+/// Times are microseconds since the clock's origin; the wall-clock time at
+/// the origin is captured once so stamps can still be shown as dates
+/// without ever reading the (adjustable) wall clock again.
+///
+class SessionClock
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static Clock::time_point origin();
+
+    static qint64 elapsedMicroseconds();
+    static qint64 elapsedMicroseconds(Clock::time_point t);
+
+    static qint64 toEpochMsecs(qint64 elapsedUs);
+    static qint64 epochMsecs() { return toEpochMsecs(elapsedMicroseconds()); }
+
+private:
+    struct Origin
+    {
+        Clock::time_point steady;
+        qint64 epochMsecs;
+    };
+
+    static const Origin &originPair();
+};
+
+#endif // SESSIONCLOCK_H
@@ -0,0 +1,109 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "sessionlistdialog.h"
+#include "recordingcatalog.h"
+
+#include <QHeaderView>
+#include <QLineEdit>
+#include <QTableWidget>
+#include <QVBoxLayout>
+
+///
+/// \brief SessionListDialog::SessionListDialog
+/// \param catalog
+/// \param parent
+///
+SessionListDialog::SessionListDialog(RecordingCatalog *catalog, QWidget *parent) :
+    QDialog(parent),
+    catalog(catalog)
+{
+    setWindowTitle(tr("Recorded Sessions"));
+    resize(720, 400);
+
+    filter = new QLineEdit(this);
+    filter->setPlaceholderText(tr("Search id, treatment, session, condition or date"));
+    filter->setClearButtonEnabled(true);
+
+    table = new QTableWidget(this);
+    table->setColumnCount(8);
+    table->setHorizontalHeaderLabels(QStringList() << tr("Id") << tr("Treatment") << tr("Session")
+                                     << tr("Condition") << tr("Recorded") << tr("Duration")
+                                     << tr("Size (MB)") << tr("File"));
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->setVisible(false);
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->horizontalHeader()->setSortIndicator(4, Qt::DescendingOrder);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(filter);
+    layout->addWidget(table);
+
+    connect(filter, SIGNAL(textChanged(QString)), this, SLOT(refresh()));
+    connect(catalog, SIGNAL(changed()), this, SLOT(refresh()));
+
+    refresh();
+}
+
+///
+/// \brief SessionListDialog::refresh
+///
+void SessionListDialog::refresh()
+{
+    QList<CatalogEntry> entries = catalog->search(filter->text());
+
+    table->setSortingEnabled(false);
+    table->setRowCount(entries.count());
+
+    for (int row = 0; row < entries.count(); ++row)
+    {
+        const CatalogEntry &entry = entries.at(row);
+
+        QTableWidgetItem *session = new QTableWidgetItem;
+        session->setData(Qt::DisplayRole, entry.session);
+
+        QTableWidgetItem *file = new QTableWidgetItem(entry.path);
+        file->setToolTip(entry.checksum.isEmpty() ? entry.path :
+                                                    QString("%1\nSHA-256 %2").arg(entry.path).arg(entry.checksum));
+
+        table->setItem(row, 0, new QTableWidgetItem(entry.id));
+        table->setItem(row, 1, new QTableWidgetItem(entry.treatment));
+        table->setItem(row, 2, session);
+        table->setItem(row, 3, new QTableWidgetItem(entry.condition));
+        table->setItem(row, 4, new QTableWidgetItem(entry.recorded.toString("yyyy-MM-dd hh:mm")));
+        table->setItem(row, 5, new QTableWidgetItem(entry.durationMs > 0 ?
+                                                        QString("%1 min").arg(entry.durationMs / 60000.0, 0, 'f', 1) :
+                                                        QString()));
+        table->setItem(row, 6, new QTableWidgetItem(entry.size > 0 ?
+                                                        QString::number(entry.size / 1024 / 1024) :
+                                                        QString()));
+        table->setItem(row, 7, file);
+    }
+
+    table->setSortingEnabled(true);
+}
@@ -0,0 +1,58 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef SESSIONLISTDIALOG_H
+#define SESSIONLISTDIALOG_H
+
+#include <QDialog>
+
+class QLineEdit;
+class QTableWidget;
+class RecordingCatalog;
+
+///
+/// \brief The SessionListDialog class
+///
+/// Searchable list of catalogued recordings
+///
+class SessionListDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit SessionListDialog(RecordingCatalog *catalog, QWidget *parent = 0);
+
+public slots:
+    void refresh();
+
+private:
+    RecordingCatalog *catalog;
+
+    QLineEdit *filter;
+    QTableWidget *table;
+};
+
+#endif // SESSIONLISTDIALOG_H
@@ -0,0 +1,329 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "enums.h"
+
+///
+/// \brief The SpscRing class
+///
+/// Bounded single-producer/single-consumer ring over pre-allocated slots.
+/// head is only written by the producer and tail only by the consumer; each
+/// publishes with a release store the other side reads with acquire, which
+/// also hands over the slot contents, so pushing and popping take no lock.
+/// Indices run modulo twice the capacity, so full and empty differ.
+///
+/// A mutex and wait conditions are only touched by a side that has to
+/// sleep (consumer on an empty ring, NeverDrop producer on a full one) and
+/// by the other side when it sees a sleeper flagged.
+///
+/// DropPolicy decides what push() does on a full ring:
+///  - NeverDrop:  producer waits for a free slot (until close())
+///  - DropNewest: incoming item is discarded
+///  - LatestWins: oldest queued item is evicted to make room, and
+///                popLatest() lets the consumer skip straight to the newest.
+///                The producer then advances tail too, so taking is
+///                serialized by a mutex under this policy only; it is the
+///                preview ring, two slots at a preview frame rate.
+///
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(int capacity = 4, DropPolicy policy = NeverDrop) :
+        entries(qMax(1, capacity)),
+        head(0),
+        tail(0),
+        drop_policy(policy),
+        closed(0),
+        dropped(0),
+        consumer_waiting(0),
+        producer_waiting(0)
+    {
+    }
+
+    ///
+    /// \brief reset
+    ///
+    /// Resize and empty the ring. Only safe while neither side is running.
+    ///
+    void reset(int capacity, DropPolicy policy)
+    {
+        entries = QVector<T>(qMax(1, capacity));
+
+        head.storeRelease(0);
+        tail.storeRelease(0);
+        drop_policy = policy;
+        closed.storeRelease(0);
+        dropped.storeRelease(0);
+    }
+
+    ///
+    /// \brief push
+    ///
+    /// Producer side
+    ///
+    /// \return false if the item was dropped or the ring is closed; an
+    /// item evicted by LatestWins is counted as dropped, but push succeeds
+    ///
+    bool push(const T &item)
+    {
+        int h = head.load();
+
+        if (distance(h, tail.loadAcquire()) == entries.size())
+        {
+            if (drop_policy == NeverDrop)
+            {
+                if (!waitForRoom(h))
+                {
+                    return false;
+                }
+            }
+            else if (drop_policy == LatestWins)
+            {
+                if (closed.loadAcquire())
+                {
+                    return false;
+                }
+
+                // full: the consumer only wants the newest, so the oldest goes
+                QMutexLocker locker(&take_mutex);
+
+                int t = tail.load();
+
+                if (distance(h, t) == entries.size())
+                {
+                    entries[t % entries.size()] = T();
+                    tail.storeRelease(next(t));
+
+                    dropped.fetchAndAddRelaxed(1);
+                }
+            }
+            else
+            {
+                dropped.fetchAndAddRelaxed(1);
+                return false;
+            }
+        }
+
+        entries[h % entries.size()] = item;
+        head.storeRelease(next(h));
+
+        wake(consumer_waiting, not_empty);
+
+        return true;
+    }
+
+    ///
+    /// \brief pop
+    ///
+    /// Consumer side, waits up to timeoutMs for an item
+    ///
+    bool pop(T &item, int timeoutMs = 0)
+    {
+        if (take(item))
+        {
+            return true;
+        }
+
+        if (timeoutMs <= 0)
+        {
+            return false;
+        }
+
+        {
+            QMutexLocker locker(&wait_mutex);
+
+            consumer_waiting.storeRelease(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (head.loadAcquire() == tail.load() && !closed.loadAcquire())
+            {
+                not_empty.wait(&wait_mutex, timeoutMs);
+            }
+
+            consumer_waiting.storeRelease(0);
+        }
+
+        return take(item);
+    }
+
+    ///
+    /// \brief popLatest
+    ///
+    /// Consumer side, returns the newest item and discards older ones
+    ///
+    bool popLatest(T &item, int timeoutMs = 0)
+    {
+        if (!pop(item, timeoutMs))
+        {
+            return false;
+        }
+
+        while (take(item))
+        {
+            dropped.fetchAndAddRelaxed(1);
+        }
+
+        return true;
+    }
+
+    ///
+    /// \brief close
+    ///
+    /// Wakes both sides; a waiting push gives up
+    ///
+    void close()
+    {
+        closed.storeRelease(1);
+
+        QMutexLocker locker(&wait_mutex);
+
+        not_empty.wakeAll();
+        not_full.wakeAll();
+    }
+
+    bool isClosed() const { return closed.loadAcquire() != 0; }
+
+    int count() const { return distance(head.loadAcquire(), tail.loadAcquire()); }
+    int capacity() const { return entries.size(); }
+
+    DropPolicy policy() const { return drop_policy; }
+    quint64 droppedCount() const { return static_cast<quint64>(dropped.loadAcquire()); }
+
+private:
+    int next(int index) const { return (index + 1) % (2 * entries.size()); }
+
+    // items between tail and head
+    int distance(int h, int t) const { return (h - t + 2 * entries.size()) % (2 * entries.size()); }
+
+    ///
+    /// \brief take
+    ///
+    /// Consumer side, without waiting
+    ///
+    bool take(T &item)
+    {
+        // only LatestWins has a second taker (the producer, evicting)
+        QMutexLocker locker(drop_policy == LatestWins ? &take_mutex : nullptr);
+
+        int t = tail.load();
+
+        if (head.loadAcquire() == t)
+        {
+            return false;
+        }
+
+        item = entries[t % entries.size()];
+        entries[t % entries.size()] = T();
+        tail.storeRelease(next(t));
+
+        wake(producer_waiting, not_full);
+
+        return true;
+    }
+
+    ///
+    /// \brief waitForRoom
+    ///
+    /// NeverDrop producer on a full ring; false once closed
+    ///
+    bool waitForRoom(int h)
+    {
+        QMutexLocker locker(&wait_mutex);
+
+        producer_waiting.storeRelease(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (distance(h, tail.loadAcquire()) == entries.size())
+        {
+            if (closed.loadAcquire())
+            {
+                producer_waiting.storeRelease(0);
+                return false;
+            }
+
+            not_full.wait(&wait_mutex, 20);
+        }
+
+        producer_waiting.storeRelease(0);
+
+        return true;
+    }
+
+    ///
+    /// \brief wake
+    ///
+    /// After publishing an index: the fence pairs with the one a sleeper
+    /// issues after raising its flag, so either it sees the new index or
+    /// this sees the flag
+    ///
+    void wake(QAtomicInt &waiting, QWaitCondition &condition)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiting.loadAcquire())
+        {
+            QMutexLocker locker(&wait_mutex);
+
+            condition.wakeOne();
+        }
+    }
+
+    QVector<T> entries;
+
+    // 0 .. 2 * capacity - 1
+    QAtomicInt head;
+    QAtomicInt tail;
+
+    // LatestWins only: guards tail against the producer evicting
+    QMutex take_mutex;
+
+    DropPolicy drop_policy;
+
+    QAtomicInt closed;
+    QAtomicInt dropped;
+
+    // slow path only
+    QMutex wait_mutex;
+    QWaitCondition not_empty;
+    QWaitCondition not_full;
+    QAtomicInt consumer_waiting;
+    QAtomicInt producer_waiting;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,94 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "staticscenedetector.h"
+
+///
+/// \brief StaticSceneDetector::StaticSceneDetector
+///
+/// 160x120 luma in 8x8 blocks: a 20x15 grid, enough to notice a hand
+/// moving in a corner but blind to sensor noise
+///
+StaticSceneDetector::StaticSceneDetector() :
+    threshold(6.0),
+    last_score(0.0),
+    analysis_size(160, 120),
+    block_grid(20, 15)
+{
+
+}
+
+///
+/// \brief StaticSceneDetector::reset
+///
+/// Next frame becomes the reference (and is reported as changed)
+///
+void StaticSceneDetector::reset()
+{
+    reference.release();
+}
+
+///
+/// \brief StaticSceneDetector::isStatic
+/// \param bgr
+/// \return
+///
+bool StaticSceneDetector::isStatic(const cv::Mat &bgr)
+{
+    if (bgr.empty())
+    {
+        return false;
+    }
+
+    cv::resize(bgr, small, analysis_size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(small, luma, CV_BGR2GRAY);
+
+    if (reference.size() != luma.size())
+    {
+        luma.copyTo(reference);
+        last_score = 255.0;
+
+        return false;
+    }
+
+    cv::absdiff(luma, reference, difference);
+
+    // area resampling to the grid = mean difference per block
+    cv::resize(difference, blocks, block_grid, 0, 0, cv::INTER_AREA);
+    cv::minMaxLoc(blocks, nullptr, &last_score);
+
+    if (last_score < threshold)
+    {
+        return true;
+    }
+
+    cv::swap(reference, luma);
+
+    return false;
+}
@@ -0,0 +1,72 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef STATICSCENEDETECTOR_H
+#define STATICSCENEDETECTOR_H
+
+#include "opencv2/core/core.hpp"
+
+///
+/// \brief The StaticSceneDetector class
+///
+/// Flags frames that hardly differ from the last changed frame. Works on a
+/// small luma plane: absolute difference against a reference, averaged over
+/// blocks (all OpenCV-vectorized), and the frame counts as static when even
+/// the busiest block stays under the threshold. The reference only moves on
+/// a changed frame, so slow drift still trips the detector eventually.
+///
+class StaticSceneDetector
+{
+public:
+    StaticSceneDetector();
+
+    void setThreshold(double meanLumaDifference) { threshold = meanLumaDifference; }
+    double getThreshold() const { return threshold; }
+
+    bool isStatic(const cv::Mat &bgr);
+
+    void reset();
+
+    // busiest block of the last frame, mean absolute luma difference
+    double lastScore() const { return last_score; }
+
+private:
+    double threshold;
+    double last_score;
+
+    // analysis plane, and block grid laid over it
+    cv::Size analysis_size;
+    cv::Size block_grid;
+
+    cv::Mat small;
+    cv::Mat luma;
+    cv::Mat reference;
+    cv::Mat difference;
+    cv::Mat blocks;
+};
+
+#endif // STATICSCENEDETECTOR_H
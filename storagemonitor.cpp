@@ -0,0 +1,264 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include "storagemonitor.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QTimer>
+#include <QtMath>
+
+#ifdef QT_DEBUG
+#include <QDebug>
+#endif
+
+///
+/// \brief ThroughputEstimator::ThroughputEstimator
+/// \param smoothingSeconds
+///
+ThroughputEstimator::ThroughputEstimator(double smoothingSeconds) :
+    smoothing_seconds(qMax(1.0, smoothingSeconds))
+{
+
+}
+
+///
+/// \brief ThroughputEstimator::reset
+///
+/// Start over, e.g. for a new recording
+///
+void ThroughputEstimator::reset()
+{
+    last_bytes = -1;
+    last_ms = 0;
+    rate = 0.0;
+    has_rate = false;
+}
+
+///
+/// \brief ThroughputEstimator::addSample
+///
+/// Samples may arrive at any interval; older rates decay by elapsed time,
+/// not by sample count
+///
+/// \param totalBytes
+///
+/// Running total; only the difference between samples matters
+///
+/// \param elapsedMs
+///
+/// Monotonic time of the sample
+///
+void ThroughputEstimator::addSample(qint64 totalBytes, qint64 elapsedMs)
+{
+    if (last_bytes < 0 || totalBytes < last_bytes)
+    {
+        last_bytes = totalBytes;
+        last_ms = elapsedMs;
+        return;
+    }
+
+    double seconds = (elapsedMs - last_ms) / 1000.0;
+
+    if (seconds <= 0.0)
+    {
+        return;
+    }
+
+    double current = (totalBytes - last_bytes) / seconds;
+
+    if (has_rate)
+    {
+        rate += (1.0 - qExp(-seconds / smoothing_seconds)) * (current - rate);
+    }
+    else
+    {
+        rate = current;
+        has_rate = true;
+    }
+
+    last_bytes = totalBytes;
+    last_ms = elapsedMs;
+}
+
+///
+/// \brief ThroughputEstimator::secondsUntil
+///
+/// Time to write bytes more at the current rate
+///
+/// \param bytes
+/// \return
+///
+qint64 ThroughputEstimator::secondsUntil(qint64 bytes) const
+{
+    if (!has_rate || rate < 1.0)
+    {
+        return -1;
+    }
+
+    return qMax<qint64>(0, static_cast<qint64>(bytes / rate));
+}
+
+///
+/// \brief StorageMonitor::StorageMonitor
+/// \param intervalMs
+///
+StorageMonitor::StorageMonitor(int intervalMs) : QObject()
+{
+    // a child, so it follows the monitor to its thread
+    timer = new QTimer(this);
+    timer->setInterval(qMax(500, intervalMs));
+
+    connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+///
+/// \brief StorageMonitor::bytesAvailable
+/// \param volume
+/// \return
+///
+qint64 StorageMonitor::bytesAvailable(int volume) const
+{
+    QMutexLocker locker(&mutex);
+
+    return volume >= 0 && volume < available.count() ? available.at(volume) : -1;
+}
+
+///
+/// \brief StorageMonitor::rootPath
+/// \param volume
+/// \return
+///
+QString StorageMonitor::rootPath(int volume) const
+{
+    QMutexLocker locker(&mutex);
+
+    return volume >= 0 && volume < roots.count() ? roots.at(volume) : QString();
+}
+
+///
+/// \brief StorageMonitor::setPaths
+///
+/// Watch these; an empty path is a volume that is not configured
+///
+/// \param paths
+///
+void StorageMonitor::setPaths(const QStringList &paths)
+{
+    volume_paths = paths;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        available = QVector<qint64>(paths.count(), -1);
+        roots = QStringList();
+
+        for (int i = 0; i < paths.count(); i++)
+        {
+            roots << QString();
+        }
+    }
+
+    refresh();
+
+    timer->start();
+}
+
+///
+/// \brief StorageMonitor::refresh
+///
+void StorageMonitor::refresh()
+{
+    QVector<qint64> free(volume_paths.count(), -1);
+    QStringList mounts;
+
+    for (int i = 0; i < volume_paths.count(); i++)
+    {
+        QString path = existingPath(volume_paths.at(i));
+
+        if (path.isEmpty())
+        {
+            mounts << QString();
+            continue;
+        }
+
+        QStorageInfo storage(path);
+
+        if (storage.isValid() && storage.isReady())
+        {
+            free[i] = storage.bytesAvailable();
+        }
+
+        mounts << storage.rootPath();
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        available = free;
+        roots = mounts;
+    }
+
+#ifdef QT_DEBUG
+    qDebug() << "StorageMonitor: free bytes" << free << "on" << mounts;
+#endif
+
+    emit refreshed();
+}
+
+///
+/// \brief StorageMonitor::existingPath
+///
+/// path, or its nearest parent that exists
+///
+/// \param path
+/// \return
+///
+QString StorageMonitor::existingPath(const QString &path)
+{
+    if (path.isEmpty())
+    {
+        return QString();
+    }
+
+    QString current = QDir::cleanPath(QDir::fromNativeSeparators(path));
+
+    while (!QFileInfo::exists(current))
+    {
+        QString parent = QFileInfo(current).absolutePath();
+
+        if (parent == current)
+        {
+            return QString();
+        }
+
+        current = parent;
+    }
+
+    return current;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef STORAGEMONITOR_H
+#define STORAGEMONITOR_H
+
+#include <QObject>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+
+class QTimer;
+
+///
+/// \brief The ThroughputEstimator class
+///
+/// Write rate from a running byte counter, smoothed over about
+/// smoothingSeconds so a burst (a keyframe, a flushed fragment) does not
+/// swing the forecast
+///
+class ThroughputEstimator
+{
+public:
+    explicit ThroughputEstimator(double smoothingSeconds = 15.0);
+
+    void reset();
+    void addSample(qint64 totalBytes, qint64 elapsedMs);
+
+    double bytesPerSecond() const { return rate; }
+
+    // -1 while nothing is being written
+    qint64 secondsUntil(qint64 bytes) const;
+
+private:
+    double smoothing_seconds;
+
+    qint64 last_bytes = -1;
+    qint64 last_ms = 0;
+
+    double rate = 0.0;
+    bool has_rate = false;
+};
+
+///
+/// \brief The StorageMonitor class
+///
+/// Free space of a few volumes, queried every intervalMs on whatever thread
+/// the monitor lives on, so a slow or unreachable share never stalls the
+/// caller. Readers only ever see the cached values.
+///
+/// Volumes are addressed by their index in setPaths(); the paths need not
+/// exist yet, the nearest existing parent is queried instead.
+///
+class StorageMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StorageMonitor(int intervalMs = 5000);
+
+    // -1 until the first refresh, or if the volume cannot be queried
+    qint64 bytesAvailable(int volume) const;
+
+    // mount point, to tell whether two paths share a volume
+    QString rootPath(int volume) const;
+
+signals:
+    void refreshed();
+
+public slots:
+    void setPaths(const QStringList &paths);
+    void refresh();
+
+private:
+    static QString existingPath(const QString &path);
+
+    QTimer *timer;
+
+    mutable QMutex mutex;
+
+    QStringList volume_paths;
+    QVector<qint64> available;
+    QStringList roots;
+};
+
+#endif // STORAGEMONITOR_H
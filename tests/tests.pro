@@ -0,0 +1,32 @@
+# Session Recorder
+# Unit tests for the self-contained kernels (no camera, audio device or disk)
+#
+#   qmake tests/tests.pro && make check
+
+TARGET = SessionRecorderTests
+TEMPLATE = app
+
+QT       += core multimedia testlib
+QT       -= gui widgets
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+include(../common.pri)
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+    tst_kernels.cpp \
+    ../latencyhistogram.cpp \
+    ../audioclock.cpp \
+    ../audiometer.cpp \
+    ../storagemonitor.cpp
+
+HEADERS += \
+    ../latencyhistogram.h \
+    ../audioclock.h \
+    ../audiometer.h \
+    ../storagemonitor.h \
+    ../spscring.h \
+    ../enums.h
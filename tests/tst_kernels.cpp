@@ -0,0 +1,519 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QtTest>
+#include <QAudioFormat>
+#include <QSysInfo>
+
+#include <random>
+#include <vector>
+
+#include "audioclock.h"
+#include "audiometer.h"
+#include "latencyhistogram.h"
+#include "spscring.h"
+#include "storagemonitor.h"
+
+namespace
+{
+    QAudioFormat pcmFormat(QAudioFormat::SampleType type, int sampleSize, int channels)
+    {
+        QAudioFormat format;
+        format.setCodec("audio/pcm");
+        format.setSampleRate(48000);
+        format.setSampleType(type);
+        format.setSampleSize(sampleSize);
+        format.setChannelCount(channels);
+        format.setByteOrder(QAudioFormat::Endian(QSysInfo::ByteOrder));
+
+        return format;
+    }
+
+    // buffers of 480 frames at 48 kHz, from a device whose clock runs
+    // (1 + error) times slower than the session clock
+    void feedClock(AudioClock &clock, qint64 startUs, int buffers, double error)
+    {
+        for (int k = 1; k <= buffers; ++k)
+        {
+            clock.addBuffer(startUs + qRound64(k * 10000 * (1.0 + error)), 480, 48000);
+        }
+    }
+
+    ///
+    /// \brief compareWithReference
+    ///
+    /// Whichever kernel AudioMeter selects must agree with the generic
+    /// scalar template (Channels = 0)
+    ///
+    template <typename T>
+    void compareWithReference(const QAudioFormat &format, const std::vector<T> &samples, int frames)
+    {
+        AudioMeter meter;
+        AudioLevels levels;
+        AudioLevels reference;
+
+        QVERIFY(meter.measure(samples.data(), frames, format, levels));
+
+        measureLevels<T, 0>(samples.data(), frames, format.channelCount(), reference);
+
+        QCOMPARE(levels.channels, reference.channels);
+
+        // The vector kernels sum squares in a different order than the scalar
+        // loop, so rms is compared with a relative tolerance
+        for (int c = 0; c < reference.channels; ++c)
+        {
+            QVERIFY2(qAbs(levels.peak[c] - reference.peak[c]) <= 1e-6f, qPrintable(QString("peak, channel %1").arg(c)));
+            QVERIFY2(qAbs(levels.rms[c] - reference.rms[c]) <= 1e-3f * qMax(reference.rms[c], 1e-3f),
+                     qPrintable(QString("rms, channel %1").arg(c)));
+            QCOMPARE(levels.clips[c], reference.clips[c]);
+        }
+    }
+}
+
+///
+/// \brief The KernelTests class
+///
+/// Timing, queueing and metering kernels the pipeline depends on
+///
+class KernelTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void histogramSmallValuesAreExact();
+    void histogramBucketResolution_data();
+    void histogramBucketResolution();
+    void histogramClampsOutOfRange();
+    void histogramReset();
+
+    void ringNeverDropStopsWhenClosed();
+    void ringDropNewestKeepsOldest();
+    void ringLatestWinsEvictsOldest();
+    void ringPopLatestSkipsToNewest();
+
+    void throughputNeedsTwoSamples();
+    void throughputSteadyRate();
+    void throughputDecaysByElapsedTime();
+    void throughputSurvivesCounterRestart();
+
+    void audioClockStartIgnoresJitter();
+    void audioClockSlowDevice();
+    void audioClockFastDevice();
+    void audioClockSampleRateChange();
+
+    void meterInt16Kernels_data();
+    void meterInt16Kernels();
+    void meterFloatKernels_data();
+    void meterFloatKernels();
+    void meterInt16ClipCountDoesNotWrap();
+    void meterUnsignedIsCentred();
+    void meterRejectsUnsupportedFormats();
+};
+
+void KernelTests::histogramSmallValuesAreExact()
+{
+    LatencyHistogram histogram;
+
+    for (int i = 0; i < 32; ++i)
+    {
+        histogram.record(i);
+    }
+
+    QCOMPARE(histogram.percentile(50.0), qint64(15));
+    QCOMPARE(histogram.percentile(100.0), qint64(31));
+
+    LatencySummary summary = histogram.summary();
+    QCOMPARE(summary.count, quint64(32));
+    QCOMPARE(summary.max, qint64(31));
+}
+
+void KernelTests::histogramBucketResolution_data()
+{
+    QTest::addColumn<qint64>("value");
+
+    QTest::newRow("32") << qint64(32);
+    QTest::newRow("33") << qint64(33);
+    QTest::newRow("63") << qint64(63);
+    QTest::newRow("64") << qint64(64);
+    QTest::newRow("1000") << qint64(1000);
+    QTest::newRow("65535") << qint64(65535);
+    QTest::newRow("1000000") << qint64(1000000);
+    QTest::newRow("123456789") << qint64(123456789);
+}
+
+void KernelTests::histogramBucketResolution()
+{
+    QFETCH(qint64, value);
+
+    // the larger sample keeps the maximum from capping the answer
+    LatencyHistogram histogram;
+    histogram.record(value);
+    histogram.record(value * 2);
+
+    // the median is the top of value's bucket: never below, at most 1/32 above
+    qint64 median = histogram.percentile(50.0);
+
+    QVERIFY(median >= value);
+    QVERIFY(median - value <= value / 32);
+}
+
+void KernelTests::histogramClampsOutOfRange()
+{
+    LatencyHistogram histogram;
+
+    histogram.record(-5);
+    QCOMPARE(histogram.percentile(100.0), qint64(0));
+
+    // past the last magnitude: counted in the top bucket, maximum saturates
+    histogram.record(qint64(1) << 40);
+    QCOMPARE(histogram.percentile(100.0), qint64(0x7fffffff));
+    QCOMPARE(histogram.summary().max, qint64(0x7fffffff));
+}
+
+void KernelTests::histogramReset()
+{
+    LatencyHistogram histogram;
+
+    histogram.record(1234);
+    histogram.reset();
+
+    QCOMPARE(histogram.summary().count, quint64(0));
+    QCOMPARE(histogram.percentile(99.0), qint64(0));
+}
+
+void KernelTests::ringNeverDropStopsWhenClosed()
+{
+    SpscRing<int> ring(1, NeverDrop);
+    int item = 0;
+
+    QVERIFY(!ring.pop(item, 10));
+
+    QVERIFY(ring.push(1));
+
+    // full: push waits for the consumer, or gives up once closed
+    ring.close();
+    QVERIFY(!ring.push(2));
+
+    QVERIFY(ring.pop(item));
+    QCOMPARE(item, 1);
+    QCOMPARE(ring.droppedCount(), quint64(0));
+}
+
+void KernelTests::ringDropNewestKeepsOldest()
+{
+    SpscRing<int> ring(2, DropNewest);
+    int item = 0;
+
+    QVERIFY(ring.push(1));
+    QVERIFY(ring.push(2));
+    QVERIFY(!ring.push(3));
+
+    QCOMPARE(ring.droppedCount(), quint64(1));
+    QCOMPARE(ring.count(), 2);
+
+    QVERIFY(ring.pop(item));
+    QCOMPARE(item, 1);
+    QVERIFY(ring.pop(item));
+    QCOMPARE(item, 2);
+    QVERIFY(!ring.pop(item));
+}
+
+void KernelTests::ringLatestWinsEvictsOldest()
+{
+    SpscRing<int> ring(2, LatestWins);
+    int item = 0;
+
+    QVERIFY(ring.push(1));
+    QVERIFY(ring.push(2));
+    QVERIFY(ring.push(3));
+    QVERIFY(ring.push(4));
+
+    QCOMPARE(ring.droppedCount(), quint64(2));
+    QCOMPARE(ring.count(), 2);
+
+    QVERIFY(ring.pop(item));
+    QCOMPARE(item, 3);
+    QVERIFY(ring.pop(item));
+    QCOMPARE(item, 4);
+    QVERIFY(!ring.pop(item));
+}
+
+void KernelTests::ringPopLatestSkipsToNewest()
+{
+    SpscRing<int> ring(4, LatestWins);
+    int item = 0;
+
+    QVERIFY(ring.push(1));
+    QVERIFY(ring.push(2));
+    QVERIFY(ring.push(3));
+
+    QVERIFY(ring.popLatest(item));
+    QCOMPARE(item, 3);
+    QCOMPARE(ring.droppedCount(), quint64(2));
+    QCOMPARE(ring.count(), 0);
+}
+
+void KernelTests::throughputNeedsTwoSamples()
+{
+    ThroughputEstimator estimator;
+
+    QCOMPARE(estimator.secondsUntil(1000), qint64(-1));
+
+    estimator.addSample(0, 0);
+    QCOMPARE(estimator.secondsUntil(1000), qint64(-1));
+
+    // nothing written since: no forecast either
+    estimator.addSample(0, 1000);
+    QCOMPARE(estimator.secondsUntil(1000), qint64(-1));
+}
+
+void KernelTests::throughputSteadyRate()
+{
+    ThroughputEstimator estimator;
+
+    for (int s = 0; s <= 10; ++s)
+    {
+        estimator.addSample(qint64(s) * 1000000, qint64(s) * 1000);
+    }
+
+    QVERIFY(qAbs(estimator.bytesPerSecond() - 1e6) < 1.0);
+    QCOMPARE(estimator.secondsUntil(10000000), qint64(10));
+}
+
+void KernelTests::throughputDecaysByElapsedTime()
+{
+    ThroughputEstimator estimator(15.0);
+
+    estimator.addSample(0, 0);
+    estimator.addSample(15000000, 15000);
+    QVERIFY(qAbs(estimator.bytesPerSecond() - 1e6) < 1.0);
+
+    // one smoothing period at twice the rate closes 1 - 1/e of the gap
+    estimator.addSample(15000000 + 30000000, 30000);
+
+    double expected = 1e6 + (1.0 - qExp(-1.0)) * 1e6;
+    QVERIFY(qAbs(estimator.bytesPerSecond() - expected) < 1.0);
+}
+
+void KernelTests::throughputSurvivesCounterRestart()
+{
+    ThroughputEstimator estimator;
+
+    estimator.addSample(0, 0);
+    estimator.addSample(1000000, 1000);
+
+    // a new file restarts the byte count; the rate carries over
+    estimator.addSample(500, 2000);
+    QVERIFY(qAbs(estimator.bytesPerSecond() - 1e6) < 1.0);
+
+    estimator.addSample(1000500, 3000);
+    QVERIFY(qAbs(estimator.bytesPerSecond() - 1e6) < 1.0);
+}
+
+void KernelTests::audioClockStartIgnoresJitter()
+{
+    AudioClock clock;
+    QVERIFY(!clock.isValid());
+
+    // every other buffer is delivered 3 ms late
+    for (int k = 1; k <= 600; ++k)
+    {
+        clock.addBuffer(5000000 + k * 10000 + (k % 2 ? 3000 : 0), 480, 48000);
+    }
+
+    QVERIFY(clock.isValid());
+    QCOMPARE(clock.startUs(), qint64(5000000));
+    QCOMPARE(clock.driftUs(), qint64(0));
+    QCOMPARE(clock.rate(), 1.0);
+    QCOMPARE(clock.frames(), qint64(600 * 480));
+}
+
+void KernelTests::audioClockSlowDevice()
+{
+    AudioClock clock;
+
+    // 10 s at 0.1% slow; the last full window started 2-4 s before the end
+    feedClock(clock, 1000000, 1000, 0.001);
+
+    QVERIFY2(clock.driftUs() > 5900 && clock.driftUs() <= 10010, qPrintable(QString::number(clock.driftUs())));
+    QVERIFY(clock.rate() < 1.0);
+    QVERIFY(clock.rate() > 0.998);
+}
+
+void KernelTests::audioClockFastDevice()
+{
+    AudioClock clock;
+
+    feedClock(clock, 1000000, 1000, -0.001);
+
+    QVERIFY2(clock.driftUs() < -5900 && clock.driftUs() >= -10010, qPrintable(QString::number(clock.driftUs())));
+    QVERIFY(clock.rate() > 1.0);
+    QVERIFY(clock.rate() < 1.002);
+}
+
+void KernelTests::audioClockSampleRateChange()
+{
+    AudioClock clock;
+
+    feedClock(clock, 0, 300, 0.0);
+
+    // a new format starts a new stream
+    clock.addBuffer(4000000, 441, 44100);
+
+    QCOMPARE(clock.sampleRate(), 44100);
+    QCOMPARE(clock.frames(), qint64(441));
+    QCOMPARE(clock.startUs(), qint64(4000000 - 10000));
+    QCOMPARE(clock.driftUs(), qint64(0));
+}
+
+void KernelTests::meterInt16Kernels_data()
+{
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<int>("frames");
+
+    QList<int> channelCounts = QList<int>() << 1 << 2 << 4 << 6 << 8;
+    QList<int> frameCounts = QList<int>() << 0 << 7 << 1001;
+
+    foreach (int channels, channelCounts)
+    {
+        foreach (int frames, frameCounts)
+        {
+            QTest::newRow(qPrintable(QString("%1ch %2").arg(channels).arg(frames))) << channels << frames;
+        }
+    }
+}
+
+void KernelTests::meterInt16Kernels()
+{
+    QFETCH(int, channels);
+    QFETCH(int, frames);
+
+    // full range, so both clip thresholds are crossed
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<int> distribution(-32768, 32767);
+
+    std::vector<qint16> samples(size_t(frames * channels));
+
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        samples[i] = qint16(distribution(generator));
+    }
+
+    compareWithReference(pcmFormat(QAudioFormat::SignedInt, 16, channels), samples, frames);
+}
+
+void KernelTests::meterFloatKernels_data()
+{
+    QTest::addColumn<int>("channels");
+    QTest::addColumn<int>("frames");
+
+    QList<int> channelCounts = QList<int>() << 1 << 2 << 4 << 6;
+    QList<int> frameCounts = QList<int>() << 0 << 3 << 1001;
+
+    foreach (int channels, channelCounts)
+    {
+        foreach (int frames, frameCounts)
+        {
+            QTest::newRow(qPrintable(QString("%1ch %2").arg(channels).arg(frames))) << channels << frames;
+        }
+    }
+}
+
+void KernelTests::meterFloatKernels()
+{
+    QFETCH(int, channels);
+    QFETCH(int, frames);
+
+    std::mt19937 generator(5678);
+    std::uniform_real_distribution<float> distribution(-1.05f, 1.05f);
+
+    std::vector<float> samples(size_t(frames * channels));
+
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        samples[i] = distribution(generator);
+    }
+
+    compareWithReference(pcmFormat(QAudioFormat::Float, 32, channels), samples, frames);
+}
+
+void KernelTests::meterInt16ClipCountDoesNotWrap()
+{
+    // more clipped samples per lane than a 16 bit counter holds
+    const int frames = 600000;
+    std::vector<qint16> samples(frames, qint16(32767));
+
+    AudioMeter meter;
+    AudioLevels levels;
+
+    QVERIFY(meter.measure(samples.data(), frames, pcmFormat(QAudioFormat::SignedInt, 16, 1), levels));
+
+    QCOMPARE(levels.channels, 1);
+    QCOMPARE(levels.clips[0], quint32(frames));
+    QCOMPARE(levels.peak[0], 1.0f);
+}
+
+void KernelTests::meterUnsignedIsCentred()
+{
+    AudioMeter meter;
+    AudioLevels levels;
+    QAudioFormat format = pcmFormat(QAudioFormat::UnSignedInt, 8, 1);
+
+    std::vector<quint8> silence(64, quint8(128));
+
+    QVERIFY(meter.measure(silence.data(), int(silence.size()), format, levels));
+    QCOMPARE(levels.peak[0], 0.0f);
+    QCOMPARE(levels.rms[0], 0.0f);
+    QCOMPARE(levels.clips[0], quint32(0));
+
+    std::vector<quint8> extremes;
+    extremes.push_back(128);
+    extremes.push_back(255);
+    extremes.push_back(0);
+    extremes.push_back(128);
+
+    QVERIFY(meter.measure(extremes.data(), int(extremes.size()), format, levels));
+    QCOMPARE(levels.peak[0], 1.0f);
+    QCOMPARE(levels.clips[0], quint32(2));
+}
+
+void KernelTests::meterRejectsUnsupportedFormats()
+{
+    AudioMeter meter;
+    AudioLevels levels;
+    qint32 sample = 0;
+
+    QVERIFY(!AudioMeter::select(pcmFormat(QAudioFormat::SignedInt, 24, 2)));
+    QVERIFY(!AudioMeter::select(pcmFormat(QAudioFormat::Float, 64, 2)));
+    QVERIFY(!AudioMeter::select(QAudioFormat()));
+
+    QVERIFY(!meter.measure(&sample, 1, pcmFormat(QAudioFormat::SignedInt, 24, 1), levels));
+}
+
+QTEST_APPLESS_MAIN(KernelTests)
+
+#include "tst_kernels.moc"
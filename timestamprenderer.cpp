@@ -0,0 +1,238 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#include <QDateTime>
+
+#include <algorithm>
+#include <string>
+
+#include "timestamprenderer.h"
+
+using namespace cv;
+
+// Layout relative to the bottom edge, matching the original overlay
+static const int boxLeft = 2;
+static const int boxTop = 22;     // rows - 22
+static const int boxBottom = 8;   // rows - 8
+static const int textLeft = 10;
+static const int textBaseline = 10; // rows - 10
+
+///
+/// \brief TimestampRenderer::TimestampRenderer
+///
+/// \param fontStyle
+/// \param fontScale
+/// \param color
+/// \param background
+///
+TimestampRenderer::TimestampRenderer(int fontStyle, double fontScale, Scalar color, Scalar background) :
+    font_style(fontStyle),
+    font_scale(fontScale),
+    text_color(color),
+    box_color(background)
+{
+    buildAtlas();
+}
+
+///
+/// \brief TimestampRenderer::setFormat
+///
+/// QDateTime format string; empty keeps the default QDateTime::toString().
+/// A 'z' field switches the stamp to millisecond resolution.
+///
+/// \param fmt
+///
+void TimestampRenderer::setFormat(const QString &fmt)
+{
+    format = fmt;
+    resolution = format.contains('z') ? 1 : 1000;
+    last_key = -1;
+}
+
+///
+/// \brief TimestampRenderer::buildAtlas
+///
+/// Rasterize each printable ASCII glyph once into its own mask
+///
+void TimestampRenderer::buildAtlas()
+{
+    atlas.clear();
+    atlas.resize(last_glyph - first_glyph + 1);
+
+    ascent = 0;
+    descent = 0;
+
+    for (int c = first_glyph; c <= last_glyph; ++c)
+    {
+        int baseline = 0;
+        Size extent = getTextSize(std::string(1, char(c)), font_style, font_scale, 1, &baseline);
+
+        ascent = std::max(ascent, extent.height);
+        descent = std::max(descent, baseline);
+    }
+
+    // italic glyphs lean past their advance, leave room on both sides
+    const int pad_right = 4;
+
+    for (int c = first_glyph; c <= last_glyph; ++c)
+    {
+        Glyph &glyph = atlas[c - first_glyph];
+
+        int baseline = 0;
+        Size extent = getTextSize(std::string(1, char(c)), font_style, font_scale, 1, &baseline);
+
+        glyph.advance = extent.width;
+        glyph.mask = Mat::zeros(ascent + descent + 1, pad_left + extent.width + pad_right, CV_8UC1);
+
+        putText(glyph.mask, std::string(1, char(c)), Point(pad_left, ascent), font_style, font_scale, Scalar::all(255));
+    }
+}
+
+///
+/// \brief TimestampRenderer::compose
+///
+/// Build the strip (black box + glyphs) for a new text
+///
+/// \param text
+///
+void TimestampRenderer::compose(const QString &text)
+{
+    composed_text = text;
+
+    std::string latin = text.toStdString();
+
+    bool inAtlas = true;
+    int textWidth = 0;
+
+    for (size_t i = 0; i < latin.size(); ++i)
+    {
+        int c = static_cast<unsigned char>(latin[i]);
+
+        if (c < first_glyph || c > last_glyph)
+        {
+            inAtlas = false;
+            break;
+        }
+
+        textWidth += atlas.at(c - first_glyph).advance;
+    }
+
+    if (!inAtlas)
+    {
+        int baseline = 0;
+        textWidth = getTextSize(latin, font_style, font_scale, 1, &baseline).width;
+    }
+
+    // strip origin is the box's top-left corner
+    const int penX = textLeft - boxLeft;
+    const int penY = boxTop - textBaseline;
+
+    int boxWidth = static_cast<int>(latin.length()) * 10 - boxLeft;
+    int width = std::max(boxWidth + 1, penX + textWidth + 4 + 1);
+    int height = std::max(boxTop - boxBottom + 1, penY + descent + 1);
+
+    strip.create(height, width, CV_8UC3);
+    strip_mask.create(height, width, CV_8UC1);
+
+    strip_mask.setTo(Scalar::all(0));
+    rectangle(strip_mask, Point(0, 0), Point(boxWidth, boxTop - boxBottom), Scalar::all(255), CV_FILLED);
+
+    Mat text_mask = Mat::zeros(height, width, CV_8UC1);
+
+    if (inAtlas)
+    {
+        int x = penX;
+
+        for (size_t i = 0; i < latin.size(); ++i)
+        {
+            const Glyph &glyph = atlas.at(static_cast<unsigned char>(latin[i]) - first_glyph);
+
+            Rect dest(x - pad_left, penY - ascent, glyph.mask.cols, glyph.mask.rows);
+            Rect clipped = dest & Rect(0, 0, width, height);
+
+            if (clipped.area() > 0)
+            {
+                Mat src = glyph.mask(Rect(clipped.x - dest.x, clipped.y - dest.y, clipped.width, clipped.height));
+                Mat dst = text_mask(clipped);
+
+                bitwise_or(dst, src, dst);
+            }
+
+            x += glyph.advance;
+        }
+    }
+    else
+    {
+        // characters outside the atlas (localized day/month names)
+        putText(text_mask, latin, Point(penX, penY), font_style, font_scale, Scalar::all(255));
+    }
+
+    strip.setTo(box_color);
+    strip.setTo(text_color, text_mask);
+
+    bitwise_or(strip_mask, text_mask, strip_mask);
+}
+
+///
+/// \brief TimestampRenderer::render
+///
+/// \param frame
+/// \param msecsSinceEpoch
+///
+/// Capture time of the frame
+///
+void TimestampRenderer::render(Mat &frame, qint64 msecsSinceEpoch)
+{
+    qint64 key = msecsSinceEpoch / resolution;
+
+    if (key != last_key)
+    {
+        last_key = key;
+
+        QDateTime datetime = QDateTime::fromMSecsSinceEpoch(msecsSinceEpoch);
+        QString text = format.isEmpty() ? datetime.toString() : datetime.toString(format);
+
+        if (text != composed_text || strip.empty())
+        {
+            compose(text);
+        }
+    }
+
+    Rect dest(boxLeft, frame.rows - boxTop, strip.cols, strip.rows);
+    Rect clipped = dest & Rect(0, 0, frame.cols, frame.rows);
+
+    if (clipped.area() <= 0)
+    {
+        return;
+    }
+
+    Rect local(clipped.x - dest.x, clipped.y - dest.y, clipped.width, clipped.height);
+
+    Mat target = frame(clipped);
+
+    strip(local).copyTo(target, strip_mask(local));
+}
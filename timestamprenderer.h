@@ -0,0 +1,88 @@
+/****************************************************************************
+
+    Copyright 2018 Shawn Gilroy
+
+    This file is part of Session Recorder.
+
+    Session Recorder is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    Session Recorder is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Session Recorder.  If not, see http://www.gnu.org/licenses/.
+
+    The Session Recorder is a tool to assist researchers in clinical behavioral research.
+
+    This file was adapted from meeting-recorder (MIT), which was based on Qt Examples
+    provided by Digia (BSD-3)
+
+    Email: shawn(dot)gilroy(at)temple.edu
+
+****************************************************************************/
+
+#ifndef TIMESTAMPRENDERER_H
+#define TIMESTAMPRENDERER_H
+
+#include <QString>
+#include <QVector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+///
+/// \brief The TimestampRenderer class
+///
+/// Draws the bottom-of-frame clock from a glyph atlas rasterized once up
+/// front. The stamp is only re-composed when its visible text changes (once
+/// a second, or every frame for formats with a millisecond field); all
+/// other frames get a masked copy of the cached strip.
+///
+class TimestampRenderer
+{
+public:
+    TimestampRenderer(int fontStyle, double fontScale, cv::Scalar color, cv::Scalar background);
+
+    void setFormat(const QString &format);
+
+    void render(cv::Mat &frame, qint64 msecsSinceEpoch);
+
+private:
+    struct Glyph
+    {
+        cv::Mat mask;
+        int advance = 0;
+    };
+
+    void buildAtlas();
+    void compose(const QString &text);
+
+    int font_style;
+    double font_scale;
+
+    cv::Scalar text_color;
+    cv::Scalar box_color;
+
+    // printable ASCII, indexed by (c - first_glyph)
+    static const int first_glyph = 32;
+    static const int last_glyph = 126;
+    QVector<Glyph> atlas;
+
+    int ascent = 0;
+    int descent = 0;
+    int pad_left = 2;
+
+    QString format;
+    qint64 resolution = 1000;
+    qint64 last_key = -1;
+
+    QString composed_text;
+    cv::Mat strip;
+    cv::Mat strip_mask;
+};
+
+#endif // TIMESTAMPRENDERER_H